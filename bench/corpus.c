@@ -0,0 +1,267 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+#include <stdarg.h>
+
+#include "corpus.h"
+
+// Every statement generated is smaller than it
+#define CORPUS_STMT_MAX     (16384)
+#define CORPUS_VAR_NUM      (8)
+#define CORPUS_UNIT_STMTS   (8)
+
+typedef struct corpus_t {
+    char    *buf;
+    int      size;
+    int      len;
+    int      error;
+    uint32_t seed;
+} corpus_t;
+
+typedef void (*corpus_stmt_t)(corpus_t *c, int n);
+
+static const char *corpus_names[CORPUS_MAX] = {
+    "object", "function", "expression", "table"
+};
+
+static const char *corpus_words[] = {
+    "name", "id", "type", "mode", "rate", "size", "pin", "port",
+    "enable", "level", "delay", "count", "next", "conf", "list", "data"
+};
+#define CORPUS_WORD_NUM (sizeof(corpus_words) / sizeof(corpus_words[0]))
+
+static const char *corpus_operators[] = {
+    "+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>",
+    "==", "!=", "<", ">=", "&&", "||"
+};
+#define CORPUS_OP_NUM (sizeof(corpus_operators) / sizeof(corpus_operators[0]))
+
+// Same sequence at every run, to make results comparable.
+// Range of literals is kept in the number & string tables of env.
+static uint32_t corpus_rand(corpus_t *c, uint32_t n)
+{
+    c->seed = c->seed * 1103515245 + 12345;
+    return (c->seed >> 8) % n;
+}
+
+static void corpus_put(corpus_t *c, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (c->error) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(c->buf + c->len, c->size - c->len, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || n >= c->size - c->len) {
+        c->error = 1;
+    } else {
+        c->len += n;
+    }
+}
+
+static inline int corpus_room(corpus_t *c)
+{
+    return !c->error && c->len + CORPUS_STMT_MAX < c->size;
+}
+
+static void corpus_declare(corpus_t *c, int indent, const char *prefix, const char *init)
+{
+    int i;
+
+    corpus_put(c, "%*svar ", indent, "");
+    for (i = 0; i < CORPUS_VAR_NUM; i++) {
+        corpus_put(c, "%s%d%s%s", prefix, i, init, i + 1 < CORPUS_VAR_NUM ? ", " : ";\n");
+    }
+}
+
+/*
+ * Statements are grouped into functions, as modules of a real program,
+ * to keep code size of each function and variables in limit.
+ */
+static void corpus_units(corpus_t *c, corpus_stmt_t stmt)
+{
+    int n = 0;
+
+    corpus_declare(c, 0, "lib", " = {}");
+    while (corpus_room(c)) {
+        int i;
+
+        corpus_put(c, "lib%d.m%d = def (a, b, c) {\n", n % CORPUS_VAR_NUM, n / CORPUS_VAR_NUM % 256);
+        corpus_declare(c, 4, "v", " = {}");
+        for (i = 0; i < CORPUS_UNIT_STMTS && corpus_room(c); i++) {
+            stmt(c, n * CORPUS_UNIT_STMTS + i);
+        }
+        corpus_put(c, "    return v%d;\n};\n", n % CORPUS_VAR_NUM);
+        n++;
+    }
+}
+
+static void corpus_value(corpus_t *c)
+{
+    switch (corpus_rand(c, 5)) {
+    case 0: corpus_put(c, "%u", corpus_rand(c, 4096)); break;
+    case 1: corpus_put(c, "%u.%u", corpus_rand(c, 256), corpus_rand(c, 16)); break;
+    case 2: corpus_put(c, "'%s%u'", corpus_words[corpus_rand(c, CORPUS_WORD_NUM)], corpus_rand(c, 64)); break;
+    case 3: corpus_put(c, corpus_rand(c, 2) ? "true" : "false"); break;
+    default: corpus_put(c, "[%u, %u, %u]", corpus_rand(c, 10), corpus_rand(c, 100), corpus_rand(c, 1000));
+    }
+}
+
+static void corpus_object(corpus_t *c, int depth, int indent)
+{
+    int i, n = 2 + corpus_rand(c, 3);
+    int deep = corpus_rand(c, n);
+
+    corpus_put(c, "{\n");
+    for (i = 0; i < n; i++) {
+        corpus_put(c, "%*s%s: ", indent + 4, "", corpus_words[(i * 5 + depth) % CORPUS_WORD_NUM]);
+        if (i == deep && depth > 0) {
+            corpus_object(c, depth - 1, indent + 4);
+        } else {
+            corpus_value(c);
+        }
+        corpus_put(c, i + 1 < n ? ",\n" : "\n");
+    }
+    corpus_put(c, "%*s}", indent, "");
+}
+
+static void corpus_gen_object(corpus_t *c, int n)
+{
+    (void) n;
+
+    corpus_put(c, "    v%u = ", corpus_rand(c, CORPUS_VAR_NUM));
+    corpus_object(c, 6 + corpus_rand(c, 16), 4);
+    corpus_put(c, ";\n");
+}
+
+static void corpus_gen_function(corpus_t *c, int n)
+{
+    int k = corpus_rand(c, 100);
+
+    corpus_put(c, "    v%d.f%d = def (a, b, c) {\n", n % CORPUS_VAR_NUM, n / CORPUS_VAR_NUM % 256);
+    corpus_put(c, "        var t = a * %d + b, i = 0;\n", k);
+    switch (n % 3) {
+    case 0:
+        corpus_put(c, "        if (t > c) {\n            return t - c;\n        } else if (t == c) {\n            return 0;\n        }\n");
+        break;
+    case 1:
+        corpus_put(c, "        while (i < %d) {\n            t = t + i * c;\n            i = i + 1;\n        }\n", k);
+        break;
+    default:
+        corpus_put(c, "        var o = {x: t, y: c, z: [a, b, %d]};\n        t = o.x + o.z[2];\n", k);
+    }
+    corpus_put(c, "        return t;\n    };\n");
+}
+
+static void corpus_expression(corpus_t *c, int depth)
+{
+    if (depth == 0) {
+        switch (corpus_rand(c, 4)) {
+        case 0: corpus_put(c, "%u", corpus_rand(c, 1000)); break;
+        case 1: corpus_put(c, "v%u.%s", corpus_rand(c, CORPUS_VAR_NUM), corpus_words[corpus_rand(c, CORPUS_WORD_NUM)]); break;
+        default: corpus_put(c, "v%u", corpus_rand(c, CORPUS_VAR_NUM));
+        }
+    } else {
+        int paren = corpus_rand(c, 2);
+
+        corpus_put(c, paren ? "(" : "");
+        corpus_expression(c, depth - 1);
+        corpus_put(c, " %s ", corpus_operators[corpus_rand(c, CORPUS_OP_NUM)]);
+        corpus_expression(c, corpus_rand(c, depth));
+        corpus_put(c, paren ? ")" : "");
+    }
+}
+
+static void corpus_gen_expression(corpus_t *c, int n)
+{
+    (void) n;
+
+    corpus_put(c, "    v%u = ", corpus_rand(c, CORPUS_VAR_NUM));
+    corpus_expression(c, 4 + corpus_rand(c, 6));
+    corpus_put(c, ";\n");
+}
+
+static void corpus_gen_table(corpus_t *c, int n)
+{
+    int i, size = 64 + corpus_rand(c, 192);
+
+    (void) n;
+
+    corpus_put(c, "    v%u = [", corpus_rand(c, CORPUS_VAR_NUM));
+    for (i = 0; i < size; i++) {
+        if (i % 8 == 0) {
+            corpus_put(c, "\n        ");
+        }
+        switch (corpus_rand(c, 4)) {
+        case 0: corpus_put(c, "%u", corpus_rand(c, 4096)); break;
+        case 1: corpus_put(c, "%u.%03u", corpus_rand(c, 512), corpus_rand(c, 8) * 125); break;
+        case 2: corpus_put(c, "0x%X", corpus_rand(c, 4096)); break;
+        default: corpus_put(c, "\"%s_%u\"", corpus_words[corpus_rand(c, CORPUS_WORD_NUM)], corpus_rand(c, 256));
+        }
+        corpus_put(c, i + 1 == size ? "\n" : (i + 1) % 8 ? ", " : ",");
+    }
+    corpus_put(c, "    ];\n");
+}
+
+const char *corpus_name(int kind)
+{
+    return kind >= 0 && kind < CORPUS_MAX ? corpus_names[kind] : NULL;
+}
+
+int corpus_kind(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CORPUS_MAX; i++) {
+        if (!strcmp(name, corpus_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int corpus_generate(int kind, char *buf, int size)
+{
+    corpus_t c;
+
+    if (!buf || size <= CORPUS_STMT_MAX * 2) {
+        return -1;
+    }
+
+    c.buf = buf;
+    c.size = size;
+    c.len = 0;
+    c.error = 0;
+    c.seed = 1 + kind;
+
+    switch (kind) {
+    case CORPUS_OBJECT:     corpus_units(&c, corpus_gen_object); break;
+    case CORPUS_FUNCTION:   corpus_units(&c, corpus_gen_function); break;
+    case CORPUS_EXPRESSION: corpus_units(&c, corpus_gen_expression); break;
+    case CORPUS_TABLE:      corpus_units(&c, corpus_gen_table); break;
+    default: return -1;
+    }
+
+    return c.error ? -1 : c.len;
+}
@@ -0,0 +1,40 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+
+#ifndef __BENCH_CORPUS_INC__
+#define __BENCH_CORPUS_INC__
+
+#include "lang/def.h"
+
+enum {
+    CORPUS_OBJECT = 0,      // deeply nested object literals
+    CORPUS_FUNCTION,        // thousands of small functions
+    CORPUS_EXPRESSION,      // long arithmetic & logic expressions
+    CORPUS_TABLE,           // big tables of number & string literals
+    CORPUS_MAX
+};
+
+const char *corpus_name(int kind);
+int corpus_kind(const char *name);
+
+// Fill buf with about size bytes of source, return: length of source, < 0 on error
+int corpus_generate(int kind, char *buf, int size);
+
+#endif /* __BENCH_CORPUS_INC__ */
@@ -0,0 +1,343 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+#include <time.h>
+#include <unistd.h>
+
+#include "lang/lex.h"
+#include "lang/parse.h"
+#include "lang/compile.h"
+
+#include "corpus.h"
+
+#define BENCH_MIN_TIME      (0.5)       // seconds spent at least, by each phase
+#define BENCH_MIN_ROUND     (3)
+#define BENCH_ENV_SIZE      (2 * 1024 * 1024)
+#define BENCH_NUMBER_MAX    (16384)
+#define BENCH_STRING_MAX    (16384)
+#define BENCH_MEM_RATIO     (64)        // workspace size, times of source size
+#define BENCH_MEM_MARK      (0xA5)
+
+typedef struct bench_t {
+    const char *name;
+    const char *src;
+    int         len;
+
+    uint8_t    *mem;            // workspace of parse & compile
+    int         mem_size;
+    uint8_t    *env_mem;
+    int         env_size;
+    env_t       env;
+
+    // result of the current phase
+    int         round;
+    double      time;
+    int         peak;
+    int         error;
+} bench_t;
+
+typedef struct bench_phase_t {
+    const char *name;
+    int (*run)(bench_t *b);
+    int (*peak)(bench_t *b);
+} bench_phase_t;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Heaps are bump allocated, the highest byte touched is the peak use
+static int bench_peak(bench_t *b)
+{
+    int i = b->mem_size;
+
+    while (i > 0 && b->mem[i - 1] == BENCH_MEM_MARK) {
+        i--;
+    }
+    return i;
+}
+
+static int bench_env_setup(bench_t *b)
+{
+    // As compile_env_init, with tables bigger than its default
+    return env_init(&b->env, b->env_mem, b->env_size, NULL, 0, NULL, 0,
+                    BENCH_NUMBER_MAX, BENCH_STRING_MAX, 0, 0, 0);
+}
+
+static int bench_lex(bench_t *b)
+{
+    lexer_t lex;
+    token_t tok;
+    double t;
+
+    t = bench_now();
+    lex_init(&lex, b->src, NULL);
+    while (TOK_EOF != lex_token(&lex, &tok)) {
+        lex_match(&lex, tok.type);
+    }
+    lex_deinit(&lex);
+    b->time += bench_now() - t;
+
+    return 0;
+}
+
+static stmt_t *bench_parse_stmts(bench_t *b, parser_t *psr)
+{
+    stmt_t *stmt;
+
+    parse_init(psr, b->src, NULL, b->mem, b->mem_size);
+    if (!(stmt = parse_stmt_multi(psr))) {
+        b->error = psr->error ? psr->error : ERR_InvalidInput;
+    }
+    return stmt;
+}
+
+static int bench_parse(bench_t *b)
+{
+    parser_t psr;
+    double t;
+
+    t = bench_now();
+    bench_parse_stmts(b, &psr);
+    b->time += bench_now() - t;
+
+    return b->error;
+}
+
+static int bench_compile(bench_t *b)
+{
+    parser_t psr;
+    compile_t cpl;
+    stmt_t *stmt;
+    double t;
+
+    // The AST may be rewritten by compile, parse it again in each round
+    if (bench_env_setup(b) || !(stmt = bench_parse_stmts(b, &psr))) {
+        return b->error ? b->error : ERR_NotEnoughMemory;
+    }
+
+    t = bench_now();
+    compile_init(&cpl, &b->env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
+    if (compile_multi_stmt(&cpl, stmt)) {
+        b->error = cpl.error;
+    }
+    compile_deinit(&cpl);
+    b->time += bench_now() - t;
+
+    // Peak of the compile heap only
+    b->peak = -psr.heap.free;
+    return b->error;
+}
+
+static int bench_exe(bench_t *b)
+{
+    double t;
+    int size;
+
+    if (bench_env_setup(b)) {
+        return ERR_NotEnoughMemory;
+    }
+
+    t = bench_now();
+    size = compile_exe(&b->env, b->src, b->mem, b->mem_size);
+    b->time += bench_now() - t;
+
+    if (size <= 0) {
+        b->error = size < 0 ? -size : ERR_InvalidInput;
+    }
+    return b->error;
+}
+
+// The image is laid out over the whole memory given, so the peak is taken
+// as the smallest memory compile_exe could be done in.
+static int bench_exe_peak(bench_t *b)
+{
+    int lo = 0, hi = b->mem_size;
+
+    while (hi - lo > 1024) {
+        int mid = SIZE_ALIGN_16((lo + hi) / 2);
+
+        if (bench_env_setup(b) || 0 >= compile_exe(&b->env, b->src, b->mem, mid)) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return hi;
+}
+
+static const bench_phase_t bench_phases[] = {
+    {"lex",     bench_lex,     bench_peak},
+    {"parse",   bench_parse,   bench_peak},
+    {"compile", bench_compile, bench_peak},
+    {"exe",     bench_exe,     bench_exe_peak},
+};
+
+static void bench_run(bench_t *b, const bench_phase_t *phase)
+{
+    double mbs;
+
+    b->round = 0;
+    b->time = 0;
+    b->peak = 0;
+    b->error = 0;
+
+    memset(b->mem, BENCH_MEM_MARK, b->mem_size);
+    while (b->round < BENCH_MIN_ROUND || b->time < BENCH_MIN_TIME) {
+        if (phase->run(b)) {
+            printf("%-12s %-8s fail: %d\n", b->name, phase->name, b->error);
+            return;
+        }
+        b->round++;
+    }
+    b->peak += phase->peak(b);
+
+    mbs = (double)b->len * b->round / b->time / (1024 * 1024);
+    printf("%-12s %-8s %10d %10.2f %10d %8d\n", b->name, phase->name,
+           b->len / 1024, mbs, b->peak / 1024, b->round);
+}
+
+static int bench_source(const char *name, const char *src, int len)
+{
+    bench_t b;
+    unsigned i;
+
+    b.name = name;
+    b.src = src;
+    b.len = len;
+    b.mem_size = SIZE_ALIGN_16(len * BENCH_MEM_RATIO + 1024 * 1024);
+    b.mem = malloc(b.mem_size);
+    b.env_mem = malloc(BENCH_ENV_SIZE);
+    b.env_size = BENCH_ENV_SIZE;
+    if (!b.mem || !b.env_mem || bench_env_setup(&b)) {
+        free(b.mem);
+        free(b.env_mem);
+        return -1;
+    }
+
+    // Size of symbol buffer, the rest of env memory, is 16 bits
+    b.env_size = (uint8_t *)b.env.symbal_buf - b.env_mem + UINT16_MAX;
+
+    for (i = 0; i < sizeof(bench_phases) / sizeof(bench_phases[0]); i++) {
+        bench_run(&b, bench_phases + i);
+    }
+
+    free(b.mem);
+    free(b.env_mem);
+    return 0;
+}
+
+static char *bench_file_load(const char *name, int *len)
+{
+    FILE *fp = fopen(name, "rb");
+    char *buf = NULL;
+    long size;
+
+    if (!fp) {
+        return NULL;
+    }
+
+    if (0 == fseek(fp, 0, SEEK_END) && (size = ftell(fp)) >= 0 &&
+        0 == fseek(fp, 0, SEEK_SET) && (buf = malloc(size + 1))) {
+        if (fread(buf, 1, size, fp) == (size_t)size) {
+            buf[size] = 0;
+            *len = size;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+
+    return buf;
+}
+
+static void usage(const char *prog)
+{
+    int i;
+
+    printf("Usage: %s [-s size_kb] [-d corpus] [file ...]\n", prog);
+    printf("  -s  size of each corpus generated, in KB\n");
+    printf("  -d  dump the corpus generated, one of:");
+    for (i = 0; i < CORPUS_MAX; i++) {
+        printf(" %s", corpus_name(i));
+    }
+    printf("\n  Without file, all corpus generated are measured\n");
+}
+
+int main(int ac, char **av)
+{
+    int size = 512 * 1024, dump = -1;
+    int i, len, opt;
+    char *src;
+
+    while ((opt = getopt(ac, av, "s:d:h")) != -1) {
+        switch (opt) {
+        case 's': size = atoi(optarg) * 1024; break;
+        case 'd':
+            if ((dump = corpus_kind(optarg)) < 0) {
+                usage(av[0]);
+                return 1;
+            }
+            break;
+        default: usage(av[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (dump < 0) {
+        printf("%-12s %-8s %10s %10s %10s %8s\n", "source", "phase", "size(KB)", "MB/s", "peak(KB)", "rounds");
+    }
+
+    if (optind < ac) {
+        for (i = optind; i < ac; i++) {
+            if (!(src = bench_file_load(av[i], &len))) {
+                printf("%s: load fail\n", av[i]);
+                return 1;
+            }
+            bench_source(av[i], src, len);
+            free(src);
+        }
+        return 0;
+    }
+
+    if (!(src = malloc(size))) {
+        return 1;
+    }
+
+    for (i = 0; i < CORPUS_MAX; i++) {
+        if (dump >= 0 && dump != i) {
+            continue;
+        }
+
+        if ((len = corpus_generate(i, src, size)) < 0) {
+            printf("%s: generate fail\n", corpus_name(i));
+        } else if (dump >= 0) {
+            fwrite(src, 1, len, stdout);
+        } else {
+            bench_source(corpus_name(i), src, len);
+        }
+    }
+    free(src);
+
+    return 0;
+}
@@ -42,7 +42,8 @@ static int compile(const char *input, void *mem_ptr, int mem_size)
     char *output  = (char *) mem_ptr;
     void *cpl_mem, *exe_mem;
     env_t env;
-    int cpl_mem_sz, exe_mem_sz, input_sz;
+    file_input_t in;
+    int cpl_mem_sz, exe_mem_sz;
     int exe_sz;
 
     exe_mem_sz = (mem_size / 3) & (~0xf);
@@ -61,15 +62,14 @@ static int compile(const char *input, void *mem_ptr, int mem_size)
 
     native_init(&env);
 
-    input = file_load(input, &input_sz);
-    if (!input) {
+    if (0 != file_input_open(&in, input)) {
         return -1;
     }
 
-    exe_sz = compile_exe(&env, input, exe_mem, exe_mem_sz);
-    file_release((void *)input, input_sz);
+    exe_sz = compile_exe_input(&env, file_input, &in, exe_mem, exe_mem_sz);
+    file_input_close(&in);
 
-    if (exe_sz <= 0) {
+    if (exe_sz <= 0 || in.error) {
         return -1;
     } else {
         return file_store(output, exe_mem, exe_sz);
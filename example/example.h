@@ -33,6 +33,17 @@ int file_release(void *map, int sz);
 int file_store(const char *name, void *data, int len);
 int file_base_name(const char *name, void *buf, int sz);
 
+#define FILE_INPUT_CHUNK    (4096)
+typedef struct file_input_t {
+    int  fd;
+    int  error;
+    char chunk[FILE_INPUT_CHUNK];
+} file_input_t;
+
+int file_input_open(file_input_t *in, const char *name);
+int file_input_close(file_input_t *in);
+int file_input(void *ud, const char **chunk);
+
 int native_init(env_t *env);
 
 #endif /* __EXAMPLE_INC__ */
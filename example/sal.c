@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#include "example.h"
 
 int output(const char *s)
 {
@@ -85,6 +88,38 @@ int file_store(const char *name, void *buf, int sz)
     return 0;
 }
 
+int file_input_open(file_input_t *in, const char *name)
+{
+    in->error = 0;
+    in->fd = open(name, O_RDONLY);
+
+    return in->fd < 0 ? -1 : 0;
+}
+
+int file_input_close(file_input_t *in)
+{
+    return close(in->fd);
+}
+
+// Input of lexer, read the file chunk by chunk
+int file_input(void *ud, const char **chunk)
+{
+    file_input_t *in = ud;
+    int n;
+
+    do {
+        n = read(in->fd, in->chunk, FILE_INPUT_CHUNK);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        in->error = errno;
+        return 0;
+    }
+
+    *chunk = in->chunk;
+    return n;
+}
+
 int file_base_name(const char *name, void *buf, int sz)
 {
     const char *base = rindex(name, '/');
@@ -23,11 +23,11 @@ void ast_traveral_expr(expr_t *e, void (*cb)(void *, expr_t *), void *ud)
 {
     if (e) {
         if (e->type > EXPR_STRING) {
-            ast_traveral_expr(e->body.child.lft, cb, ud);
+            ast_traveral_expr(ast_expr_lft(e), cb, ud);
         }
 
         if (e->type > EXPR_DICT) {
-            ast_traveral_expr(e->body.child.rht, cb, ud);
+            ast_traveral_expr(ast_expr_rht(e), cb, ud);
         }
 
         cb(ud, e);
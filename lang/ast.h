@@ -114,35 +114,89 @@ enum STMT_TYPE {
     STMT_THROW,
     STMT_TRY,
     STMT_PASS,
+    STMT_SWITCH,        // expr: value to dispatch, block: list of case
+    STMT_CASE,          // expr: value of case, NULL for default; block: statements
+    STMT_FOR_IN,        // expr: "id in object", block: statements, other: declare of id
+    STMT_FOR_OF,        // expr: same as for in, iterate the values
+    STMT_CONST,         // expr: list of "id = value"
 };
 
-struct expr_t;
+/*
+ * Nodes are linked by 32 bits offset from the node itself, 0 for none,
+ * which halves the links on 64 bits target; nodes of a tree should be
+ * allocated in one heap.
+ */
+typedef int32_t ast_ref_t;
+
+static inline void *ast_ref_get(const void *node, ast_ref_t ref) {
+    return ref ? (char *)node + ref : NULL;
+}
+
+static inline ast_ref_t ast_ref_make(const void *node, const void *to) {
+    return to ? (ast_ref_t)((const char *)to - (const char *)node) : 0;
+}
+
 typedef struct stmt_t {
     int type;
 
-    struct expr_t *expr;
-    struct stmt_t *block;
-    struct stmt_t *other;
+    ast_ref_t expr;
+    ast_ref_t block;
+    ast_ref_t other;
 
-    struct stmt_t *next;
+    ast_ref_t next;
 } stmt_t;
 
 typedef struct expr_t {
-    int type;
-    int line, col;
+    uint16_t type;
+    uint16_t col;               // saturated at 65535
+    uint32_t line;
     union {
         union {
-            char   *str;
+            char   *str;        // interned for identifier
             double  num;
             stmt_t *proc;
         } data;
         struct {
-            struct expr_t *lft;
-            struct expr_t *rht;
+            ast_ref_t lft;
+            ast_ref_t rht;
         } child;
     } body;
 } expr_t;
 
+static inline struct expr_t *ast_stmt_expr(stmt_t *s) {
+    return ast_ref_get(s, s->expr);
+}
+
+static inline stmt_t *ast_stmt_block(stmt_t *s) {
+    return ast_ref_get(s, s->block);
+}
+
+static inline stmt_t *ast_stmt_other(stmt_t *s) {
+    return ast_ref_get(s, s->other);
+}
+
+static inline stmt_t *ast_stmt_next(stmt_t *s) {
+    return ast_ref_get(s, s->next);
+}
+
+static inline void ast_stmt_set_next(stmt_t *s, stmt_t *next) {
+    s->next = ast_ref_make(s, next);
+}
+
+static inline void ast_stmt_set_block(stmt_t *s, stmt_t *block) {
+    s->block = ast_ref_make(s, block);
+}
+
+
+// Source of function, from "def" to the end of body, follows the proc node
+typedef struct ast_span_t {
+    uint32_t start;
+    uint32_t size;
+} ast_span_t;
+
+static inline ast_span_t *ast_expr_span(expr_t *proc) {
+    return (ast_span_t *)(proc + 1);
+}
 
 static inline const char * ast_expr_text(expr_t *e) {
     return e->body.data.str;
@@ -161,19 +215,24 @@ static inline int ast_expr_type(expr_t *e) {
 }
 
 static inline expr_t *ast_expr_lft(expr_t *e) {
-    return e->body.child.lft;
+    return ast_ref_get(e, e->body.child.lft);
 }
 
 static inline expr_t *ast_expr_rht(expr_t *e) {
-    return e->body.child.rht;
+    return ast_ref_get(e, e->body.child.rht);
 }
 
 static inline void ast_expr_set_lft(expr_t *e, expr_t *lft) {
-    e->body.child.lft = lft;
+    e->body.child.lft = ast_ref_make(e, lft);
 }
 
 static inline void ast_expr_set_rht(expr_t *e, expr_t *rht) {
-    e->body.child.rht = rht;
+    e->body.child.rht = ast_ref_make(e, rht);
+}
+
+static inline void ast_expr_set_pos(expr_t *e, expr_t *from) {
+    e->line = from->line;
+    e->col  = from->col;
 }
 
 void ast_traveral_expr(expr_t *e, void (*cb)(void *, expr_t *), void *ud);
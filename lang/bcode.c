@@ -164,6 +164,11 @@ int bcode_parse(const uint8_t *code, int *offset, const char **name, int *param1
     case BC_LSHIFT_ASSIGN:     *name = "LS_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_RSHIFT_ASSIGN:     *name = "RS_ASSIGN"; if(offset) *offset = shift; return 0;
 
+    case BC_PROP_INC:        *name = "PROP_INC"; if(offset) *offset = shift; return 0;
+    case BC_PROP_INCP:       *name = "PROP_INCP"; if(offset) *offset = shift; return 0;
+    case BC_PROP_DEC:        *name = "PROP_DEC"; if(offset) *offset = shift; return 0;
+    case BC_PROP_DECP:       *name = "PROP_DECP"; if(offset) *offset = shift; return 0;
+
     case BC_PROP_ASSIGN:     *name = "PROP_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_PROP_ADD_ASSIGN: *name = "PROP_ADD_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_PROP_SUB_ASSIGN: *name = "PROP_SUB_ASSIGN"; if(offset) *offset = shift; return 0;
@@ -176,6 +181,11 @@ int bcode_parse(const uint8_t *code, int *offset, const char **name, int *param1
     case BC_PROP_LSHIFT_ASSIGN:     *name = "PROP_LS_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_PROP_RSHIFT_ASSIGN:     *name = "PROP_RS_ASSIGN"; if(offset) *offset = shift; return 0;
 
+    case BC_ELEM_INC:        *name = "ELEM_INC"; if(offset) *offset = shift; return 0;
+    case BC_ELEM_INCP:       *name = "ELEM_INCP"; if(offset) *offset = shift; return 0;
+    case BC_ELEM_DEC:        *name = "ELEM_DEC"; if(offset) *offset = shift; return 0;
+    case BC_ELEM_DECP:       *name = "ELEM_DECP"; if(offset) *offset = shift; return 0;
+
     case BC_ELEM_ASSIGN:*name = "ELEM_ASSING"; if(offset) *offset = shift; return 0;
     case BC_ELEM_ADD_ASSIGN: *name = "ELEM_ADD_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_ELEM_SUB_ASSIGN: *name = "ELEM_SUB_ASSIGN"; if(offset) *offset = shift; return 0;
@@ -188,6 +198,49 @@ int bcode_parse(const uint8_t *code, int *offset, const char **name, int *param1
     case BC_ELEM_LSHIFT_ASSIGN:     *name = "ELEM_LS_ASSIGN"; if(offset) *offset = shift; return 0;
     case BC_ELEM_RSHIFT_ASSIGN:     *name = "ELEM_RS_ASSIGN"; if(offset) *offset = shift; return 0;
 
+    case BC_ADD_NUM:    *name = "ADD_NUM"; if(offset) *offset = shift; return 0;
+    case BC_SUB_NUM:    *name = "SUB_NUM"; if(offset) *offset = shift; return 0;
+    case BC_MUL_NUM:    *name = "MUL_NUM"; if(offset) *offset = shift; return 0;
+
+    case BC_TGT_NUM:    *name = "TGT_NUM"; if(offset) *offset = shift; return 0;
+    case BC_TGE_NUM:    *name = "TGE_NUM"; if(offset) *offset = shift; return 0;
+    case BC_TLT_NUM:    *name = "TLT_NUM"; if(offset) *offset = shift; return 0;
+    case BC_TLE_NUM:    *name = "TLE_NUM"; if(offset) *offset = shift; return 0;
+
+    case BC_INC_NUM:    *param1 = code[shift++];
+                        *name = "INC_NUM"; if(offset) *offset = shift; return 1;
+    case BC_INCP_NUM:   *param1 = code[shift++];
+                        *name = "INCP_NUM"; if(offset) *offset = shift; return 1;
+    case BC_DEC_NUM:    *param1 = code[shift++];
+                        *name = "DEC_NUM"; if(offset) *offset = shift; return 1;
+    case BC_DECP_NUM:   *param1 = code[shift++];
+                        *name = "DECP_NUM"; if(offset) *offset = shift; return 1;
+
+    case BC_POP_VAR:    *param1 = code[shift++];
+                        *name = "POP_VAR"; if(offset) *offset = shift; return 1;
+
+    case BC_CASE:       index = (int8_t) (code[shift++]);
+                        *param1 = (index << 8) | (code[shift++]);
+                        *name = "CASE"; if(offset) *offset = shift; return 1;
+
+    case BC_SWITCH_NUM: *param1 = bcode_switch_default(code + shift - 1);
+                        *param2 = bcode_switch_size(code + shift - 1);
+                        shift += bcode_switch_length(code + shift - 1) - 1;
+                        *name = "SWITCH_NUM"; if(offset) *offset = shift; return 2;
+
+    case BC_SWITCH_HASH:*param1 = bcode_switch_default(code + shift - 1);
+                        *param2 = bcode_switch_size(code + shift - 1);
+                        shift += bcode_switch_length(code + shift - 1) - 1;
+                        *name = "SWITCH_HASH"; if(offset) *offset = shift; return 2;
+
+    case BC_ITER:       *name = "ITER"; if(offset) *offset = shift; return 0;
+    case BC_ITER_KEY:   index = (int8_t) (code[shift++]);
+                        *param1 = (index << 8) | (code[shift++]);
+                        *name = "ITER_KEY"; if(offset) *offset = shift; return 1;
+    case BC_ITER_VAL:   index = (int8_t) (code[shift++]);
+                        *param1 = (index << 8) | (code[shift++]);
+                        *name = "ITER_VAL"; if(offset) *offset = shift; return 1;
+
     default:            *name = "UNKNOWN"; if(offset) *offset = shift; return 0;
     }
 }
@@ -144,8 +144,105 @@ typedef enum bcode_t {
     BC_ARRAY,
     BC_DICT,
 
+    // Operands are proven be number by compiler
+    BC_ADD_NUM,
+    BC_SUB_NUM,
+    BC_MUL_NUM,
+
+    BC_TGT_NUM,
+    BC_TGE_NUM,
+    BC_TLT_NUM,
+    BC_TLE_NUM,
+
+    BC_INC_NUM,
+    BC_INCP_NUM,
+    BC_DEC_NUM,
+    BC_DECP_NUM,
+
+    BC_POP_VAR,
+
+    // Dispatch of switch statement
+    BC_CASE,
+    BC_SWITCH_NUM,
+    BC_SWITCH_HASH,
+
+    // Iteration of for in & for of
+    BC_ITER,
+    BC_ITER_KEY,
+    BC_ITER_VAL,
+
 } bcode_t;
 
+/*
+ * Switch instructions pop the value, and jump to the target of matched case
+ * or the default one. Offsets are relative to the end of instruction.
+ *
+ * SWITCH_NUM:  min(int16), num(uint16), default(int16), offset(int16) * num
+ *              case values are the integers in [min, min + num)
+ * SWITCH_HASH: bits(uint8), rbits(uint8), default(int16), seed(uint8) * (1 << rbits),
+ *              {constant(uint16), offset(int16)} * (1 << bits)
+ *              perfect hash of the constants: seed is selected by low bits of
+ *              the hash of value, constant is string id or number id | 0x8000,
+ *              0xFFFF for empty slot.
+ * CASE:        offset(int16), pop the value of case, if it equal to value on top,
+ *              pop the value also and jump.
+ */
+/*
+ * ITER:        replace the object on top by the iterator, two values: object
+ *              and cursor.
+ * ITER_KEY:    offset(int16), push the next key (index of array) of iterator,
+ * ITER_VAL:    offset(int16), push the next value of iterator,
+ *              jump if iterator be exhausted. Iterator may be under the
+ *              reference of loop variable.
+ */
+#define BCODE_SWITCH_NONE   0xFFFF
+#define BCODE_SWITCH_NUMBER 0x8000
+
+static inline int bcode_switch_slot(uint32_t h, int seed, int bits) {
+    return ((h ^ (seed * 0x9E3779B9u)) * 0x85EBCA6Bu) >> (32 - bits);
+}
+
+// number of offsets in table of switch instruction
+static inline int bcode_switch_size(const uint8_t *code) {
+    if (code[0] == BC_SWITCH_NUM) {
+        return code[3] * 0x100 + code[4];
+    } else {
+        return 1 << code[1];
+    }
+}
+
+static inline const uint8_t *bcode_switch_table(const uint8_t *code) {
+    if (code[0] == BC_SWITCH_NUM) {
+        return code + 7;
+    } else {
+        return code + 5 + (1 << code[2]);
+    }
+}
+
+// size of whole instruction
+static inline int bcode_switch_length(const uint8_t *code) {
+    int unit = code[0] == BC_SWITCH_NUM ? 2 : 4;
+
+    return bcode_switch_table(code) - code + bcode_switch_size(code) * unit;
+}
+
+static inline int bcode_switch_default(const uint8_t *code) {
+    const uint8_t *entry = code[0] == BC_SWITCH_NUM ? code + 5 : code + 3;
+
+    return (int16_t)(entry[0] * 0x100 + entry[1]);
+}
+
+static inline int bcode_switch_offset(const uint8_t *code, int i) {
+    const uint8_t *entry;
+
+    if (code[0] == BC_SWITCH_NUM) {
+        entry = bcode_switch_table(code) + i * 2;
+    } else {
+        entry = bcode_switch_table(code) + i * 4 + 2;
+    }
+    return (int16_t)(entry[0] * 0x100 + entry[1]);
+}
+
 int bcode_parse(const uint8_t *code, int *offset, const char **name, int *param1, int *param2);
 
 #endif /* __LANG_BCODE_INC__ */
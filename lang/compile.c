@@ -18,6 +18,7 @@
  **/
 
 #include "err.h"
+#include "hash.h"
 #include "bcode.h"
 #include "parse.h"
 #include "compile.h"
@@ -25,47 +26,6 @@
 
 void compile_code_dump(compile_t *cpl);
 
-static inline void swap(intptr_t *buf, uint32_t a, uint32_t b) {
-    intptr_t tmp = buf[a];
-
-    buf[a] = buf[b];
-    buf[b] = tmp;
-}
-
-static void max_heapify(intptr_t *buf, uint32_t start, uint32_t end)
-{
-    uint32_t dad = start;
-    uint32_t son = dad * 2 + 1;
-
-    while(son < end) {
-        // choice the max
-        if (son + 1 < end && buf[son] < buf[son + 1]) {
-            son ++;
-        }
-
-        if (buf[son] > buf[dad]) {
-            swap(buf, dad, son);
-            dad = son;
-            son = dad * 2 + 1;
-        } else {
-            return;
-        }
-    }
-}
-
-static void heap_sort(intptr_t *buf, int num)
-{
-    int i;
-
-    for (i = num / 2 - 1; i >= 0; i--) {
-        max_heapify(buf, i, num);
-    }
-    for (i = num - 1; i > 0; i--) {
-        swap(buf, 0, i);
-        max_heapify(buf, 0, i);
-    }
-}
-
 static inline
 intptr_t compile_sym_add(compile_t *cpl, const char *sym)
 {
@@ -90,100 +50,14 @@ int compile_arg_num(compile_t *cpl) {
             cpl->func_buf[cpl->func_cur].arg_num : 0;
 }
 
-static void compile_gc(compile_t *cpl);
-
-/* alloced memory:
- * head   +--------------+
- *        | memory size  | \
- *        +--------------+  <- used by gc
- *        | new address  | /
- * user   +--------------+
- *        |              |
- *        |  user memory |
- *        |              |
- *        |     ....     |
+/*
+ * Memory of compiler is a region: allocated from heap one by one,
+ * never be moved or freed, and all released as the compile finished.
+ * Code is kept in list of segments, so it grow without copy.
  */
-static void *compile_malloc(compile_t *cpl, int size)
-{
-    int keep_size = sizeof(intptr_t) * (cpl->func_num * 2 + 1);
-    void *p;
-
-    size += sizeof(intptr_t) * 2;
-    size = SIZE_ALIGN(size);
-
-    if (cpl->heap.free + size + keep_size > cpl->heap.size) {
-        compile_gc(cpl);
-        if (cpl->heap.free + size + keep_size > cpl->heap.size) {
-            return NULL;
-        }
-    }
-
-    p = cpl->heap.base + cpl->heap.free;
-    cpl->heap.free += size;
-    *((intptr_t*)p) = size; // set head.size
-
-    return p + sizeof(intptr_t) * 2;
-}
-
-static inline intptr_t *compile_mem_head(void *mem) {
-    return (intptr_t *) (((unsigned long)mem) - sizeof(intptr_t) * 2);
-}
-
-static void compile_gc(compile_t *cpl)
+static inline void *compile_malloc(compile_t *cpl, int size)
 {
-    intptr_t *keep_tbl = (intptr_t *)(cpl->heap.base + cpl->heap.free);
-    intptr_t *head;
-    int i, n, free = 0;
-
-    keep_tbl[0] = (intptr_t) compile_mem_head(cpl->func_buf);
-    for (i = 0, n = 1; i < cpl->func_num; i++) {
-        compile_func_t *fn = cpl->func_buf + i;
-        if (fn->var_map)
-            keep_tbl[n++] = (intptr_t)compile_mem_head(fn->var_map);
-        if (fn->code_buf)
-            keep_tbl[n++] = (intptr_t)compile_mem_head(fn->code_buf);
-    }
-
-    /*
-     * compute & recorde new address
-     */
-    heap_sort(keep_tbl, n);
-    for (i = 0; i < n; i++) {
-        head = (intptr_t *)(keep_tbl[i]);
-
-        head[1] = (intptr_t)cpl->heap.base + free;
-        free += head[0];
-    }
-
-    /*
-     * update pointer reference
-     */
-    head = compile_mem_head(cpl->func_buf);
-    cpl->func_buf = (compile_func_t *) (head[1] + sizeof(intptr_t) * 2);
-    for (i = 0; i < cpl->func_num; i++) {
-        compile_func_t *fn = cpl->func_buf + i;
-
-        if (fn->var_map) {
-            head = compile_mem_head(fn->var_map);
-            fn->var_map = (intptr_t *)(head[1] + sizeof(intptr_t) * 2);
-        }
-
-        if (fn->code_buf) {
-            head = compile_mem_head(fn->code_buf);
-            fn->code_buf = (uint8_t *)(head[1] + sizeof(intptr_t) * 2);
-        }
-    }
-
-    /*
-     * data relocation
-     */
-    for (i = 0; i < n; i++) {
-        head = (intptr_t *)(keep_tbl[i]);
-        memmove((void*)(head[1]), head, head[0]);
-    }
-
-    //printf("compile gc: %d -> %d\n", cpl->heap.free, free);
-    cpl->heap.free = free;
+    return heap_alloc(&cpl->heap, size);
 }
 
 static inline compile_func_t *compile_func_cur(compile_t *cpl) {
@@ -199,10 +73,6 @@ static inline compile_func_t *compile_func_parent(compile_t *cpl, compile_func_t
     }
 }
 
-static inline uint8_t *compile_code_buf(compile_t *cpl) {
-    return cpl->func_buf[cpl->func_cur].code_buf;
-}
-
 static inline int compile_code_pos(compile_t *cpl) {
     return cpl->func_buf[cpl->func_cur].code_num;
 }
@@ -241,7 +111,12 @@ static inline int compile_string_find_add(compile_t *cpl, intptr_t s)
 
 static inline int compile_native_lookup(compile_t *cpl, intptr_t sym_id)
 {
-    return env_native_find(cpl->env, sym_id);
+    int id = env_native_find(cpl->env, sym_id);
+
+    if (id >= 0) {
+        cpl->native_ref = 1;
+    }
+    return id;
 }
 
 static int compile_func_check_extend(compile_t *cpl, int space)
@@ -277,20 +152,60 @@ static int compile_func_append(compile_t *cpl, int owner)
 
     func_id = cpl->func_num++;
     cpl->func_buf[func_id].owner = owner;
-    cpl->func_buf[func_id].stack_space = 0;
     cpl->func_buf[func_id].stack_high  = 0;
     cpl->func_buf[func_id].closure = 0;
     cpl->func_buf[func_id].var_max = 0;
     cpl->func_buf[func_id].var_num = 0;
     cpl->func_buf[func_id].arg_num = 0;
-    cpl->func_buf[func_id].code_max = 0;
     cpl->func_buf[func_id].code_num = 0;
     cpl->func_buf[func_id].code_buf = NULL;
+    cpl->func_buf[func_id].code_seg = NULL;
+    cpl->func_buf[func_id].code_tail = NULL;
+    cpl->func_buf[func_id].line_num = 0;
     cpl->func_buf[func_id].var_map = NULL;
+    cpl->func_buf[func_id].owner_var_num = owner < 0 ? 0 : cpl->func_buf[owner].var_num;
+    cpl->func_buf[func_id].args = NULL;
+    cpl->func_buf[func_id].body = NULL;
+    cpl->func_buf[func_id].src = NULL;
+    cpl->func_buf[func_id].src_size = 0;
+    cpl->func_buf[func_id].consts = NULL;
 
     return func_id;
 }
 
+/* var_map memory:
+ *        +--------------+
+ *        | symbal ids   |  var_max * sizeof(intptr_t)
+ *        +--------------+
+ *        | hash index   |  var_max * 2 bytes, slot hold (var id + 1)
+ *        +--------------+
+ */
+static inline uint8_t *compile_varmap_index(compile_func_t *func) {
+    return (uint8_t *)(func->var_map + func->var_max);
+}
+
+static int compile_varmap_index_find(compile_func_t *func, intptr_t sym_id, uint32_t *slot)
+{
+    uint8_t *index = compile_varmap_index(func);
+    uint32_t size = func->var_max * 2;
+    uint32_t pos, i;
+
+    pos = hash_ptr(sym_id) % size;
+    for (i = 0; i < size; i++, pos = hash_next(size, pos)) {
+        int id = index[pos];
+
+        if (id == 0) {
+            break;
+        }
+        if (func->var_map[id - 1] == sym_id) {
+            return id - 1;
+        }
+    }
+
+    if (slot) *slot = pos;
+    return -1;
+}
+
 static int compile_varmap_check_extend(compile_t *cpl, int space)
 {
     int size;
@@ -299,7 +214,10 @@ static int compile_varmap_check_extend(compile_t *cpl, int space)
     if (0 < (size = compile_extend_size(cpl, func->var_max, func->var_num, space,
                                  LIMIT_VMAP_SIZE, DEF_VMAP_SIZE))) {
         intptr_t *ptr;
-        if (NULL == (ptr = (intptr_t *)compile_malloc(cpl, size * sizeof(intptr_t)))) {
+        uint32_t slot;
+        int i;
+
+        if (NULL == (ptr = (intptr_t *)compile_malloc(cpl, size * (sizeof(intptr_t) + 2)))) {
             cpl->error = ERR_NotEnoughMemory;
             return -1;
         }
@@ -310,6 +228,13 @@ static int compile_varmap_check_extend(compile_t *cpl, int space)
 
         func->var_map = ptr;
         func->var_max = size;
+
+        // rebuild index
+        memset(compile_varmap_index(func), 0, size * 2);
+        for (i = 0; i < func->var_num; i++) {
+            compile_varmap_index_find(func, ptr[i], &slot);
+            compile_varmap_index(func)[slot] = i + 1;
+        }
     }
     return size;
 }
@@ -318,7 +243,8 @@ static int compile_varmap_check_extend(compile_t *cpl, int space)
 static int compile_varmap_find_add(compile_t *cpl, intptr_t sym_id)
 {
     compile_func_t *func;
-    int i, num;
+    uint32_t slot;
+    int id;
 
     // Note: sym_id is a string point of symbal, should not be 0!
     if (cpl->error || sym_id == 0) {
@@ -326,41 +252,75 @@ static int compile_varmap_find_add(compile_t *cpl, intptr_t sym_id)
     }
 
     func = compile_func_cur(cpl);
-    num = func->var_num;
-    for (i = 0; i < num; i++) {
-        if (sym_id == func->var_map[i]) return i; // already exist!
+    if (func->var_max && 0 <= (id = compile_varmap_index_find(func, sym_id, NULL))) {
+        return id; // already exist!
     }
 
     if (0 > compile_varmap_check_extend(cpl, 1)) {
         return -1;
     }
 
-    func->var_map[func->var_num++] = sym_id;
+    compile_varmap_index_find(func, sym_id, &slot);
+    id = func->var_num++;
+    func->var_map[id] = sym_id;
+    compile_varmap_index(func)[slot] = id + 1;
 
-    return i;
+    return id;
+}
+
+// Position of argument in list, or -1
+static int compile_arg_index(compile_t *cpl, expr_t *args, intptr_t sym_id)
+{
+    int i = 0;
+
+    while (args) {
+        expr_t *e = args->type == EXPR_COMMA ? ast_expr_lft(args) : args;
+
+        if (e->type == EXPR_ASSIGN) {
+            e = ast_expr_lft(e);
+        }
+        if (e->type == EXPR_ID && compile_sym_add(cpl, ast_expr_text(e)) == sym_id) {
+            return i;
+        }
+
+        args = args->type == EXPR_COMMA ? ast_expr_rht(args) : NULL;
+        i++;
+    }
+
+    return -1;
 }
 
 static int compile_varmap_lookup(compile_t *cpl, intptr_t sym_id, int *generation)
 {
     compile_func_t *func;
+    int limit, arg;
 
     if (cpl->error || sym_id == 0) {
         return -1;
     }
 
+    // Arguments of inlined function are hold by variables of caller
+    if (cpl->inline_args && 0 <= (arg = compile_arg_index(cpl, cpl->inline_args, sym_id))) {
+        if (generation)
+            *generation = 0;
+        return cpl->inline_vars[arg];
+    }
+
     if (generation)
         *generation = 0;
 
     func = compile_func_cur(cpl);
+    limit = func->var_num;
     while (func) {
-        int i, num = func->var_num;
-        for (i = 0; i < num; i++) {
-            if (sym_id == func->var_map[i]) {
-                return i;
-            }
+        int id;
+
+        // Only variables defined before the function, are visible
+        if (limit && 0 <= (id = compile_varmap_index_find(func, sym_id, NULL)) && id < limit) {
+            return id;
         }
 
         if (generation) {
+            limit = func->owner_var_num;
             func = compile_func_parent(cpl, func);
             (*generation)++;
             // Mark the closure flag
@@ -373,6 +333,23 @@ static int compile_varmap_lookup(compile_t *cpl, intptr_t sym_id, int *generatio
     return -1;
 }
 
+// Function where the variable is defined, as compile_varmap_lookup but not mark closure
+static compile_func_t *compile_varmap_owner(compile_t *cpl, intptr_t sym_id, int *id)
+{
+    compile_func_t *func = compile_func_cur(cpl);
+    int limit = func->var_num;
+
+    while (func && sym_id) {
+        if (limit && 0 <= (*id = compile_varmap_index_find(func, sym_id, NULL)) && *id < limit) {
+            return func;
+        }
+        limit = func->owner_var_num;
+        func = compile_func_parent(cpl, func);
+    }
+
+    return NULL;
+}
+
 static int compile_arg_add(compile_t *cpl, intptr_t sym_id)
 {
     int var_id, var_max;
@@ -429,88 +406,311 @@ static inline int compile_arg_add_name(compile_t *cpl, const char *name) {
     return compile_arg_add(cpl, compile_sym_add(cpl, name));
 }
 
-static int compile_code_check_extend(compile_t *cpl, int space)
+// Hidden variable used by compiler, which should not take the room of
+// variables declared later, return: id of variable or -1
+static int compile_var_hidden(compile_t *cpl, const char *name)
 {
-    compile_func_t *func;
+    compile_func_t *func = compile_func_cur(cpl);
+    intptr_t sym_id = compile_sym_add(cpl, name);
+    int id;
+
+    if (func->var_max && 0 <= (id = compile_varmap_index_find(func, sym_id, NULL))) {
+        return id;
+    }
+    if (cpl->var_spare <= 0) {
+        return -1;
+    }
+    cpl->var_spare--;
+    return compile_varmap_find_add(cpl, sym_id);
+}
+
+static compile_code_seg_t *compile_code_seg_alloc(compile_t *cpl, compile_func_t *func, int space)
+{
+    compile_code_seg_t *seg;
     int size;
 
-    func = cpl->func_buf + cpl->func_cur;
-    if (0 < (size = compile_extend_size(cpl, func->code_max, func->code_num, space,
-                                 LIMIT_FUNC_CODE_SIZE, DEF_FUNC_CODE_SIZE))) {
-        uint8_t *ptr;
-        if (NULL == (ptr = (uint8_t *) compile_malloc(cpl,size))) {
-            cpl->error = ERR_NotEnoughMemory;
-            return -1;
-        }
+    size = func->code_tail ? func->code_tail->size * 2 : DEF_FUNC_CODE_SIZE;
+    if (size > LIMIT_FUNC_CODE_SIZE) {
+        size = LIMIT_FUNC_CODE_SIZE;
+    }
+    if (size < space) {
+        size = space;
+    }
 
-        if (func->code_buf) {
-            memcpy(ptr, func->code_buf, func->code_num);
+    if (NULL == (seg = (compile_code_seg_t *) compile_malloc(cpl, sizeof(compile_code_seg_t) + size))) {
+        // Not enough memory, take all of the rest
+        size = ((cpl->heap.size - cpl->heap.free) & ~0x07) - (int)sizeof(compile_code_seg_t);
+        if (size < space || NULL == (seg = (compile_code_seg_t *) compile_malloc(cpl, sizeof(compile_code_seg_t) + size))) {
+            cpl->error = ERR_NotEnoughMemory;
+            return NULL;
         }
+    }
+    seg->next = NULL;
+    seg->size = size;
+    seg->used = 0;
 
-        func->code_buf = ptr;
-        func->code_max = size;
+    if (func->code_tail) {
+        func->code_tail->next = seg;
+    } else {
+        func->code_seg = seg;
     }
-    return size;
+    func->code_tail = seg;
+
+    return seg;
 }
 
-static inline void compile_code_append(compile_t *cpl, uint8_t code)
+// return: continuous space of tail segment
+static uint8_t *compile_code_reserve(compile_t *cpl, int space)
 {
     compile_func_t *func;
+    compile_code_seg_t *seg;
 
-    if (cpl->error || 0 > compile_code_check_extend(cpl, 1)) {
-        return;
+    if (cpl->error) {
+        return NULL;
     }
 
     func = compile_func_cur(cpl);
-    func->code_buf[func->code_num++] = code;
+    if (func->code_num + space > LIMIT_FUNC_CODE_SIZE) {
+        cpl->error = ERR_ResourceOutLimit;
+        return NULL;
+    }
+
+    seg = func->code_tail;
+    if (!seg || seg->used + space > seg->size) {
+        if (NULL == (seg = compile_code_seg_alloc(cpl, func, space))) {
+            return NULL;
+        }
+    }
+
+    return seg->code + seg->used;
 }
 
-static inline void compile_code_appends(compile_t *cpl, int n, uint8_t *code)
+static inline void compile_code_commit(compile_t *cpl, int bytes)
 {
-    compile_func_t *func;
+    compile_func_t *func = compile_func_cur(cpl);
+
+    func->code_tail->used += bytes;
+    func->code_num += bytes;
+}
+
+// pos: in, position in function; out, position in segment
+static compile_code_seg_t *compile_code_seg_locate(compile_func_t *func, int *pos)
+{
+    compile_code_seg_t *seg = func->code_seg;
+
+    while (seg && *pos >= seg->used) {
+        *pos -= seg->used;
+        seg = seg->next;
+    }
+    return seg;
+}
+
+static void compile_code_write(compile_t *cpl, int pos, const uint8_t *data, int n)
+{
+    compile_code_seg_t *seg = compile_code_seg_locate(compile_func_cur(cpl), &pos);
     int i;
 
-    if (cpl->error || 0 > compile_code_check_extend(cpl, n)) {
-        return;
+    for (i = 0; seg && i < n; i++) {
+        if (pos >= seg->used) {
+            if (NULL == (seg = seg->next)) {
+                break;
+            }
+            pos = 0;
+        }
+        seg->code[pos++] = data[i];
     }
+}
 
-    func = compile_func_cur(cpl);
-    for (i = 0; i < n; i++) {
-        func->code_buf[func->code_num++] = code[i];
+static inline void compile_code_append(compile_t *cpl, uint8_t code)
+{
+    uint8_t *buf = compile_code_reserve(cpl, 1);
+
+    if (buf) {
+        buf[0] = code;
+        compile_code_commit(cpl, 1);
     }
 }
 
-static int compile_code_extend(compile_t *cpl, int bytes)
+static inline void compile_code_appends(compile_t *cpl, int n, uint8_t *code)
 {
-    compile_func_t *func = cpl->func_buf + cpl->func_cur;
+    uint8_t *buf = compile_code_reserve(cpl, n);
+
+    if (buf) {
+        memcpy(buf, code, n);
+        compile_code_commit(cpl, n);
+    }
+}
 
-    if (cpl->error || 0 > compile_code_check_extend(cpl, bytes)) {
+static int compile_code_extend(compile_t *cpl, int bytes)
+{
+    if (!compile_code_reserve(cpl, bytes)) {
         return 1;
     }
 
-    func->code_num += bytes;
+    compile_code_commit(cpl, bytes);
 
     return 0;
 }
 
-static int compile_code_insert(compile_t *cpl, int pos, int bytes)
+/*
+ * Source line of code is recorded as the line of expression changed, in
+ * segments linked from the latest one. Functions are compiled one by one
+ * while lines is set (module compile), so records of a function are
+ * continuous and their pc are increasing.
+ */
+static void compile_line_mark(compile_t *cpl, expr_t *e)
 {
-    compile_func_t *func = cpl->func_buf + cpl->func_cur;
-    int i, n;
+    compile_func_t *func = compile_func_cur(cpl);
+    compile_line_seg_t *seg = cpl->line_seg;
+    compile_line_t *last = seg ? seg->line + seg->used - 1 : NULL;
+
+    if (last && last->func == cpl->func_cur) {
+        if (last->line == e->line) {
+            return;
+        }
+        if (last->pc == func->code_num) {
+            last->line = e->line;
+            return;
+        }
+    }
+
+    if (!seg || seg->used >= seg->size) {
+        int size = seg ? seg->size * 2 : DEF_FUNC_CODE_SIZE / 2;
+
+        if (size > LIMIT_FUNC_CODE_SIZE / 2) {
+            size = LIMIT_FUNC_CODE_SIZE / 2;
+        }
+        if (NULL == (seg = compile_malloc(cpl, sizeof(compile_line_seg_t) + size * sizeof(compile_line_t)))) {
+            cpl->error = ERR_NotEnoughMemory;
+            return;
+        }
+        seg->prev = cpl->line_seg;
+        seg->size = size;
+        seg->used = 0;
+        cpl->line_seg = seg;
+    }
+
+    seg->line[seg->used].func = cpl->func_cur;
+    seg->line[seg->used].pc = func->code_num;
+    seg->line[seg->used].line = e->line;
+    seg->used++;
+    func->line_num++;
+}
+
+// records behind pos be moved, they are the latest ones
+static void compile_line_shift(compile_t *cpl, int pos, int bytes)
+{
+    compile_line_seg_t *seg;
+    int i;
 
-    if (cpl->error || 0 > compile_code_check_extend(cpl, bytes)) {
+    for (seg = cpl->line_seg; seg; seg = seg->prev) {
+        for (i = seg->used - 1; i >= 0; i--) {
+            compile_line_t *rec = seg->line + i;
+
+            if (rec->func != cpl->func_cur || rec->pc < pos) {
+                return;
+            }
+            rec->pc += bytes;
+        }
+    }
+}
+
+/*
+ * Insert bytes at pos, the bytes behind pos shift to segments after,
+ * and the overflow of each segment be carried to the next one.
+ */
+static int compile_code_insert(compile_t *cpl, int pos, const uint8_t *data, int bytes)
+{
+    compile_func_t *func;
+    compile_code_seg_t *seg;
+    uint8_t carry[8], tmp[16];
+
+    if (bytes > 8 || !compile_code_reserve(cpl, bytes)) {
         return 1;
     }
 
-    n = func->code_num - pos;
-    for (i = 1; i <= n; i++) {
-        func->code_buf[func->code_num + bytes - i] = func->code_buf[func->code_num - i];
+    func = compile_func_cur(cpl);
+    compile_line_shift(cpl, pos, bytes);
+    if (NULL == (seg = compile_code_seg_locate(func, &pos))) {
+        seg = func->code_tail;
+        pos = seg->used;
+    }
+
+    memcpy(carry, data, bytes);
+    while (1) {
+        int rest = seg->used - pos;
+
+        if (seg->used + bytes <= seg->size) {
+            memmove(seg->code + pos + bytes, seg->code + pos, rest);
+            memcpy(seg->code + pos, carry, bytes);
+            seg->used += bytes;
+            break;
+        }
+
+        if (rest >= bytes) {
+            memcpy(tmp, seg->code + seg->used - bytes, bytes);
+            memmove(seg->code + pos + bytes, seg->code + pos, rest - bytes);
+            memcpy(seg->code + pos, carry, bytes);
+            memcpy(carry, tmp, bytes);
+        } else {
+            memcpy(tmp, carry, bytes);
+            memcpy(tmp + bytes, seg->code + pos, rest);
+            memcpy(seg->code + pos, tmp, rest);
+            memcpy(carry, tmp + rest, bytes);
+        }
+
+        // tail segment has enough space, it always be reached
+        seg = seg->next;
+        pos = 0;
     }
     func->code_num += bytes;
 
     return 0;
 }
 
+/*
+ * Concatenate code segments, before the code be relocated or mapped.
+ * The free space at top of heap is used, and the tail segment be released
+ * if it is the last one allocated. The result is valid until next flatten.
+ */
+static uint8_t *compile_code_flatten(compile_t *cpl, compile_func_t *fn)
+{
+    compile_code_seg_t *seg = fn->code_seg;
+    compile_code_seg_t *tail = fn->code_tail;
+    uint8_t *end, *low, *buf;
+    int off;
+
+    if (!seg) {
+        return fn->code_buf;
+    }
+    if (!seg->next) {
+        return fn->code_buf = seg->code;
+    }
+
+    end = cpl->heap.base + cpl->heap.size;
+    low = cpl->heap.base + cpl->heap.free;
+    if ((uint8_t *)tail + SIZE_ALIGN(sizeof(compile_code_seg_t) + tail->size) == low) {
+        // release the tail segment, it is the last one allocated
+        low = tail->code;
+        cpl->heap.free = (void *)tail - cpl->heap.base;
+    }
+
+    if (end - low < fn->code_num) {
+        cpl->error = ERR_NotEnoughMemory;
+        return fn->code_buf = NULL;
+    }
+
+    buf = end - fn->code_num;
+    memmove(end - tail->used, tail->code, tail->used);
+    for (off = 0; seg != tail; seg = seg->next) {
+        memcpy(buf + off, seg->code, seg->used);
+        off += seg->used;
+    }
+    fn->code_seg = fn->code_tail = NULL;
+
+    return fn->code_buf = buf;
+}
+
 static void compile_code_append_num(compile_t *cpl, double n)
 {
     int id;
@@ -546,62 +746,54 @@ static void compile_code_append_str(compile_t *cpl, const char *s)
 
 static inline void compile_code_append_arg_u16(compile_t *cpl, uint8_t cmd, int n)
 {
-    compile_func_t *func;
-
-    if (cpl->error || 0 > compile_code_check_extend(cpl, 3)) {
-        return;
-    }
+    uint8_t code[3];
 
     if (n < 0 || n > 0xffff) {
         cpl->error = ERR_SysError;
         return;
     }
 
-    func = compile_func_cur(cpl);
-    func->code_buf[func->code_num++] = cmd;
-    func->code_buf[func->code_num++] = n >> 8;
-    func->code_buf[func->code_num++] = n;
+    code[0] = cmd;
+    code[1] = n >> 8;
+    code[2] = n;
+    compile_code_appends(cpl, 3, code);
 }
 
 static inline void compile_code_append_var(compile_t *cpl, int id, int generation)
 {
-    compile_func_t *func;
+    uint8_t code[3];
 
-    if (cpl->error || 0 > compile_code_check_extend(cpl, 3)) {
-        return;
-    }
-
-    func = compile_func_cur(cpl);
-    func->code_buf[func->code_num++] = BC_PUSH_VAR;
-    func->code_buf[func->code_num++] = id;
-    func->code_buf[func->code_num++] = generation;
+    code[0] = BC_PUSH_VAR;
+    code[1] = id;
+    code[2] = generation;
+    compile_code_appends(cpl, 3, code);
 }
 
 static inline void compile_code_append_call(compile_t *cpl, int ac)
 {
-    compile_func_t *func;
-
-    if (cpl->error || 0 > compile_code_check_extend(cpl, 2)) {
-        return;
-    }
+    uint8_t code[2];
 
-    func = compile_func_cur(cpl);
-    func->code_buf[func->code_num++] = BC_FUNC_CALL;
-    func->code_buf[func->code_num++] = ac;
+    code[0] = BC_FUNC_CALL;
+    code[1] = ac;
+    compile_code_appends(cpl, 2, code);
 }
 
 static void compile_expr(compile_t *cpl, expr_t *e);
+static void compile_func_call_code(compile_t *cpl, expr_t *e);
+static const native_t *compile_native_pure(compile_t *cpl, expr_t *callor);
+static int compile_const_fold(compile_t *cpl, expr_t *e, val_t *v, int *names);
 
 static void compile_code_set_jmp(compile_t *cpl, int pos, uint8_t jmp, int step)
 {
-    uint8_t *buf = compile_code_buf(cpl) + pos;
+    uint8_t code[3];
 
     if (step > 32767 || step < -32768) {
         cpl->error = 5555;
     }
-    buf[0] = jmp;
-    buf[1] = step >> 8;
-    buf[2] = step;
+    code[0] = jmp;
+    code[1] = step >> 8;
+    code[2] = step;
+    compile_code_write(cpl, pos, code, 3);
 }
 
 static void compile_code_append_jmp(compile_t *cpl, uint8_t jmp, int step)
@@ -615,18 +807,18 @@ static void compile_code_append_jmp(compile_t *cpl, uint8_t jmp, int step)
 
 static void compile_code_insert_xjmp(compile_t *cpl, int from, int step)
 {
-    int jmps = (step < -128 || step > 127) ? 3 : 2;
+    uint8_t code[3];
+    int n = 0;
 
-    if (0 == compile_code_insert(cpl, from, jmps)) {
-        uint8_t *code_buf = compile_code_buf(cpl);
-        if (jmps == 3) {
-            code_buf[from++] = BC_JMP;
-            code_buf[from++] = step >> 8;
-        } else {
-            code_buf[from++] = BC_SJMP;
-        }
-        code_buf[from++] = step;
+    if (step < -128 || step > 127) {
+        code[n++] = BC_JMP;
+        code[n++] = step >> 8;
+    } else {
+        code[n++] = BC_SJMP;
     }
+    code[n++] = step;
+
+    compile_code_insert(cpl, from, code, n);
 }
 
 static inline void compile_code_insert_jmp_to(compile_t *cpl, int from, int to)
@@ -637,92 +829,1520 @@ static inline void compile_code_insert_jmp_to(compile_t *cpl, int from, int to)
 static void compile_true_jmp_false_pop(compile_t *cpl, int from, int to)
 {
     int step = to - from + 1; // one POP instruction
+    uint8_t code[4];
+    int n = 0;
 
-    if (!cpl->error && 0 == compile_code_insert(cpl, from, (step > 127 || step < -128) ? 4 : 3)) {
-        uint8_t *code_buf = compile_code_buf(cpl);
-        if (step > 127) {
-            code_buf[from++] = BC_JMP_T;
-            code_buf[from++] = step >> 8;
-        } else {
-            code_buf[from++] = BC_SJMP_T;
-        }
-        code_buf[from++] = step;
-        code_buf[from++] = BC_POP;
+    if (step > 127) {
+        code[n++] = BC_JMP_T;
+        code[n++] = step >> 8;
+    } else {
+        code[n++] = BC_SJMP_T;
+    }
+    code[n++] = step;
+    code[n++] = BC_POP;
+
+    if (!cpl->error) {
+        compile_code_insert(cpl, from, code, n);
     }
 }
 
 static void compile_false_jmp_true_pop(compile_t *cpl, int from, int to)
 {
     int step = to - from + 1; // one POP instruction
+    uint8_t code[4];
+    int n = 0;
 
-    if (!cpl->error && 0 == compile_code_insert(cpl, from, (step > 127 || step < -128) ? 4 : 3)) {
-        uint8_t *code_buf = compile_code_buf(cpl);
-        if (step > 127) {
-            code_buf[from++] = BC_JMP_F;
-            code_buf[from++] = step >> 8;
-        } else {
-            code_buf[from++] = BC_SJMP_F;
-        }
-        code_buf[from++] = step;
-        code_buf[from++] = BC_POP;
+    if (step > 127) {
+        code[n++] = BC_JMP_F;
+        code[n++] = step >> 8;
+    } else {
+        code[n++] = BC_SJMP_F;
+    }
+    code[n++] = step;
+    code[n++] = BC_POP;
+
+    if (!cpl->error) {
+        compile_code_insert(cpl, from, code, n);
     }
 }
 
 static void compile_false_pop_jmp(compile_t *cpl, int from, int to)
 {
     int step = to - from;
+    uint8_t code[3];
+    int n = 0;
+
+    if (step > 127) {
+        code[n++] = BC_POP_JMP_F;
+        code[n++] = step >> 8;
+    } else {
+        code[n++] = BC_POP_SJMP_F;
+    }
+    code[n++] = step;
+
+    if (!cpl->error) {
+        compile_code_insert(cpl, from, code, n);
+    }
+}
+
+/*
+ * Type inference of local variables
+ *
+ * cpl->num_vars is the set of local variables, which are proven to hold a
+ * number (NaN and infinity included) at current compile point, and
+ * cpl->expr_num tell the last compiled expression produce a number.
+ * Operations on numbers are emitted as typed instructions, which skip the
+ * type check and dispatch, others fall back to the generic ones.
+ *
+ * Inference only be done in function without nested function, so the local
+ * variables could not be changed by a call.
+ */
+typedef int (*compile_visit_t)(compile_t *cpl, expr_t *e, void *ud);
+
+static int compile_visit_expr(compile_t *cpl, expr_t *e, compile_visit_t visit, void *ud)
+{
+    while (e) {
+        if (visit(cpl, e, ud)) {
+            return 1;
+        }
+
+        if (e->type <= EXPR_STRING || e->type == EXPR_FUNCDEF) {
+            return 0;
+        }
+
+        if (e->type >= EXPR_ARRAY && compile_visit_expr(cpl, ast_expr_lft(e), visit, ud)) {
+            return 1;
+        }
+        e = e->type >= EXPR_ARRAY ? ast_expr_rht(e) : ast_expr_lft(e);
+    }
+    return 0;
+}
+
+static int compile_visit_stmt(compile_t *cpl, stmt_t *s, compile_visit_t visit, void *ud)
+{
+    while (s) {
+        if (compile_visit_expr(cpl, ast_stmt_expr(s), visit, ud) ||
+            compile_visit_stmt(cpl, ast_stmt_block(s), visit, ud) ||
+            compile_visit_stmt(cpl, ast_stmt_other(s), visit, ud)) {
+            return 1;
+        }
+        s = ast_stmt_next(s);
+    }
+    return 0;
+}
+
+static int compile_visit_funcdef(compile_t *cpl, expr_t *e, void *ud)
+{
+    (void) cpl;
+    (void) ud;
+    return e->type == EXPR_FUNCDEF;
+}
+
+static int compile_visit_funcname(compile_t *cpl, expr_t *e, void *ud)
+{
+    (void) cpl;
+    if (e->type == EXPR_FUNCDEF && ast_expr_lft(e) && ast_expr_lft(ast_expr_lft(e))) {
+        *(int *)ud += 1;
+    }
+    return 0;
+}
+
+// Count of variables may be declared by statements, not less than the real
+static int compile_stmt_decls(compile_t *cpl, stmt_t *s)
+{
+    int n = 0;
+
+    for (; s; s = ast_stmt_next(s)) {
+        if (s->type == STMT_VAR || s->type == STMT_CONST) {
+            expr_t *e;
+
+            for (e = ast_stmt_expr(s); e && e->type == EXPR_COMMA; e = ast_expr_rht(e)) {
+                n++;
+            }
+            n += e ? 1 : 0;
+        }
+        n += compile_stmt_decls(cpl, ast_stmt_block(s)) + compile_stmt_decls(cpl, ast_stmt_other(s));
+    }
+    return n;
+}
+
+// Room of hidden variables, after the variables declared by statements
+static int compile_var_spare(compile_t *cpl, stmt_t *s)
+{
+    int n = compile_func_cur(cpl)->var_num + compile_stmt_decls(cpl, s);
+
+    compile_visit_stmt(cpl, s, compile_visit_funcname, &n);
+    return n < LIMIT_VMAP_SIZE ? LIMIT_VMAP_SIZE - n : 0;
+}
+
+// Value of expression may be a foreign object, which keep itself on assignment
+static int compile_type_foreign(expr_t *e)
+{
+    switch (e->type) {
+    case EXPR_LOGIC_AND:
+    case EXPR_LOGIC_OR: return compile_type_foreign(ast_expr_lft(e)) || compile_type_foreign(ast_expr_rht(e));
+    case EXPR_COMMA:    return compile_type_foreign(ast_expr_rht(e));
+    case EXPR_TERNARY:  return compile_type_foreign(ast_expr_lft(ast_expr_rht(e))) ||
+                               compile_type_foreign(ast_expr_rht(ast_expr_rht(e)));
+    case EXPR_ID:
+    case EXPR_ASSIGN:
+    case EXPR_CALL:
+    case EXPR_PROP:
+    case EXPR_ELEM:     return 1;
+    default:            return 0;
+    }
+}
+
+static int compile_visit_foreign(compile_t *cpl, expr_t *e, void *ud)
+{
+    expr_t *lft;
+
+    if (e->type != EXPR_ASSIGN) {
+        return 0;
+    }
+
+    lft = ast_expr_lft(e);
+    return lft->type == EXPR_ID && compile_sym_find(cpl, ast_expr_text(lft)) == *(intptr_t *)ud
+           && compile_type_foreign(ast_expr_rht(e));
+}
+
+static int compile_type_var(compile_t *cpl, expr_t *e);
+
+// Local variables be assigned by for in & for of statements
+static uint32_t compile_type_iter(compile_t *cpl, stmt_t *s)
+{
+    uint32_t vars = 0;
+
+    for (; s; s = ast_stmt_next(s)) {
+        if (s->type == STMT_FOR_IN || s->type == STMT_FOR_OF) {
+            int id = compile_type_var(cpl, ast_expr_lft(ast_stmt_expr(s)));
+
+            if (id >= 0) {
+                vars |= 1u << id;
+            }
+        }
+        vars |= compile_type_iter(cpl, ast_stmt_block(s)) | compile_type_iter(cpl, ast_stmt_other(s));
+    }
+    return vars;
+}
+
+// Local variable could not hold a foreign object
+static int compile_type_clean(compile_t *cpl, int id)
+{
+    uint32_t bit = 1u << id;
+
+    if (!(cpl->num_check & bit)) {
+        compile_func_t *f = compile_func_cur(cpl);
+        intptr_t sym_id = f->var_map[id];
+
+        cpl->num_check |= bit;
+        if (id >= f->arg_num && !compile_visit_stmt(cpl, cpl->num_body, compile_visit_foreign, &sym_id) &&
+            !(compile_type_iter(cpl, cpl->num_body) & bit)) {
+            cpl->num_clean |= bit;
+        }
+    }
+
+    return cpl->num_clean & bit;
+}
+
+// Id of local variable, which type could be inferred
+static int compile_type_var(compile_t *cpl, expr_t *e)
+{
+    int id, generation;
+
+    if (!cpl->num_body || e->type != EXPR_ID) {
+        return -1;
+    }
+
+    // Variable of outer function, is not tracked
+    id = compile_varmap_lookup(cpl, compile_sym_find(cpl, ast_expr_text(e)), &generation);
+    return id < 32 && !generation ? id : -1;
+}
+
+static inline int compile_type_var_num(compile_t *cpl, int id, uint32_t vars) {
+    return id >= 0 && (vars & (1u << id));
+}
+
+// Expression produce a number, if variables of set are numbers
+static int compile_type_num(compile_t *cpl, expr_t *e, uint32_t vars)
+{
+    int id;
+
+    switch (e->type) {
+    case EXPR_NUM:
+    case EXPR_NAN:
+    case EXPR_NEG:
+    case EXPR_NOT:
+    case EXPR_MUL:
+    case EXPR_DIV:
+    case EXPR_MOD:
+    case EXPR_SUB:
+    case EXPR_LSHIFT:
+    case EXPR_RSHIFT:
+    case EXPR_AND:
+    case EXPR_OR:
+    case EXPR_XOR:      return 1;
+    case EXPR_INC:
+    case EXPR_INC_PRE:
+    case EXPR_DEC:
+    case EXPR_DEC_PRE:  return ast_expr_lft(e)->type == EXPR_ID;
+    case EXPR_ID:       return compile_type_var_num(cpl, compile_type_var(cpl, e), vars);
+    case EXPR_ADD:
+    case EXPR_LOGIC_AND:
+    case EXPR_LOGIC_OR: return compile_type_num(cpl, ast_expr_lft(e), vars) &&
+                               compile_type_num(cpl, ast_expr_rht(e), vars);
+    case EXPR_COMMA:    return compile_type_num(cpl, ast_expr_rht(e), vars);
+    case EXPR_TERNARY:  return compile_type_num(cpl, ast_expr_lft(ast_expr_rht(e)), vars) &&
+                               compile_type_num(cpl, ast_expr_rht(ast_expr_rht(e)), vars);
+    case EXPR_ASSIGN:   id = compile_type_var(cpl, ast_expr_lft(e));
+                        return id >= 0 && (compile_type_var_num(cpl, id, vars) || compile_type_clean(cpl, id))
+                               && compile_type_num(cpl, ast_expr_rht(e), vars);
+    case EXPR_ADD_ASSIGN:
+                        return compile_type_var_num(cpl, compile_type_var(cpl, ast_expr_lft(e)), vars)
+                               && compile_type_num(cpl, ast_expr_rht(e), vars);
+    default:
+        if (e->type > EXPR_ADD_ASSIGN && e->type <= EXPR_RSHIFT_ASSIGN) {
+            return ast_expr_lft(e)->type == EXPR_ID;
+        }
+        return 0;
+    }
+}
+
+static int compile_visit_loop(compile_t *cpl, expr_t *e, void *ud)
+{
+    uint32_t *vars = ud;
+
+    if (e->type >= EXPR_ASSIGN && e->type <= EXPR_RSHIFT_ASSIGN) {
+        int id = compile_type_var(cpl, ast_expr_lft(e));
+
+        if (id >= 0 && !compile_type_num(cpl, e, *vars)) {
+            *vars &= ~(1u << id);
+        }
+    }
+    return 0;
+}
+
+// Variables keep number through the loop
+static uint32_t compile_type_loop(compile_t *cpl, stmt_t *s, uint32_t vars)
+{
+    uint32_t prev;
+
+    if (!vars) {
+        return 0;
+    }
+
+    vars &= ~compile_type_iter(cpl, ast_stmt_block(s));
+    do {
+        prev = vars;
+        compile_visit_expr(cpl, ast_stmt_expr(s), compile_visit_loop, &vars);
+        compile_visit_stmt(cpl, ast_stmt_block(s), compile_visit_loop, &vars);
+    } while (vars != prev);
+
+    return vars;
+}
+
+static inline void compile_type_store(compile_t *cpl, int id, int num)
+{
+    if (id < 32) {
+        if (num) {
+            cpl->num_vars |= 1u << id;
+        } else {
+            cpl->num_vars &= ~(1u << id);
+        }
+    }
+}
+
+// Update variable type by assignment, return: the result is number
+static int compile_type_assign(compile_t *cpl, expr_t *e, int num)
+{
+    int id = compile_type_var(cpl, ast_expr_lft(e));
+
+    if (id >= 0) {
+        uint32_t bit = 1u << id;
+
+        if (e->type == EXPR_ASSIGN) {
+            num = num && ((cpl->num_vars & bit) || compile_type_clean(cpl, id));
+        } else
+        if (e->type == EXPR_ADD_ASSIGN) {
+            num = num && (cpl->num_vars & bit);
+        } else {
+            num = 1;
+        }
+
+        if (num) {
+            cpl->num_vars |= bit;
+        } else {
+            cpl->num_vars &= ~bit;
+        }
+        return num;
+    } else {
+        return e->type > EXPR_ADD_ASSIGN && ast_expr_lft(e)->type == EXPR_ID;
+    }
+}
+
+/*
+ * Inline of small functions
+ *
+ * Function defined by statement "def f(args) return expr" in main, and never
+ * be reassigned, is inlined at call site: arguments are stored to hidden
+ * variables of the caller, then the expression is evaluated with them.
+ * The expression should only refer to its arguments, so it has the same
+ * meaning anywhere. Only calls in main after the definition, or in functions
+ * defined after it, are inlined; they could not run before f is defined.
+ */
+typedef struct compile_inline_scan_t {
+    const char *name;
+    expr_t *def;
+} compile_inline_scan_t;
+
+static int compile_stmt_reassign(compile_t *cpl, stmt_t *s, compile_inline_scan_t *scan);
+
+static int compile_visit_reassign(compile_t *cpl, expr_t *e, void *ud)
+{
+    compile_inline_scan_t *scan = ud;
+    expr_t *lft = e->type > EXPR_STRING ? ast_expr_lft(e) : NULL;
+
+    if (e->type == EXPR_FUNCDEF) {
+        expr_t *name = lft ? ast_expr_lft(lft) : NULL;
+
+        if (e != scan->def && name && name->type == EXPR_ID && !strcmp(ast_expr_text(name), scan->name)) {
+            return 1;
+        }
+        return ast_expr_rht(e) && compile_stmt_reassign(cpl, ast_expr_stmt(ast_expr_rht(e)), scan);
+    }
+
+    if ((e->type >= EXPR_ASSIGN && e->type <= EXPR_RSHIFT_ASSIGN) ||
+        (e->type >= EXPR_INC && e->type <= EXPR_DEC_PRE)) {
+        return lft->type == EXPR_ID && !strcmp(ast_expr_text(lft), scan->name);
+    }
+
+    return 0;
+}
+
+// Name is stored by expressions of statements, or as the variable of for in & for of
+static int compile_stmt_reassign(compile_t *cpl, stmt_t *s, compile_inline_scan_t *scan)
+{
+    for (; s; s = ast_stmt_next(s)) {
+        if (s->type == STMT_FOR_IN || s->type == STMT_FOR_OF) {
+            expr_t *id = ast_expr_lft(ast_stmt_expr(s));
+
+            if (!strcmp(ast_expr_text(id), scan->name)) {
+                return 1;
+            }
+        }
+        if (compile_visit_expr(cpl, ast_stmt_expr(s), compile_visit_reassign, scan) ||
+            compile_stmt_reassign(cpl, ast_stmt_block(s), scan) ||
+            compile_stmt_reassign(cpl, ast_stmt_other(s), scan)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int compile_arg_count(expr_t *args)
+{
+    int n = 0;
+
+    while (args) {
+        args = args->type == EXPR_COMMA ? ast_expr_rht(args) : NULL;
+        n++;
+    }
+    return n;
+}
+
+// Size of expression, which only refer to the arguments, or -1
+static int compile_inline_size(compile_t *cpl, expr_t *e, expr_t *args)
+{
+    int lft, rht;
+
+    if (!e) {
+        return 0;
+    }
+
+    switch (e->type) {
+    case EXPR_ID:       return compile_arg_index(cpl, args, compile_sym_add(cpl, ast_expr_text(e))) < 0 ? -1 : 1;
+    case EXPR_FUNCDEF:
+    case EXPR_FUNCPROC: return -1;
+    case EXPR_PROP:     lft = compile_inline_size(cpl, ast_expr_lft(e), args);
+                        return lft < 0 ? -1 : lft + 1;
+    case EXPR_PAIR:     rht = compile_inline_size(cpl, ast_expr_rht(e), args);
+                        return rht < 0 ? -1 : rht + 1;
+    default:            break;
+    }
+
+    if (e->type <= EXPR_STRING) {
+        return 1;
+    }
+
+    if (0 > (lft = compile_inline_size(cpl, ast_expr_lft(e), args))) {
+        return -1;
+    }
+    if (e->type < EXPR_ARRAY) {
+        return lft + 1;
+    }
+
+    rht = compile_inline_size(cpl, ast_expr_rht(e), args);
+    return rht < 0 ? -1 : lft + rht + 1;
+}
+
+// Record the function defined by a statement of main, if it could be inlined
+static void compile_inline_record(compile_t *cpl, stmt_t *s, int func)
+{
+    compile_inline_scan_t scan;
+    compile_func_t *fn;
+    expr_t *e = ast_stmt_expr(s), *name;
+    int size, id;
+
+    if (!cpl->prog || cpl->error || s->type != STMT_EXPR || e->type != EXPR_FUNCDEF ||
+        func + 1 != cpl->func_num || !ast_expr_lft(e)) {
+        return;
+    }
+
+    fn = cpl->func_buf + func;
+    name = ast_expr_lft(ast_expr_lft(e));
+    if (!name || name->type != EXPR_ID || !fn->body || ast_stmt_next(fn->body) ||
+        fn->body->type != STMT_RET || !ast_stmt_expr(fn->body) ||
+        compile_arg_count(fn->args) > LIMIT_INLINE_ARGS) {
+        return;
+    }
+
+    size = compile_inline_size(cpl, ast_stmt_expr(fn->body), fn->args);
+    if (size <= 0 || size > LIMIT_INLINE_SIZE) {
+        return;
+    }
+
+    scan.name = ast_expr_text(name);
+    scan.def = e;
+    if (compile_stmt_reassign(cpl, cpl->prog, &scan)) {
+        return;
+    }
+
+    if (cpl->func_buf == compile_varmap_owner(cpl, compile_sym_find(cpl, scan.name), &id)
+        && id < LIMIT_VMAP_SIZE) {
+        cpl->inline_func[id] = func;
+    }
+}
+
+// return: 1 if the call is inlined, 0: should be called normally
+static int compile_inline_call(compile_t *cpl, expr_t *e)
+{
+    expr_t *callor = ast_expr_lft(e);
+    expr_t *argv[LIMIT_INLINE_ARGS], *list;
+    uint8_t vars[LIMIT_INLINE_ARGS];
+    compile_func_t *fn;
+    int id, func, argc, paramc, i;
+
+    if (!cpl->prog || cpl->inline_args || cpl->inline_depth >= LIMIT_INLINE_DEPTH ||
+        callor->type != EXPR_ID) {
+        return 0;
+    }
+
+    if (cpl->func_buf != compile_varmap_owner(cpl, compile_sym_find(cpl, ast_expr_text(callor)), &id) ||
+        id >= LIMIT_VMAP_SIZE || 0 == (func = cpl->inline_func[id]) ||
+        (cpl->func_cur && cpl->func_cur <= func)) {
+        return 0;
+    }
+
+    for (argc = 0, list = ast_expr_rht(e); list; argc++) {
+        if (argc >= LIMIT_INLINE_ARGS) {
+            return 0;
+        }
+        if (list->type == EXPR_COMMA) {
+            argv[argc] = ast_expr_lft(list);
+            list = ast_expr_rht(list);
+        } else {
+            argv[argc] = list;
+            list = NULL;
+        }
+    }
+
+    fn = cpl->func_buf + func;
+    paramc = compile_arg_count(fn->args);
+    for (i = 0; i < paramc; i++) {
+        char name[4] = {'#', '0' + cpl->inline_depth, '0' + i, 0};
+
+        if (0 > (id = compile_var_hidden(cpl, name))) {
+            return 0;
+        }
+        vars[i] = id;
+
+        // Hold any value of argument, the type is known by store only
+        if (id < 32) {
+            cpl->num_check |= 1u << id;
+            cpl->num_clean &= ~(1u << id);
+        }
+    }
+
+    // Arguments are evaluated from the last one, as the call
+    for (i = argc - 1; i >= 0; i--) {
+        cpl->inline_depth++;
+        compile_expr(cpl, argv[i]);
+        cpl->inline_depth--;
+
+        if (i < paramc) {
+            uint8_t code[2] = {BC_POP_VAR, vars[i]};
+
+            compile_code_appends(cpl, 2, code);
+            compile_type_store(cpl, vars[i], cpl->expr_num);
+        } else {
+            compile_code_append(cpl, BC_POP);
+        }
+    }
+    for (i = argc; i < paramc; i++) {
+        uint8_t code[3] = {BC_PUSH_UND, BC_POP_VAR, vars[i]};
+
+        compile_code_appends(cpl, 3, code);
+        compile_type_store(cpl, vars[i], 0);
+    }
+
+    cpl->inline_args = fn->args;
+    cpl->inline_vars = vars;
+    compile_expr(cpl, ast_stmt_expr(fn->body));
+    cpl->inline_args = NULL;
+    cpl->inline_vars = NULL;
+
+    for (i = 0; i < paramc; i++) {
+        compile_type_store(cpl, vars[i], 0);
+    }
+
+    return 1;
+}
+
+/*
+ * Scalar replacement of literals
+ *
+ * Object or array literal, assigned to local variable by "var p = literal",
+ * is not created, if the variable is only accessed as "p.key", "p['key']" or
+ * "p[number]" behind the definition in source, with key & number in the
+ * literal. Fields of the literal are kept in hidden variables instead. It is
+ * done in function without nested function only, as type inference, so the
+ * variable could not be captured by closure.
+ */
+typedef struct compile_scalar_scan_t {
+    intptr_t sym;
+    expr_t  *def;
+    int      refs;     // references of the variable, field access excluded
+    int      before;   // scan before the definition, field access is escape
+    expr_t  *item;     // the definition "p = literal"
+} compile_scalar_scan_t;
+
+static expr_t *compile_scalar_next(expr_t *def, expr_t **list)
+{
+    expr_t *item = *list;
+
+    if (item->type == def->type) {
+        *list = ast_expr_lft(item);
+        return ast_expr_rht(item);
+    }
+    *list = NULL;
+    return item;
+}
+
+// Index of field by key, in the order of compile_dict, the last one if duplicate
+static int compile_scalar_key(expr_t *def, const char *key)
+{
+    expr_t *list = def, *pair;
+    int n = 0, i = -1;
+
+    while (list) {
+        if ((pair = compile_scalar_next(def, &list)) != NULL) {
+            if (!strcmp(ast_expr_text(ast_expr_lft(pair)), key)) {
+                i = n;
+            }
+            n++;
+        }
+    }
+    return i;
+}
+
+static int compile_scalar_size(expr_t *def)
+{
+    expr_t *list = def;
+    int n = 0;
+
+    while (list) {
+        n += compile_scalar_next(def, &list) != NULL;
+    }
+    return n;
+}
+
+// Index of field accessed by expression, or -1
+static int compile_scalar_field(expr_t *def, expr_t *e)
+{
+    expr_t *key = ast_expr_rht(e);
+
+    if (def->type == EXPR_DICT) {
+        if (e->type == EXPR_PROP || key->type == EXPR_STRING) {
+            return compile_scalar_key(def, ast_expr_text(key));
+        }
+    } else
+    if (e->type == EXPR_ELEM && key->type == EXPR_NUM) {
+        double k = ast_expr_num(key);
+        int n = compile_scalar_size(def);
+
+        // elements are compiled from the last one
+        if (k >= 0 && k < n && k == (int) k) {
+            return n - 1 - (int) k;
+        }
+    }
+    return -1;
+}
+
+static int compile_visit_scalar(compile_t *cpl, expr_t *e, void *ud)
+{
+    compile_scalar_scan_t *scan = ud;
+    expr_t *lft;
+
+    if (e->type == EXPR_ID) {
+        scan->refs += compile_sym_find(cpl, ast_expr_text(e)) == scan->sym;
+        return 0;
+    }
+    if (e->type <= EXPR_STRING || !(lft = ast_expr_lft(e))) {
+        return 0;
+    }
+
+    // The variable of definition will be visited next, the literal is checked
+    if (e == scan->item) {
+        scan->before = 0;
+        scan->refs--;
+        return 0;
+    }
+
+    // Name of property & key of pair are not references
+    if ((e->type == EXPR_PROP && compile_sym_find(cpl, ast_expr_text(ast_expr_rht(e))) == scan->sym) ||
+        (e->type == EXPR_PAIR && lft->type == EXPR_ID && compile_sym_find(cpl, ast_expr_text(lft)) == scan->sym)) {
+        scan->refs--;
+    }
+
+    // Method call take the object as argument
+    if (e->type == EXPR_CALL && (lft->type == EXPR_PROP || lft->type == EXPR_ELEM)) {
+        lft = ast_expr_lft(lft);
+        return lft->type == EXPR_ID && compile_sym_find(cpl, ast_expr_text(lft)) == scan->sym;
+    }
+
+    if ((e->type == EXPR_PROP || e->type == EXPR_ELEM) && lft->type == EXPR_ID &&
+        compile_sym_find(cpl, ast_expr_text(lft)) == scan->sym) {
+        if (scan->before || compile_scalar_field(scan->def, e) < 0) {
+            return 1;
+        }
+        scan->refs--;
+    }
+    return 0;
+}
+
+// Literal could be replaced: keys are names or strings, without duplicate
+static int compile_scalar_literal(expr_t *def, int spare)
+{
+    expr_t *list = def, *pair;
+    int n = compile_scalar_size(def), i = 0;
+
+    if (n > LIMIT_SCALAR_SIZE || n > spare) {
+        return 0;
+    }
+
+    while (def->type == EXPR_DICT && list) {
+        if ((pair = compile_scalar_next(def, &list)) != NULL) {
+            expr_t *key = ast_expr_lft(pair);
+
+            if (pair->type != EXPR_PAIR || (key->type != EXPR_ID && key->type != EXPR_STRING) ||
+                compile_scalar_key(def, ast_expr_text(key)) != i++) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Check the item "p = literal" of var statement
+static void compile_scalar_check(compile_t *cpl, expr_t *item)
+{
+    compile_scalar_scan_t scan;
+    compile_scalar_t *scalar;
+    expr_t *lft = ast_expr_lft(item);
+    int n, i;
+
+    scan.def = ast_expr_rht(item);
+    if (lft->type != EXPR_ID || !scan.def ||
+        (scan.def->type != EXPR_DICT && scan.def->type != EXPR_ARRAY) ||
+        !compile_scalar_literal(scan.def, cpl->var_spare)) {
+        return;
+    }
+    scan.sym = compile_sym_add(cpl, ast_expr_text(lft));
+    scan.item = item;
+    scan.refs = 0;
+    scan.before = 1;
+
+    if (compile_visit_expr(cpl, scan.def, compile_visit_scalar, &scan) || scan.refs ||
+        compile_visit_stmt(cpl, cpl->num_body, compile_visit_scalar, &scan) || scan.refs) {
+        return;
+    }
+
+    if (NULL == (scalar = compile_malloc(cpl, sizeof(compile_scalar_t)))) {
+        return;
+    }
+
+    n = compile_scalar_size(scan.def);
+    for (i = 0; i < n; i++) {
+        int k = compile_func_cur(cpl)->var_num - compile_func_cur(cpl)->arg_num;
+        char name[4] = {'#', 's', 'A' + k, 0};
+        int id = compile_var_hidden(cpl, name);
+
+        if (id < 0) {
+            return;
+        }
+        if (i == 0) {
+            scalar->base = id;
+        }
+    }
+    scalar->sym = scan.sym;
+    scalar->def = scan.def;
+    scalar->next = cpl->scalars;
+    cpl->scalars = scalar;
+}
+
+// Find the literals could be replaced, in var statements of function body
+static void compile_scalar_scan(compile_t *cpl, stmt_t *s)
+{
+    for (; s && !cpl->error; s = ast_stmt_next(s)) {
+        expr_t *rest = s->type == STMT_VAR ? ast_stmt_expr(s) : NULL;
+
+        while (rest) {
+            expr_t *item = rest->type == EXPR_COMMA ? ast_expr_lft(rest) : rest;
+
+            if (item->type == EXPR_ASSIGN) {
+                compile_scalar_check(cpl, item);
+            }
+            rest = rest->type == EXPR_COMMA ? ast_expr_rht(rest) : NULL;
+        }
+        compile_scalar_scan(cpl, ast_stmt_block(s));
+        compile_scalar_scan(cpl, ast_stmt_other(s));
+    }
+}
+
+// Hidden variable of field accessed by expression, or -1
+static int compile_scalar_var(compile_t *cpl, expr_t *e)
+{
+    compile_scalar_t *scalar;
+    expr_t *lft = ast_expr_lft(e);
+    intptr_t sym;
+
+    if (!cpl->scalars || lft->type != EXPR_ID) {
+        return -1;
+    }
+
+    sym = compile_sym_find(cpl, ast_expr_text(lft));
+    for (scalar = cpl->scalars; scalar; scalar = scalar->next) {
+        if (scalar->sym == sym) {
+            int i = compile_scalar_field(scalar->def, e);
+
+            return i < 0 ? -1 : scalar->base + i;
+        }
+    }
+    return -1;
+}
+
+// return: 1 if fields of literal are stored to hidden variables
+static int compile_scalar_def(compile_t *cpl, expr_t *def)
+{
+    compile_scalar_t *scalar = cpl->scalars;
+    expr_t *list = def, *item;
+    int i = 0;
+
+    while (scalar && scalar->def != def) {
+        scalar = scalar->next;
+    }
+    if (!scalar) {
+        return 0;
+    }
+
+    while (!cpl->error && list) {
+        if ((item = compile_scalar_next(def, &list)) != NULL) {
+            uint8_t code[2] = {BC_POP_VAR, scalar->base + i++};
+
+            compile_expr(cpl, def->type == EXPR_DICT ? ast_expr_rht(item) : item);
+            compile_code_appends(cpl, 2, code);
+        }
+    }
+    return 1;
+}
+
+static void compile_expr_binary(compile_t *cpl, expr_t *e, uint8_t code)
+{
+    compile_expr(cpl, ast_expr_lft(e));
+    if (e->type == EXPR_PROP) {
+        if (ast_expr_rht(e)->type == EXPR_ID) {
+            compile_code_append_str(cpl, ast_expr_text(ast_expr_rht(e)));
+        } else {
+            cpl->error = ERR_InvalidSyntax;
+        }
+    } else {
+        compile_expr(cpl, ast_expr_rht(e));
+    }
+    compile_code_append(cpl, code);
+}
+
+/*
+ * Common subexpression of property chains
+ *
+ * Statements without control flow, as expression, var & return, in sequence
+ * are a basic block. Property chains "a.b.c" and pure calls loaded more than
+ * once in block are counted before it be compiled, the first load store the
+ * value to a hidden variable, and the later ones reuse it, till be clobbered:
+ *   call: clobber all, the callee could change anything, except pure one
+ *   store to element: clobber all, the key is not known
+ *   store to property: clobber chains with the same key, and pure calls
+ *   store to variable: clobber chains of the variable
+ * Value loaded in conditional part of expression is not reused after it.
+ */
+// Operand could be reused: name, literal, property chain, or pure call of them
+static int compile_cse_operand(compile_t *cpl, expr_t *e)
+{
+    expr_t *list;
+
+    switch (e->type) {
+    case EXPR_ID:
+    case EXPR_NUM:
+    case EXPR_STRING:   return 1;
+    case EXPR_PROP:     return ast_expr_rht(e)->type == EXPR_ID && compile_cse_operand(cpl, ast_expr_lft(e));
+    case EXPR_CALL:     if (!compile_native_pure(cpl, ast_expr_lft(e))) {
+                            return 0;
+                        }
+                        for (list = ast_expr_rht(e); list; list = list->type == EXPR_COMMA ? ast_expr_rht(list) : NULL) {
+                            if (!compile_cse_operand(cpl, list->type == EXPR_COMMA ? ast_expr_lft(list) : list)) {
+                                return 0;
+                            }
+                        }
+                        return 1;
+    default:            return 0;
+    }
+}
+
+static inline int compile_cse_chain(compile_t *cpl, expr_t *e) {
+    return (e->type == EXPR_PROP || e->type == EXPR_CALL) && compile_cse_operand(cpl, e);
+}
+
+static int compile_cse_same(expr_t *a, expr_t *b)
+{
+    if (!a || !b || a->type != b->type) {
+        return a == b;
+    }
+
+    switch (a->type) {
+    case EXPR_ID:
+    case EXPR_STRING:   return !strcmp(ast_expr_text(a), ast_expr_text(b));
+    case EXPR_NUM:      return !memcmp(&a->body.data.num, &b->body.data.num, sizeof(double));
+    case EXPR_PROP:
+    case EXPR_CALL:
+    case EXPR_COMMA:    return compile_cse_same(ast_expr_lft(a), ast_expr_lft(b)) &&
+                               compile_cse_same(ast_expr_rht(a), ast_expr_rht(b));
+    default:            return 0;
+    }
+}
+
+// Operand depend on variable, or property with the key; call may read any property
+static int compile_cse_depend(expr_t *e, const char *var, const char *key)
+{
+    switch (e ? e->type : 0) {
+    case EXPR_ID:       return var && !strcmp(ast_expr_text(e), var);
+    case EXPR_PROP:     return (key && !strcmp(ast_expr_text(ast_expr_rht(e)), key)) ||
+                               compile_cse_depend(ast_expr_lft(e), var, key);
+    case EXPR_CALL:     return key || compile_cse_depend(ast_expr_rht(e), var, key);
+    case EXPR_COMMA:    return compile_cse_depend(ast_expr_lft(e), var, key) ||
+                               compile_cse_depend(ast_expr_rht(e), var, key);
+    default:            return 0;
+    }
+}
+
+static compile_cse_t *compile_cse_find(compile_t *cpl, expr_t *e)
+{
+    int i;
+
+    for (i = 0; i < cpl->cse_num; i++) {
+        if (compile_cse_same(cpl->cse[i].chain, e)) {
+            return cpl->cse + i;
+        }
+    }
+    return NULL;
+}
+
+static compile_cse_t *compile_cse_find_add(compile_t *cpl, expr_t *e)
+{
+    compile_cse_t *c = compile_cse_find(cpl, e);
+
+    if (!c && cpl->cse_num < LIMIT_CSE_SIZE) {
+        c = cpl->cse + cpl->cse_num++;
+        c->chain = e;
+        c->count = c->ext = 0;
+        c->var = -1;
+    }
+    return c;
+}
+
+static int compile_visit_cse(compile_t *cpl, expr_t *e, void *ud)
+{
+    compile_cse_t *c;
+    (void) ud;
+
+    if (compile_cse_chain(cpl, e)) {
+        if ((c = compile_cse_find_add(cpl, e)) != NULL) {
+            c->count++;
+        }
+    } else
+    if ((e->type >= EXPR_ASSIGN && e->type <= EXPR_RSHIFT_ASSIGN) ||
+        (e->type >= EXPR_INC && e->type <= EXPR_DEC_PRE)) {
+        // Target of store is not a load
+        expr_t *lft = ast_expr_lft(e);
+
+        if (lft->type == EXPR_PROP && compile_cse_chain(cpl, lft) && (c = compile_cse_find_add(cpl, lft)) != NULL) {
+            c->count--;
+        }
+    }
+    return 0;
+}
+
+static inline int compile_cse_simple(stmt_t *s) {
+    return s->type == STMT_EXPR || s->type == STMT_VAR || s->type == STMT_CONST ||
+           s->type == STMT_RET || s->type == STMT_PASS;
+}
+
+static inline void compile_cse_reset(compile_t *cpl) {
+    cpl->cse_num = -1;
+    cpl->cse_valid = 0;
+}
+
+// Count the chains of basic block begin with s
+static void compile_cse_scan(compile_t *cpl, stmt_t *s)
+{
+    int i;
+
+    cpl->cse_num = 0;
+    cpl->cse_valid = 0;
+    for (; s && compile_cse_simple(s); s = ast_stmt_next(s)) {
+        if (ast_stmt_expr(s)) {
+            compile_visit_expr(cpl, ast_stmt_expr(s), compile_visit_cse, NULL);
+        }
+    }
+
+    // Chain only loaded as prefix of a longer one, need not be kept
+    for (i = 0; i < cpl->cse_num; i++) {
+        expr_t *lft = ast_expr_lft(cpl->cse[i].chain);
+        compile_cse_t *c = lft->type == EXPR_PROP ? compile_cse_find(cpl, lft) : NULL;
+
+        if (c && c->ext < cpl->cse[i].count) {
+            c->ext = cpl->cse[i].count;
+        }
+    }
+}
+
+// Clobber chains of variable, or with the key, or all if both are NULL
+static void compile_cse_kill(compile_t *cpl, const char *var, const char *key)
+{
+    int i;
+
+    for (i = 0; cpl->cse_valid && i < cpl->cse_num; i++) {
+        if ((!var && !key) || compile_cse_depend(cpl->cse[i].chain, var, key)) {
+            cpl->cse_valid &= ~(1u << i);
+        }
+    }
+}
+
+// return: 1 if the chain is reused, or loaded and kept
+static int compile_cse_expr(compile_t *cpl, expr_t *e)
+{
+    compile_cse_t *c;
+    uint32_t bit;
+    uint8_t code[3];
+
+    if (cpl->cse_num <= 0 || cpl->inline_args || !compile_cse_chain(cpl, e) ||
+        !(c = compile_cse_find(cpl, e)) || c->count < 2 || c->count <= c->ext) {
+        return 0;
+    }
+
+    bit = 1u << (c - cpl->cse);
+    if (cpl->cse_valid & bit) {
+        compile_code_append_var(cpl, c->var, 0);
+        return 1;
+    }
+
+    if (c->var < 0) {
+        char name[4] = {'#', 'c', 'A' + (c - cpl->cse), 0};
+
+        if (0 > (c->var = compile_var_hidden(cpl, name))) {
+            return 0;
+        }
+    }
+
+    code[0] = BC_PUSH_REF;
+    code[1] = c->var;
+    code[2] = 0;
+    compile_code_appends(cpl, 3, code);
+    if (e->type == EXPR_PROP) {
+        compile_expr_binary(cpl, e, BC_PROP);
+    } else {
+        compile_func_call_code(cpl, e);
+    }
+    compile_code_append(cpl, BC_ASSIGN);
+    cpl->cse_valid |= bit;
+
+    return 1;
+}
+
+/*
+ * Hoist of pure calls
+ *
+ * Pure call in loop, with arguments of constants and local variables which
+ * hold number and never be assigned in the loop, is evaluated once before
+ * the loop, and the result is kept by a hidden variable. It is done with
+ * type inference, in function without nested function.
+ */
+typedef struct compile_hoist_scan_t {
+    uint32_t vars;     // variables hold number & not be assigned in the loop
+    int      num;
+    expr_t  *calls[LIMIT_HOIST_SIZE];
+} compile_hoist_scan_t;
+
+static int compile_visit_assigned(compile_t *cpl, expr_t *e, void *ud)
+{
+    uint32_t *vars = ud;
+
+    if ((e->type >= EXPR_ASSIGN && e->type <= EXPR_RSHIFT_ASSIGN) ||
+        (e->type >= EXPR_INC && e->type <= EXPR_DEC_PRE)) {
+        int id = compile_type_var(cpl, ast_expr_lft(e));
+
+        if (id >= 0) {
+            *vars &= ~(1u << id);
+        }
+    }
+    return 0;
+}
+
+static int compile_visit_is(compile_t *cpl, expr_t *e, void *ud)
+{
+    (void) cpl;
+    return e == ud;
+}
+
+// names: count of variables referred
+static int compile_hoist_operand(compile_t *cpl, expr_t *e, uint32_t vars, int *names)
+{
+    expr_t *list;
+    val_t v;
+    int n = 0;
+
+    switch (e->type) {
+    case EXPR_NUM:  return 1;
+    case EXPR_ID:   if (compile_const_fold(cpl, e, &v, &n)) {
+                        return 1;
+                    }
+                    *names += 1;
+                    return compile_type_var_num(cpl, compile_type_var(cpl, e), vars);
+    case EXPR_CALL: if (!compile_native_pure(cpl, ast_expr_lft(e))) {
+                        return 0;
+                    }
+                    for (list = ast_expr_rht(e); list; list = list->type == EXPR_COMMA ? ast_expr_rht(list) : NULL) {
+                        if (!compile_hoist_operand(cpl, list->type == EXPR_COMMA ? ast_expr_lft(list) : list, vars, names)) {
+                            return 0;
+                        }
+                    }
+                    return 1;
+    default:        return 0;
+    }
+}
+
+static int compile_visit_hoist(compile_t *cpl, expr_t *e, void *ud)
+{
+    compile_hoist_scan_t *scan = ud;
+    int i, names = 0;
+
+    // Call of constants is folded
+    if (e->type != EXPR_CALL || scan->num >= LIMIT_HOIST_SIZE ||
+        !compile_hoist_operand(cpl, e, scan->vars, &names) || !names) {
+        return 0;
+    }
+
+    for (i = 0; i < scan->num; i++) {
+        if (compile_cse_same(scan->calls[i], e) ||
+            compile_visit_expr(cpl, scan->calls[i], compile_visit_is, e)) {
+            return 0;
+        }
+    }
+    scan->calls[scan->num++] = e;
+
+    return 0;
+}
+
+// Evaluate the invariant pure calls of loop, return: hoisted calls before
+static compile_hoist_t *compile_hoist_loop(compile_t *cpl, expr_t *cond, stmt_t *block, uint32_t vars)
+{
+    compile_hoist_t *prev = cpl->hoists, *h;
+    compile_hoist_scan_t scan;
+    int i, depth = 0;
+
+    if (!cpl->num_body || !cpl->env->native_pure) {
+        return prev;
+    }
+
+    scan.vars = vars & ~compile_type_iter(cpl, block);
+    scan.num = 0;
+    if (cond) {
+        compile_visit_expr(cpl, cond, compile_visit_assigned, &scan.vars);
+        compile_visit_expr(cpl, cond, compile_visit_hoist, &scan);
+    }
+    compile_visit_stmt(cpl, block, compile_visit_assigned, &scan.vars);
+    compile_visit_stmt(cpl, block, compile_visit_hoist, &scan);
+
+    for (h = prev; h; h = h->next) {
+        depth++;
+    }
+
+    for (i = 0; i < scan.num && !cpl->error; i++) {
+        char name[4] = {'#', 'h', 'A' + depth + i, 0};
+        uint8_t code[2] = {BC_POP_VAR, 0};
+        int id;
+
+        if (NULL == (h = compile_malloc(cpl, sizeof(compile_hoist_t))) ||
+            0 > (id = compile_var_hidden(cpl, name))) {
+            break;
+        }
+
+        code[1] = id;
+        compile_func_call_code(cpl, scan.calls[i]);
+        compile_code_appends(cpl, 2, code);
+
+        h->call = scan.calls[i];
+        h->var = id;
+        h->next = cpl->hoists;
+        cpl->hoists = h;
+    }
+
+    return prev;
+}
+
+// return: 1 if the call is hoisted, and its result loaded
+static int compile_hoist_load(compile_t *cpl, expr_t *e)
+{
+    compile_hoist_t *h;
+
+    for (h = cpl->hoists; h; h = h->next) {
+        if (compile_cse_same(h->call, e)) {
+            compile_code_append_var(cpl, h->var, 0);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void compile_expr_field(compile_t *cpl, expr_t *e, uint8_t code)
+{
+    int id = compile_scalar_var(cpl, e);
+
+    if (id >= 0) {
+        compile_code_append_var(cpl, id, 0);
+    } else
+    if (code != BC_PROP || !compile_cse_expr(cpl, e)) {
+        compile_expr_binary(cpl, e, code);
+    }
+}
+
+// Emit the typed instruction, if both operands are numbers
+static int compile_expr_arith(compile_t *cpl, expr_t *e, uint8_t code, uint8_t typed)
+{
+    int num;
+
+    compile_expr(cpl, ast_expr_lft(e)); num = cpl->expr_num;
+    compile_expr(cpl, ast_expr_rht(e)); num = num && cpl->expr_num;
+    compile_code_append(cpl, num ? typed : code);
+
+    return num;
+}
+
+static int compile_expr_logic_and(compile_t *cpl, expr_t *e)
+{
+    int pos, num;
+    uint32_t vars, valid;
+
+    compile_expr(cpl, ast_expr_lft(e)); pos = compile_code_pos(cpl);
+    num = cpl->expr_num; vars = cpl->num_vars; valid = cpl->cse_valid;
+    compile_expr(cpl, ast_expr_rht(e));
+    compile_false_jmp_true_pop(cpl, pos, compile_code_pos(cpl));
+    cpl->num_vars &= vars; cpl->cse_valid &= valid;
+
+    return num && cpl->expr_num;
+}
+
+static int compile_expr_logic_or(compile_t *cpl, expr_t *e)
+{
+    int pos, num;
+    uint32_t vars, valid;
+
+    compile_expr(cpl, ast_expr_lft(e)); pos = compile_code_pos(cpl);
+    num = cpl->expr_num; vars = cpl->num_vars; valid = cpl->cse_valid;
+    compile_expr(cpl, ast_expr_rht(e));
+    compile_true_jmp_false_pop(cpl, pos, compile_code_pos(cpl));
+    cpl->num_vars &= vars; cpl->cse_valid &= valid;
+
+    return num && cpl->expr_num;
+}
+
+/*
+ * Constants: primitive value is inlined at each use, other value is kept
+ * by a read only variable. The variable is also set for primitive one,
+ * it is still visible to later compile, as interactive mode.
+ */
+static compile_const_t *compile_const_find(compile_t *cpl, expr_t *e)
+{
+    compile_func_t *func;
+    compile_const_t *c;
+    int id;
+
+    if (!cpl->consts || e->type != EXPR_ID || cpl->inline_args) {
+        return NULL;
+    }
+
+    func = compile_varmap_owner(cpl, compile_sym_find(cpl, ast_expr_text(e)), &id);
+    for (c = cpl->consts; func && c; c = c->next) {
+        if (c->id == id && cpl->func_buf + c->func == func) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static inline int compile_const_check(compile_t *cpl, expr_t *e)
+{
+    if (compile_const_find(cpl, e)) {
+        cpl->error = ERR_InvalidLeftValue;
+        return -1;
+    }
+    return 0;
+}
+
+// Native function declared pure, which is called by the name, or NULL
+static const native_t *compile_native_pure(compile_t *cpl, expr_t *callor)
+{
+    intptr_t sym_id;
+    int id;
+
+    if (callor->type != EXPR_ID || cpl->inline_args || compile_const_find(cpl, callor)) {
+        return NULL;
+    }
+
+    sym_id = compile_sym_find(cpl, ast_expr_text(callor));
+    if (!sym_id || compile_varmap_lookup(cpl, sym_id, NULL) >= 0 ||
+        (id = compile_native_lookup(cpl, sym_id)) < 0) {
+        return NULL;
+    }
+    return cpl->env->native_ent[id].pure ? cpl->env->native_ent + id : NULL;
+}
+
+// Call native function declared pure with constant arguments, the result
+// is taken only if it is a number
+static int compile_native_fold(compile_t *cpl, expr_t *e, val_t *v, int *names)
+{
+    const native_t *native = compile_native_pure(cpl, ast_expr_lft(e));
+    val_t argv[LIMIT_INLINE_ARGS];
+    expr_t *list = ast_expr_rht(e);
+    compile_pure_t *p;
+    int argc = 0, error, folded;
+
+    if (!native) {
+        return 0;
+    }
+
+    while (list) {
+        if (argc >= LIMIT_INLINE_ARGS ||
+            !compile_const_fold(cpl, list->type == EXPR_COMMA ? ast_expr_lft(list) : list, argv + argc++, names)) {
+            return 0;
+        }
+        list = list->type == EXPR_COMMA ? ast_expr_rht(list) : NULL;
+    }
+
+    // native is called once for the same arguments
+    for (p = cpl->pures; p; p = p->next) {
+        if (p->native == native && p->argc == argc && !memcmp(p->argv, argv, sizeof(val_t) * argc)) {
+            *v = p->result;
+            return p->folded;
+        }
+    }
+
+    error = cpl->env->error;
+    *v = native->fn(cpl->env, argc, argv);
+    folded = cpl->env->error == error && val_is_number(v);
+    cpl->env->error = error;
+
+    if ((p = compile_malloc(cpl, sizeof(compile_pure_t) + sizeof(val_t) * argc)) != NULL) {
+        p->native = native;
+        p->argc = argc;
+        p->folded = folded;
+        p->result = *v;
+        memcpy(p->argv, argv, sizeof(val_t) * argc);
+        p->next = cpl->pures;
+        cpl->pures = p;
+    }
+    return folded;
+}
+
+// Evaluate expression of number constants, as the interpreter does
+// names: count of constant names and pure calls referred
+static int compile_const_fold(compile_t *cpl, expr_t *e, val_t *v, int *names)
+{
+    void (*op)(void *, val_t *, val_t *, val_t *);
+    compile_const_t *c;
+    val_t a, b;
+
+    switch (e->type) {
+    case EXPR_NUM:  val_set_number(v, ast_expr_num(e)); return 1;
+    case EXPR_ID:   c = compile_const_find(cpl, e);
+                    *names += 1;
+                    return c && c->value && compile_const_fold(cpl, c->value, v, names);
+    case EXPR_NEG:  if (!compile_const_fold(cpl, ast_expr_lft(e), &a, names)) return 0;
+                    val_neg(cpl->env, &a, v); return 1;
+    case EXPR_NOT:  if (!compile_const_fold(cpl, ast_expr_lft(e), &a, names)) return 0;
+                    val_not(cpl->env, &a, v); return 1;
+    case EXPR_CALL: *names += 1;
+                    return compile_native_fold(cpl, e, v, names);
+    case EXPR_MUL:  op = val_mul; break;
+    case EXPR_DIV:  op = val_div; break;
+    case EXPR_MOD:  op = val_mod; break;
+    case EXPR_ADD:  op = val_add; break;
+    case EXPR_SUB:  op = val_sub; break;
+    case EXPR_AND:  op = val_and; break;
+    case EXPR_OR:   op = val_or; break;
+    case EXPR_XOR:  op = val_xor; break;
+    case EXPR_LSHIFT: op = val_lshift; break;
+    case EXPR_RSHIFT: op = val_rshift; break;
+    default:        return 0;
+    }
+
+    if (!compile_const_fold(cpl, ast_expr_lft(e), &a, names) ||
+        !compile_const_fold(cpl, ast_expr_rht(e), &b, names)) {
+        return 0;
+    }
+    op(cpl->env, &a, &b, v);
+    return 1;
+}
+
+// return: 1 if number pushed
+static int compile_const_push(compile_t *cpl, expr_t *e)
+{
+    switch (e->type) {
+    case EXPR_NUM:      compile_code_append_num(cpl, ast_expr_num(e)); return 1;
+    case EXPR_NAN:      compile_code_append(cpl, BC_PUSH_NAN); return 1;
+    case EXPR_UND:      compile_code_append(cpl, BC_PUSH_UND); return 0;
+    case EXPR_TRUE:     compile_code_append(cpl, BC_PUSH_TRUE); return 0;
+    case EXPR_FALSE:    compile_code_append(cpl, BC_PUSH_FALSE); return 0;
+    case EXPR_STRING:   compile_code_append_str(cpl, ast_expr_text(e)); return 0;
+    default:            cpl->error = ERR_InvalidSementic; return 0;
+    }
+}
+
+// return: 1 if expression of constant names or pure calls be folded to a
+// number and pushed, arithmetic of literals is left as it is written
+static int compile_const_expr(compile_t *cpl, expr_t *e)
+{
+    int names = 0;
+    val_t v;
+    double n;
+
+    if ((!cpl->consts && !cpl->env->native_pure) || !compile_const_fold(cpl, e, &v, &names) || !names) {
+        return 0;
+    }
+
+    // -0 could not be loaded by PUSH_ZERO
+    n = val_2_double(&v);
+    if (n == 0 && 1 / n < 0) {
+        return 0;
+    }
+
+    if (n != n) {
+        compile_code_append(cpl, BC_PUSH_NAN);
+    } else {
+        compile_code_append_num(cpl, n);
+    }
+    return 1;
+}
+
+static void compile_const_def(compile_t *cpl, expr_t *e)
+{
+    expr_t *id = ast_expr_lft(e), *value = ast_expr_rht(e), *copy;
+    compile_const_t *c;
+    val_t v;
+    int var, names = 0;
+
+    if (0 > compile_var_add_name(cpl, ast_expr_text(id))) {
+        cpl->error = ERR_NotEnoughMemory;
+        return;
+    }
+    if (compile_const_check(cpl, id)) {
+        return;
+    }
+    var = compile_varmap_lookup_name(cpl, ast_expr_text(id), NULL);
+
+    compile_expr(cpl, e);
+    compile_code_append(cpl, BC_POP);
+
+    if (cpl->error || !(c = compile_malloc(cpl, sizeof(compile_const_t)))) {
+        if (!cpl->error) cpl->error = ERR_NotEnoughMemory;
+        return;
+    }
 
-    if (!cpl->error && 0 == compile_code_insert(cpl, from, step > 127 ? 3 : 2)) {
-        uint8_t *code_buf = compile_code_buf(cpl);
-        if (step > 127) {
-            code_buf[from++] = BC_POP_JMP_F;
-            code_buf[from++] = step >> 8;
-        } else {
-            code_buf[from++] = BC_POP_SJMP_F;
+    if (value->type == EXPR_ID) {
+        compile_const_t *from = compile_const_find(cpl, value);
+
+        value = from ? from->value : NULL;
+    } else if (value->type != EXPR_NUM && compile_const_fold(cpl, value, &v, &names)) {
+        if ((value = compile_malloc(cpl, sizeof(expr_t))) != NULL) {
+            *value = *e;
+            value->type = EXPR_NUM;
+            value->body.data.num = val_2_double(&v);
+        }
+    } else if (value->type > EXPR_STRING || value->type == EXPR_FUNCPROC) {
+        value = NULL;
+    } else if ((copy = compile_malloc(cpl, sizeof(expr_t))) != NULL) {
+        // keep a copy, the AST may be released before out of scope
+        *copy = *value;
+        if (copy->type == EXPR_STRING) {
+            copy->body.data.str = (char *)compile_sym_add(cpl, ast_expr_text(value));
         }
-        code_buf[from++] = step;
+        value = copy;
     }
+
+    c->func = cpl->func_cur;
+    c->id = var;
+    c->value = value;
+    c->next = cpl->consts;
+    cpl->consts = c;
 }
 
-static void compile_expr_binary(compile_t *cpl, expr_t *e, uint8_t code)
+static void compile_stmt_const(compile_t *cpl, stmt_t *s)
 {
-    compile_expr(cpl, ast_expr_lft(e));
-    if (e->type == EXPR_PROP) {
-        if (ast_expr_rht(e)->type == EXPR_ID) {
-            compile_code_append_str(cpl, ast_expr_text(ast_expr_rht(e)));
+    expr_t *e = ast_stmt_expr(s);
+
+    while (!cpl->error && e) {
+        if (e->type == EXPR_COMMA) {
+            compile_const_def(cpl, ast_expr_lft(e));
+            e = ast_expr_rht(e);
         } else {
-            cpl->error = ERR_InvalidSyntax;
+            compile_const_def(cpl, e);
+            e = NULL;
         }
-    } else {
-        compile_expr(cpl, ast_expr_rht(e));
     }
-    compile_code_append(cpl, code);
-}
-
-static void compile_expr_logic_and(compile_t *cpl, expr_t *e)
-{
-    int pos;
-    compile_expr(cpl, ast_expr_lft(e)); pos = compile_code_pos(cpl);
-    compile_expr(cpl, ast_expr_rht(e));
-    compile_false_jmp_true_pop(cpl, pos, compile_code_pos(cpl));
-}
-
-static void compile_expr_logic_or(compile_t *cpl, expr_t *e)
-{
-    int pos;
-    compile_expr(cpl, ast_expr_lft(e)); pos = compile_code_pos(cpl);
-    compile_expr(cpl, ast_expr_rht(e));
-    compile_true_jmp_false_pop(cpl, pos, compile_code_pos(cpl));
 }
 
-static void compile_expr_id(compile_t *cpl, expr_t *e)
+static int compile_expr_id(compile_t *cpl, expr_t *e)
 {
     intptr_t sym_id = compile_sym_add(cpl, ast_expr_text(e));
+    compile_const_t *c = compile_const_find(cpl, e);
     int generation, id;
 
+    if (c && c->value) {
+        return compile_const_push(cpl, c->value);
+    }
+
     id = compile_varmap_lookup(cpl, sym_id, &generation);
     if (id >= 0) {
         compile_code_append_var(cpl, id, generation);
+        return generation == 0 && id < 32 && (cpl->num_vars & (1u << id));
     } else {
         id = compile_native_lookup(cpl, sym_id);
 
@@ -732,6 +2352,7 @@ static void compile_expr_id(compile_t *cpl, expr_t *e)
             cpl->error = ERR_NotDefinedId;
         }
     }
+    return 0;
 }
 
 static void compile_expr_lft(compile_t *cpl, expr_t *e)
@@ -740,6 +2361,11 @@ static void compile_expr_lft(compile_t *cpl, expr_t *e)
     case EXPR_ID: {
                     int generation;
                     int var_id = compile_varmap_lookup_name(cpl, ast_expr_text(e), &generation);
+
+                    compile_cse_kill(cpl, ast_expr_text(e), NULL);
+                    if (cpl->error || compile_const_check(cpl, e)) {
+                        break;
+                    }
                     if (var_id < 0) {
                         cpl->error = ERR_NotDefinedId;
                     } else {
@@ -828,19 +2454,62 @@ static void compile_arg_list(compile_t *cpl, expr_t *e, int *ac)
 
 static void compile_stmt_block(compile_t *cpl, stmt_t *s)
 {
+    // Block is entered by a jump, as a branch or case, values reused before
+    // it may not be loaded
+    compile_cse_reset(cpl);
     while(s && !cpl->error) {
         if (0 == compile_stmt(cpl, s)) {
             if (s->type == STMT_EXPR) {
                 compile_code_append(cpl, BC_POP);
             }
-            s = s->next;
+            s = ast_stmt_next(s);
         }
     }
 }
 
+static void compile_func_body(compile_t *cpl, int func, expr_t *args, stmt_t *block)
+{
+    int owner = cpl->func_cur;
+    uint32_t vars = cpl->num_vars, clean = cpl->num_clean, check = cpl->num_check;
+    stmt_t *body = cpl->num_body;
+    compile_scalar_t *scalars = cpl->scalars;
+    compile_hoist_t *hoists = cpl->hoists;
+    int spare = cpl->var_spare;
+    compile_cse_t cse[LIMIT_CSE_SIZE];
+    int cse_num = cpl->cse_num;
+    uint32_t cse_valid = cpl->cse_valid;
+
+    memcpy(cse, cpl->cse, sizeof(cse));
+    compile_cse_reset(cpl);
+
+    cpl->func_cur = func;
+    cpl->num_vars = cpl->num_clean = cpl->num_check = 0;
+    cpl->num_body = compile_visit_stmt(cpl, block, compile_visit_funcdef, NULL) ? NULL : block;
+    cpl->scalars = NULL;
+    cpl->hoists = NULL;
+
+    compile_arg_def_list(cpl, args);
+    cpl->var_spare = compile_var_spare(cpl, block);
+    if (LIMIT_SCALAR_SIZE && cpl->num_body) {
+        compile_scalar_scan(cpl, block);
+    }
+    compile_stmt_block(cpl, block);
+    compile_code_append(cpl, BC_RET0);
+
+    cpl->func_cur = owner;
+    cpl->num_vars = vars; cpl->num_clean = clean; cpl->num_check = check;
+    cpl->num_body = body;
+    cpl->scalars = scalars;
+    cpl->hoists = hoists;
+    cpl->var_spare = spare;
+    memcpy(cpl->cse, cse, sizeof(cse));
+    cpl->cse_num = cse_num;
+    cpl->cse_valid = cse_valid;
+}
+
 static void compile_func_def(compile_t *cpl, expr_t *e)
 {
-    int owner, curr, func_id;
+    int curr, func_id;
     expr_t *args, *name;
     stmt_t *block;
 
@@ -852,15 +2521,21 @@ static void compile_func_def(compile_t *cpl, expr_t *e)
         compile_var_def(cpl, name);
     }
 
-    owner = cpl->func_cur;
-    if (0 > (curr = compile_func_append(cpl, owner))) {
+    if (0 > (curr = compile_func_append(cpl, cpl->func_cur))) {
         return;
     }
-    cpl->func_cur = curr;
-    compile_arg_def_list(cpl, args);
-    compile_stmt_block(cpl, block);
-    compile_code_append(cpl, BC_RET0);
-    cpl->func_cur = owner;
+
+    if (cpl->lazy && cpl->func_cur == 0 && !cpl->inline_args) {
+        ast_span_t *span = ast_expr_span(ast_expr_rht(e));
+
+        cpl->func_buf[curr].src = cpl->lazy + span->start;
+        cpl->func_buf[curr].src_size = span->size;
+        cpl->func_buf[curr].consts = cpl->consts;
+    } else {
+        cpl->func_buf[curr].args = args;
+        cpl->func_buf[curr].body = block;
+        compile_func_body(cpl, curr, args, block);
+    }
 
     func_id = curr + cpl->func_offset;
     if (name) {
@@ -952,11 +2627,19 @@ static void compile_callor(compile_t *cpl, expr_t *e, int argc)
     compile_code_append_call(cpl, argc);
 }
 
-static void compile_assign(compile_t *cpl, expr_t *e)
+static int compile_assign(compile_t *cpl, expr_t *e)
 {
     int op  = e->type - EXPR_ASSIGN;
     int lft = ast_expr_lft(e)->type;
+    int id;
+
+    if ((lft == EXPR_PROP || lft == EXPR_ELEM) && 0 <= (id = compile_scalar_var(cpl, ast_expr_lft(e)))) {
+        uint8_t code[3] = {BC_PUSH_REF, id, 0};
 
+        compile_code_appends(cpl, 3, code);
+        compile_expr(cpl, ast_expr_rht(e));
+        compile_code_append(cpl, BC_ASSIGN + op);
+    } else
     if (lft == EXPR_PROP) {
         expr_t *prop = ast_expr_rht(ast_expr_lft(e));
 
@@ -964,126 +2647,189 @@ static void compile_assign(compile_t *cpl, expr_t *e)
         compile_code_append_str(cpl, ast_expr_text(prop));
         compile_expr(cpl, ast_expr_rht(e));
         compile_code_append(cpl, BC_PROP_ASSIGN + op);
+        compile_cse_kill(cpl, NULL, ast_expr_text(prop));
     } else
     if (lft == EXPR_ELEM) {
         compile_expr(cpl, ast_expr_lft(ast_expr_lft(e)));
         compile_expr(cpl, ast_expr_rht(ast_expr_lft(e)));
         compile_expr(cpl, ast_expr_rht(e));
         compile_code_append(cpl, BC_ELEM_ASSIGN + op);
+        compile_cse_kill(cpl, NULL, NULL);
     } else {
         compile_expr_lft(cpl, ast_expr_lft(e));
         compile_expr(cpl, ast_expr_rht(e));
         compile_code_append(cpl, BC_ASSIGN + op);
+        return compile_type_assign(cpl, e, cpl->expr_num);
     }
+    return 0;
 }
 
-static void compile_selfop(compile_t *cpl, expr_t *e)
+static int compile_selfop(compile_t *cpl, expr_t *e)
 {
     int op  = e->type - EXPR_INC;
     int lft = ast_expr_lft(e)->type;
+    int id;
+
+    if ((lft == EXPR_PROP || lft == EXPR_ELEM) && 0 <= (id = compile_scalar_var(cpl, ast_expr_lft(e)))) {
+        uint8_t code[3] = {BC_PUSH_REF, id, 0};
 
+        compile_code_appends(cpl, 3, code);
+        compile_code_append(cpl, BC_INC + op);
+    } else
     if (lft == EXPR_PROP) {
         expr_t *prop = ast_expr_rht(ast_expr_lft(e));
 
         compile_expr(cpl, ast_expr_lft(ast_expr_lft(e)));
         compile_code_append_str(cpl, ast_expr_text(prop));
         compile_code_append(cpl, BC_PROP_INC + op);
+        compile_cse_kill(cpl, NULL, ast_expr_text(prop));
     } else
     if (lft == EXPR_ELEM) {
         compile_expr(cpl, ast_expr_lft(ast_expr_lft(e)));
         compile_expr(cpl, ast_expr_rht(ast_expr_lft(e)));
         compile_code_append(cpl, BC_ELEM_INC + op);
+        compile_cse_kill(cpl, NULL, NULL);
     } else {
-        compile_expr_lft(cpl, ast_expr_lft(e));
-        compile_code_append(cpl, BC_INC + op);
+        int id = compile_type_var(cpl, ast_expr_lft(e));
+
+        if (compile_const_check(cpl, ast_expr_lft(e))) {
+            return 0;
+        }
+        if (compile_type_var_num(cpl, id, cpl->num_vars)) {
+            uint8_t code[2];
+
+            code[0] = BC_INC_NUM + op;
+            code[1] = id;
+            compile_code_appends(cpl, 2, code);
+            compile_cse_kill(cpl, ast_expr_text(ast_expr_lft(e)), NULL);
+        } else {
+            compile_expr_lft(cpl, ast_expr_lft(e));
+            compile_code_append(cpl, BC_INC + op);
+        }
+        return 1;
     }
+    return 0;
 }
-static inline void compile_comma(compile_t *cpl, expr_t *e)
+
+static inline int compile_comma(compile_t *cpl, expr_t *e)
 {
     compile_expr(cpl, ast_expr_lft(e));
     compile_code_append(cpl, BC_POP);
     compile_expr(cpl, ast_expr_rht(e));
+
+    return cpl->expr_num;
 }
 
-static inline void compile_ternary(compile_t *cpl, expr_t *e)
+static inline int compile_ternary(compile_t *cpl, expr_t *e)
 {
-    int pos1, pos2, end;
+    int pos1, pos2, end, num;
+    uint32_t vars, then_vars, valid, then_valid;
 
     compile_expr(cpl, ast_expr_lft(e)); pos1 = compile_code_pos(cpl);
+    vars = cpl->num_vars; valid = cpl->cse_valid;
     compile_expr(cpl, ast_expr_lft(ast_expr_rht(e))); pos2 = compile_code_pos(cpl);
+    num = cpl->expr_num; then_vars = cpl->num_vars; then_valid = cpl->cse_valid;
+    cpl->num_vars = vars; cpl->cse_valid = valid;
     compile_expr(cpl, ast_expr_rht(ast_expr_rht(e))); end = compile_code_pos(cpl);
+    cpl->num_vars &= then_vars; cpl->cse_valid &= then_valid;
 
     compile_code_insert_jmp_to(cpl, pos2, end);
     compile_false_pop_jmp(cpl, pos1, pos2 + (compile_code_pos(cpl) - end));
+
+    return num && cpl->expr_num;
 }
 
-static inline void compile_func_call(compile_t *cpl, expr_t *e)
+static void compile_func_call_code(compile_t *cpl, expr_t *e)
 {
     int argc = 0;
-    expr_t *args, *func;
 
-    func = ast_expr_lft(e);
-    args = ast_expr_rht(e);
+    compile_arg_list(cpl, ast_expr_rht(e), &argc);
+    compile_callor(cpl, ast_expr_lft(e), argc);
+}
+
+static inline void compile_func_call(compile_t *cpl, expr_t *e)
+{
+    // Pure call clobber nothing
+    if (compile_native_pure(cpl, ast_expr_lft(e))) {
+        if (!compile_hoist_load(cpl, e) && !compile_cse_expr(cpl, e)) {
+            compile_func_call_code(cpl, e);
+        }
+        return;
+    }
 
-    compile_arg_list(cpl, args, &argc);
-    compile_callor(cpl, func, argc);
+    if (!compile_inline_call(cpl, e)) {
+        compile_func_call_code(cpl, e);
+    }
+    compile_cse_kill(cpl, NULL, NULL);
 }
 
 static void compile_expr(compile_t *cpl, expr_t *e)
 {
+    int num = 0;
+
     if (cpl->error) {
         return;
     }
 
+    if (cpl->lines) {
+        compile_line_mark(cpl, e);
+    }
+
+    // Fold the arithmetic of number constants
+    if (((e->type >= EXPR_NEG && e->type <= EXPR_XOR) || e->type == EXPR_CALL) && compile_const_expr(cpl, e)) {
+        cpl->expr_num = 1;
+        return;
+    }
+
     switch (e->type) {
-    case EXPR_ID:       compile_expr_id(cpl, e); break;
-    case EXPR_NAN:      compile_code_append(cpl, BC_PUSH_NAN); break;
+    case EXPR_ID:       num = compile_expr_id(cpl, e); break;
+    case EXPR_NAN:      compile_code_append(cpl, BC_PUSH_NAN); num = 1; break;
     case EXPR_UND:      compile_code_append(cpl, BC_PUSH_UND); break;
-    case EXPR_NUM:      compile_code_append_num(cpl, ast_expr_num(e)); break;
+    case EXPR_NUM:      compile_code_append_num(cpl, ast_expr_num(e)); num = 1; break;
     case EXPR_TRUE:     compile_code_append(cpl, BC_PUSH_TRUE); break;
     case EXPR_FALSE:    compile_code_append(cpl, BC_PUSH_FALSE); break;
     case EXPR_FUNCDEF:  compile_func_def(cpl, e); break;
     case EXPR_STRING:   compile_code_append_str(cpl, ast_expr_text(e)); break;
 
-    case EXPR_NEG:      compile_expr(cpl, ast_expr_lft(e)); compile_code_append(cpl, BC_NEG); break;
-    case EXPR_NOT:      compile_expr(cpl, ast_expr_lft(e)); compile_code_append(cpl, BC_NOT); break;
+    case EXPR_NEG:      compile_expr(cpl, ast_expr_lft(e)); compile_code_append(cpl, BC_NEG); num = 1; break;
+    case EXPR_NOT:      compile_expr(cpl, ast_expr_lft(e)); compile_code_append(cpl, BC_NOT); num = 1; break;
     case EXPR_LOGIC_NOT:compile_expr(cpl, ast_expr_lft(e)); compile_code_append(cpl, BC_LOGIC_NOT); break;
 
     case EXPR_INC:
     case EXPR_INC_PRE:
     case EXPR_DEC:
-    case EXPR_DEC_PRE:  compile_selfop(cpl, e); break;
+    case EXPR_DEC_PRE:  num = compile_selfop(cpl, e); break;
 
     case EXPR_ARRAY:    compile_array(cpl, e); break;
     case EXPR_DICT:     compile_dict(cpl, e); break;
 
-    case EXPR_MUL:      compile_expr_binary(cpl, e, BC_MUL); break;
-    case EXPR_DIV:      compile_expr_binary(cpl, e, BC_DIV); break;
-    case EXPR_MOD:      compile_expr_binary(cpl, e, BC_MOD); break;
-    case EXPR_ADD:      compile_expr_binary(cpl, e, BC_ADD); break;
-    case EXPR_SUB:      compile_expr_binary(cpl, e, BC_SUB); break;
+    case EXPR_MUL:      compile_expr_arith(cpl, e, BC_MUL, BC_MUL_NUM); num = 1; break;
+    case EXPR_DIV:      compile_expr_binary(cpl, e, BC_DIV); num = 1; break;
+    case EXPR_MOD:      compile_expr_binary(cpl, e, BC_MOD); num = 1; break;
+    case EXPR_ADD:      num = compile_expr_arith(cpl, e, BC_ADD, BC_ADD_NUM); break;
+    case EXPR_SUB:      compile_expr_arith(cpl, e, BC_SUB, BC_SUB_NUM); num = 1; break;
 
-    case EXPR_AND:      compile_expr_binary(cpl, e, BC_AAND); break;
-    case EXPR_OR:       compile_expr_binary(cpl, e, BC_AOR); break;
-    case EXPR_XOR:      compile_expr_binary(cpl, e, BC_AXOR); break;
+    case EXPR_AND:      compile_expr_binary(cpl, e, BC_AAND); num = 1; break;
+    case EXPR_OR:       compile_expr_binary(cpl, e, BC_AOR); num = 1; break;
+    case EXPR_XOR:      compile_expr_binary(cpl, e, BC_AXOR); num = 1; break;
 
-    case EXPR_LSHIFT:   compile_expr_binary(cpl, e, BC_LSHIFT); break;
-    case EXPR_RSHIFT:   compile_expr_binary(cpl, e, BC_RSHIFT); break;
+    case EXPR_LSHIFT:   compile_expr_binary(cpl, e, BC_LSHIFT); num = 1; break;
+    case EXPR_RSHIFT:   compile_expr_binary(cpl, e, BC_RSHIFT); num = 1; break;
 
     case EXPR_TEQ:      compile_expr_binary(cpl, e, BC_TEQ); break;
     case EXPR_TNE:      compile_expr_binary(cpl, e, BC_TNE); break;
-    case EXPR_TGT:      compile_expr_binary(cpl, e, BC_TGT); break;
-    case EXPR_TGE:      compile_expr_binary(cpl, e, BC_TGE); break;
-    case EXPR_TLT:      compile_expr_binary(cpl, e, BC_TLT); break;
-    case EXPR_TLE:      compile_expr_binary(cpl, e, BC_TLE); break;
+    case EXPR_TGT:      compile_expr_arith(cpl, e, BC_TGT, BC_TGT_NUM); break;
+    case EXPR_TGE:      compile_expr_arith(cpl, e, BC_TGE, BC_TGE_NUM); break;
+    case EXPR_TLT:      compile_expr_arith(cpl, e, BC_TLT, BC_TLT_NUM); break;
+    case EXPR_TLE:      compile_expr_arith(cpl, e, BC_TLE, BC_TLE_NUM); break;
     case EXPR_TIN:      compile_expr_binary(cpl, e, BC_TIN); break;
 
-    case EXPR_LOGIC_AND:compile_expr_logic_and(cpl, e); break;
-    case EXPR_LOGIC_OR: compile_expr_logic_or(cpl, e); break;
+    case EXPR_LOGIC_AND:num = compile_expr_logic_and(cpl, e); break;
+    case EXPR_LOGIC_OR: num = compile_expr_logic_or(cpl, e); break;
 
     case EXPR_CALL:     compile_func_call(cpl, e); break;
-    case EXPR_PROP:     compile_expr_binary(cpl, e, BC_PROP); break;
-    case EXPR_ELEM:     compile_expr_binary(cpl, e, BC_ELEM); break;
+    case EXPR_PROP:     compile_expr_field(cpl, e, BC_PROP); break;
+    case EXPR_ELEM:     compile_expr_field(cpl, e, BC_ELEM); break;
 
     case EXPR_ASSIGN:
     case EXPR_ADD_ASSIGN:
@@ -1096,25 +2842,27 @@ static void compile_expr(compile_t *cpl, expr_t *e)
     case EXPR_XOR_ASSIGN:
     case EXPR_NOT_ASSIGN:
     case EXPR_LSHIFT_ASSIGN:
-    case EXPR_RSHIFT_ASSIGN: compile_assign(cpl, e); break;
+    case EXPR_RSHIFT_ASSIGN: num = compile_assign(cpl, e); break;
 
 
-    case EXPR_COMMA:    compile_comma(cpl, e); break;
-    case EXPR_TERNARY:  compile_ternary(cpl, e); break;
+    case EXPR_COMMA:    num = compile_comma(cpl, e); break;
+    case EXPR_TERNARY:  num = compile_ternary(cpl, e); break;
 
     default:            cpl->error = ERR_InvalidSementic; break;
     }
+
+    cpl->expr_num = num;
 }
 
 static void compile_stmt_expr(compile_t *cpl, stmt_t *s)
 {
-    compile_expr(cpl, s->expr);
+    compile_expr(cpl, ast_stmt_expr(s));
 }
 
 static void compile_stmt_return(compile_t *cpl, stmt_t *s)
 {
-    if (s->expr) {
-        compile_expr(cpl, s->expr);
+    if (ast_stmt_expr(s)) {
+        compile_expr(cpl, ast_stmt_expr(s));
         compile_code_append(cpl, BC_RET);
     } else {
         compile_code_append(cpl, BC_RET0);
@@ -1123,7 +2871,7 @@ static void compile_stmt_return(compile_t *cpl, stmt_t *s)
 
 static void compile_stmt_var(compile_t *cpl, stmt_t *s)
 {
-    expr_t *e = s->expr;
+    expr_t *e = ast_stmt_expr(s);
 
     while (!cpl->error && e) {
         expr_t *next;
@@ -1140,7 +2888,7 @@ static void compile_stmt_var(compile_t *cpl, stmt_t *s)
             break;
         }
 
-        if (e->type == EXPR_ASSIGN) {
+        if (e->type == EXPR_ASSIGN && !compile_scalar_def(cpl, ast_expr_rht(e))) {
             compile_expr(cpl, e);
             compile_code_append(cpl, BC_POP);
         }
@@ -1170,24 +2918,29 @@ static void compile_stmt_var(compile_t *cpl, stmt_t *s)
 static void compile_stmt_cond(compile_t *cpl, stmt_t *s)
 {
     int test_pos, skip_pos, block, other;
+    uint32_t vars, block_vars;
 
-    compile_expr(cpl, s->expr);
+    compile_expr(cpl, ast_stmt_expr(s));
     test_pos = compile_code_pos(cpl);
+    vars = cpl->num_vars;
 
     compile_code_extend(cpl, 3);
     block = compile_code_pos(cpl);
 
-    compile_stmt_block(cpl, s->block);
+    compile_stmt_block(cpl, ast_stmt_block(s));
     other = compile_code_pos(cpl);
-    if (s->other) {
+    block_vars = cpl->num_vars;
+    cpl->num_vars = vars;
+    if (ast_stmt_other(s)) {
         skip_pos = other;
         compile_code_extend(cpl, 3);
 
         other = compile_code_pos(cpl);
-        compile_stmt_block(cpl, s->other);
+        compile_stmt_block(cpl, ast_stmt_other(s));
 
         compile_code_set_jmp(cpl, skip_pos, BC_JMP, compile_code_pos(cpl) - other);
     }
+    cpl->num_vars &= block_vars;
 
     compile_code_set_jmp(cpl, test_pos, BC_POP_JMP_F, other - block);
 }
@@ -1216,9 +2969,16 @@ static void compile_stmt_while(compile_t *cpl, stmt_t *s)
 {
     int bgn, skip, end, total, block, bgn_bk, skip_bk;
     uint8_t code[2] = {BC_POP_SJMP_T, 3};
+    uint32_t vars;
+    compile_hoist_t *hoists;
+
+    // Variables keep number in the loop, also hold after the loop
+    vars = compile_type_loop(cpl, s, cpl->num_vars);
+    cpl->num_vars = vars;
+    hoists = compile_hoist_loop(cpl, ast_stmt_expr(s), ast_stmt_block(s), vars);
 
     bgn = compile_code_pos(cpl);
-    compile_expr(cpl, s->expr);
+    compile_expr(cpl, ast_stmt_expr(s));
     compile_code_appends(cpl, 2, code);
 
     skip = compile_code_pos(cpl);
@@ -1229,11 +2989,13 @@ static void compile_stmt_while(compile_t *cpl, stmt_t *s)
     bgn_bk = cpl->bgn_pos; skip_bk = cpl->skip_pos;
     cpl->bgn_pos = bgn;    cpl->skip_pos = skip;
 
-    compile_stmt_block(cpl, s->block); if (cpl->error) return;
+    compile_stmt_block(cpl, ast_stmt_block(s)); if (cpl->error) return;
 
     // Restore the begin and skip position
     cpl->bgn_pos = bgn_bk;
     cpl->skip_pos = skip_bk;
+    cpl->num_vars = vars;
+    cpl->hoists = hoists;
 
     end = compile_code_pos(cpl);
     total = end - bgn + 3;
@@ -1255,6 +3017,435 @@ static void compile_stmt_break(compile_t *cpl, stmt_t *s)
     compile_code_append_jmp(cpl, BC_JMP, -total);
 }
 
+/****************************************************************
+ *                        For in & for of form
+ *
+ *              +------------+
+ *              |   object   |
+ *              + ---------- +
+ *              |    ITER    |
+ *              + ---------- +
+ *              |   SJMP 3   | ------------------+
+ * skip:        + ---------- + <-- break         |
+ *         +--- | JMP to End |                   |
+ *         |    + ---------- + <-----------------+ <-- continue
+ * Begin:  |    |  ITER_KEY  | -- exhausted --+
+ *         |    |  ITER_VAL  |                |
+ *         |    + ---------- +                |
+ *         |    | store var  |                |
+ *         |    + ---------- +                |
+ *         |    | statements |                |
+ *         |    + ---------- +                |
+ *         |    | JMP Begin  |                |
+ *         |    + ---------- + <--------------+
+ *         |    | POP ref    |
+ * End:    +--> + ---------- +
+ *              | POP iter   |
+ *              +------------+
+ *
+ * The iterator keep in stack through the loop, variable is stored
+ * by POP_VAR directly when it is local, otherwise a reference pushed
+ * before ITER_KEY/ITER_VAL, "POP ref" is there only for this case.
+ ***************************************************************/
+static void compile_stmt_for(compile_t *cpl, stmt_t *s)
+{
+    expr_t *id = ast_expr_lft(ast_stmt_expr(s));
+    uint8_t code[2] = {BC_SJMP, 3};
+    int bgn, skip, next, end, bgn_bk, skip_bk, var, generation;
+    uint32_t vars;
+    compile_hoist_t *hoists;
+
+    if (ast_stmt_other(s)) {
+        compile_stmt_var(cpl, ast_stmt_other(s));
+    }
+    compile_expr(cpl, ast_expr_rht(ast_stmt_expr(s)));
+    compile_code_append(cpl, BC_ITER);
+    if (cpl->error) {
+        return;
+    }
+
+    var = compile_varmap_lookup_name(cpl, ast_expr_text(id), &generation);
+    if (compile_const_check(cpl, id)) {
+        return;
+    }
+    if (var < 0) {
+        cpl->error = ERR_NotDefinedId;
+        return;
+    }
+
+    // Variable not be a number in the loop
+    vars = compile_type_loop(cpl, s, cpl->num_vars);
+    if (!generation) {
+        compile_type_store(cpl, var, 0);
+    }
+    cpl->num_vars &= vars;
+    vars = cpl->num_vars;
+    hoists = compile_hoist_loop(cpl, NULL, ast_stmt_block(s), vars);
+    compile_code_appends(cpl, 2, code);
+
+    skip = compile_code_pos(cpl);
+    compile_code_extend(cpl, 3);
+
+    bgn = compile_code_pos(cpl);
+    if (generation) {
+        compile_expr_lft(cpl, id);
+    }
+    next = compile_code_pos(cpl);
+    compile_code_extend(cpl, 3);
+    if (generation) {
+        compile_code_append(cpl, BC_ASSIGN);
+        compile_code_append(cpl, BC_POP);
+    } else {
+        code[0] = BC_POP_VAR;
+        code[1] = var;
+        compile_code_appends(cpl, 2, code);
+    }
+
+    bgn_bk = cpl->bgn_pos; skip_bk = cpl->skip_pos;
+    cpl->bgn_pos = bgn;    cpl->skip_pos = skip;
+
+    compile_stmt_block(cpl, ast_stmt_block(s)); if (cpl->error) return;
+
+    cpl->bgn_pos = bgn_bk;
+    cpl->skip_pos = skip_bk;
+    cpl->num_vars = vars;
+    cpl->hoists = hoists;
+
+    compile_code_append_jmp(cpl, BC_JMP, bgn - (compile_code_pos(cpl) + 3));
+    compile_code_set_jmp(cpl, next, s->type == STMT_FOR_IN ? BC_ITER_KEY : BC_ITER_VAL,
+                         compile_code_pos(cpl) - (next + 3));
+    if (generation) {
+        compile_code_append(cpl, BC_POP);
+    }
+    end = compile_code_pos(cpl);
+    compile_code_append(cpl, BC_POP);
+    compile_code_append(cpl, BC_POP);
+
+    compile_code_set_jmp(cpl, skip, BC_JMP, end - (skip + 3));
+}
+
+/****************************************************************
+ *                        Switch form
+ *
+ *              +------------+
+ *              |   value    |
+ *              + ---------- +
+ *              |  dispatch  | -- to case, default or End --+
+ * skip:        + ---------- + <-- break                    |
+ *         +--- | JMP to End |                              |
+ *         |    + ---------- + <----------------------------+
+ *         |    |   cases    |
+ * End:    +--> +------------+
+ *
+ * Dispatch is a jump table while all of the cases are dense integers,
+ * a perfect hash table while all of the cases are constants, otherwise
+ * the cases are compared one by one.
+ ***************************************************************/
+typedef struct compile_case_t {
+    double   num;
+    uint32_t hash;
+    uint16_t id;        // constant id, with BCODE_SWITCH_NUMBER for number
+    uint16_t arm;       // index of case statement
+} compile_case_t;
+
+static int compile_case_const(compile_t *cpl, expr_t *e, compile_case_t *c)
+{
+    int id;
+
+    if (e->type == EXPR_STRING) {
+        if (0 > (id = compile_string_find_add(cpl, compile_sym_add(cpl, ast_expr_text(e))))) {
+            cpl->error = ERR_ResourceOutLimit;
+            return 0;
+        }
+        c->hash = hash_text(ast_expr_text(e), NULL);
+        c->id = id;
+        return 1;
+    }
+
+    if (e->type == EXPR_NUM) {
+        c->num = ast_expr_num(e);
+    } else
+    if (e->type == EXPR_NEG && ast_expr_lft(e)->type == EXPR_NUM && ast_expr_num(ast_expr_lft(e)) != 0) {
+        c->num = -ast_expr_num(ast_expr_lft(e));
+    } else {
+        return 0;
+    }
+
+    if (0 > (id = compile_number_find_add(cpl, c->num)) || id >= BCODE_SWITCH_NUMBER) {
+        return 0;
+    }
+    c->hash = hash_number(c->num);
+    c->id = id | BCODE_SWITCH_NUMBER;
+    return 1;
+}
+
+static inline int compile_case_is_int(compile_case_t *c) {
+    return (c->id & BCODE_SWITCH_NUMBER) && c->num >= -32768 && c->num <= 32767 && c->num == (int)c->num;
+}
+
+/*
+ * Hash and displace: keys are grouped into buckets by low bits of hash,
+ * and a seed is searched for each bucket, from the biggest one, which put
+ * all keys of the bucket into empty slots.
+ * order & start: keys sorted by bucket, and begin of each bucket
+ */
+static int compile_case_hash(compile_case_t *cases, int n, int bits, uint8_t *seed,
+                             uint16_t *slot, uint16_t *order, uint16_t *start)
+{
+    int rbits = bits > 2 ? bits - 2 : 0;
+    int r = 1 << rbits, m = 1 << bits;
+    int size, max = 0, b, i;
+
+    memset(start, 0, sizeof(uint16_t) * (r + 1));
+    for (i = 0; i < n; i++) {
+        start[(cases[i].hash & (r - 1)) + 1]++;
+    }
+    for (b = 0; b < r; b++) {
+        max = start[b + 1] > max ? start[b + 1] : max;
+        start[b + 1] += start[b];
+    }
+    for (i = 0; i < n; i++) {
+        order[start[cases[i].hash & (r - 1)]++] = i;
+    }
+    for (b = r; b > 0; b--) {
+        start[b] = start[b - 1];
+    }
+    start[0] = 0;
+
+    memset(seed, 0, r);
+    for (i = 0; i < m; i++) {
+        slot[i] = BCODE_SWITCH_NONE;
+    }
+
+    for (size = max; size > 0; size--) {
+        for (b = 0; b < r; b++) {
+            uint16_t *key = order + start[b];
+            int sd;
+
+            if (start[b + 1] - start[b] != size) {
+                continue;
+            }
+
+            for (sd = 0; sd < 256; sd++) {
+                for (i = 0; i < size; i++) {
+                    int k = bcode_switch_slot(cases[key[i]].hash, sd, bits);
+
+                    if (slot[k] != BCODE_SWITCH_NONE) {
+                        break;
+                    }
+                    slot[k] = key[i];
+                }
+                if (i == size) {
+                    break;
+                }
+                while (i-- > 0) {
+                    slot[bcode_switch_slot(cases[key[i]].hash, sd, bits)] = BCODE_SWITCH_NONE;
+                }
+            }
+            if (sd == 256) {
+                return -1;
+            }
+            seed[b] = sd;
+        }
+    }
+
+    return rbits;
+}
+
+static void compile_code_set_u16(compile_t *cpl, int pos, int v)
+{
+    uint8_t code[2];
+
+    code[0] = v >> 8;
+    code[1] = v;
+    compile_code_write(cpl, pos, code, 2);
+}
+
+static void compile_stmt_switch(compile_t *cpl, stmt_t *s)
+{
+    compile_case_t *cases = NULL;
+    uint16_t *slot = NULL;
+    uint8_t  *seed = NULL;
+    int *arm_pos;
+    int arm_num, case_num, dflt, min, max;
+    int i, n, kind, bits = 0, rbits = 0;
+    int pos, skip, end, skip_bk, dflt_pos = 0;
+    uint32_t vars;
+    stmt_t *c;
+
+    compile_expr(cpl, ast_stmt_expr(s));
+
+    // Variables keep number in the cases, also hold after the switch
+    vars = compile_type_loop(cpl, s, cpl->num_vars);
+    cpl->num_vars = vars;
+
+    for (c = ast_stmt_block(s), arm_num = 0, case_num = 0; c; c = ast_stmt_next(c), arm_num++) {
+        case_num += ast_stmt_expr(c) != NULL;
+    }
+
+    arm_pos = compile_malloc(cpl, sizeof(int) * (arm_num + 1));
+    if (case_num) {
+        cases = compile_malloc(cpl, sizeof(compile_case_t) * case_num);
+    }
+    if (!arm_pos || (case_num && !cases)) {
+        cpl->error = ERR_NotEnoughMemory;
+        return;
+    }
+
+    // Classify the cases: 1, dense integers; 2, constants; 0, the others
+    kind = case_num > 0 ? 1 : 0;
+    min = 32767; max = -32768;
+    for (c = ast_stmt_block(s), i = 0, n = 0, dflt = -1; c; c = ast_stmt_next(c), i++) {
+        int k;
+
+        if (!ast_stmt_expr(c)) {
+            dflt = dflt < 0 ? i : dflt;
+            continue;
+        }
+        if (!kind || !compile_case_const(cpl, ast_stmt_expr(c), cases + n)) {
+            kind = 0;
+            continue;
+        }
+        cases[n].arm = i;
+
+        // the first one be matched, as compared one by one
+        for (k = 0; k < n && cases[k].id != cases[n].id; k++)
+            ;
+        if (k < n) {
+            continue;
+        }
+
+        if (compile_case_is_int(cases + n)) {
+            min = cases[n].num < min ? cases[n].num : min;
+            max = cases[n].num > max ? cases[n].num : max;
+        } else {
+            kind = 2;
+        }
+        n++;
+    }
+    if (cpl->error) {
+        return;
+    }
+
+    if (kind == 1 && max - min + 1 > n * 2 + 8) {
+        kind = 2;
+    }
+    if (kind == 2) {
+        uint16_t *order, *start;
+
+        // load of hash table under 1/2, and try bigger ones if failed
+        for (bits = 1; (1 << bits) < n * 2; bits++)
+            ;
+        slot  = compile_malloc(cpl, sizeof(uint16_t) << (bits + 2));
+        start = compile_malloc(cpl, sizeof(uint16_t) * ((1 << bits) + 1));
+        order = compile_malloc(cpl, sizeof(uint16_t) * n);
+        seed  = compile_malloc(cpl, 1 << bits);
+        if (!slot || !start || !order || !seed) {
+            cpl->error = ERR_NotEnoughMemory;
+            return;
+        }
+        for (i = 0; i < 3 && bits <= 15; i++, bits++) {
+            if (0 <= (rbits = compile_case_hash(cases, n, bits, seed, slot, order, start))) {
+                break;
+            }
+        }
+        if (i == 3 || bits > 15) {
+            kind = 0;
+        }
+    }
+
+    // Dispatch
+    pos = compile_code_pos(cpl);
+    if (kind == 1) {
+        compile_code_extend(cpl, 7 + (max - min + 1) * 2);
+    } else
+    if (kind == 2) {
+        compile_code_extend(cpl, 5 + (1 << rbits) + (4 << bits));
+    } else {
+        for (c = ast_stmt_block(s), i = 0; c; c = ast_stmt_next(c), i++) {
+            if (ast_stmt_expr(c)) {
+                compile_expr(cpl, ast_stmt_expr(c));
+                arm_pos[i] = compile_code_pos(cpl);
+                compile_code_extend(cpl, 3);
+            }
+        }
+        compile_code_append(cpl, BC_POP);
+        dflt_pos = compile_code_pos(cpl);
+        compile_code_extend(cpl, 3);
+    }
+
+    skip = compile_code_pos(cpl);
+    compile_code_extend(cpl, 3);
+
+    skip_bk = cpl->skip_pos;
+    cpl->skip_pos = skip;
+    for (c = ast_stmt_block(s), i = 0; c && !cpl->error; c = ast_stmt_next(c), i++) {
+        if (kind == 0 && ast_stmt_expr(c)) {
+            // position of CASE instruction, be replaced by the case
+            int at = arm_pos[i];
+
+            arm_pos[i] = compile_code_pos(cpl);
+            compile_code_set_jmp(cpl, at, BC_CASE, arm_pos[i] - (at + 3));
+        } else {
+            arm_pos[i] = compile_code_pos(cpl);
+        }
+        cpl->num_vars = vars;
+        compile_stmt_block(cpl, ast_stmt_block(c));
+    }
+    cpl->skip_pos = skip_bk;
+    cpl->num_vars = vars;
+    if (cpl->error) {
+        return;
+    }
+
+    end = compile_code_pos(cpl);
+    arm_pos[arm_num] = end;
+    dflt = dflt < 0 ? end : arm_pos[dflt];
+
+    compile_code_set_jmp(cpl, skip, BC_JMP, end - (skip + 3));
+    if (kind == 0) {
+        compile_code_set_jmp(cpl, dflt_pos, BC_JMP, dflt - (dflt_pos + 3));
+    } else
+    if (kind == 1) {
+        int num = max - min + 1;
+        int tab = pos + 7;
+        uint8_t code = BC_SWITCH_NUM;
+
+        compile_code_write(cpl, pos, &code, 1);
+        compile_code_set_u16(cpl, pos + 1, min);
+        compile_code_set_u16(cpl, pos + 3, num);
+        compile_code_set_u16(cpl, pos + 5, dflt - skip);
+        for (i = 0; i < num; i++) {
+            compile_code_set_u16(cpl, tab + i * 2, dflt - skip);
+        }
+        for (i = n - 1; i >= 0; i--) {
+            compile_code_set_u16(cpl, tab + ((int)cases[i].num - min) * 2, arm_pos[cases[i].arm] - skip);
+        }
+    } else {
+        int tab = pos + 5 + (1 << rbits);
+        uint8_t code[5];
+
+        code[0] = BC_SWITCH_HASH;
+        code[1] = bits;
+        code[2] = rbits;
+        code[3] = (dflt - skip) >> 8;
+        code[4] = (dflt - skip);
+        compile_code_write(cpl, pos, code, 5);
+        compile_code_write(cpl, pos + 5, seed, 1 << rbits);
+        for (i = 0; i < (1 << bits); i++) {
+            int k = slot[i];
+
+            if (k == BCODE_SWITCH_NONE) {
+                compile_code_set_u16(cpl, tab + i * 4, BCODE_SWITCH_NONE);
+                compile_code_set_u16(cpl, tab + i * 4 + 2, dflt - skip);
+            } else {
+                compile_code_set_u16(cpl, tab + i * 4, cases[k].id);
+                compile_code_set_u16(cpl, tab + i * 4 + 2, arm_pos[cases[k].arm] - skip);
+            }
+        }
+    }
+}
+
 static void compile_stmt_continue(compile_t *cpl, stmt_t *s)
 {
     int bgn, end, total;
@@ -1300,6 +3491,29 @@ int compile_init(compile_t *cpl, env_t *env, void *heap_ptr, int heap_size)
     cpl->func_cur = 0;
     cpl->func_num = 0;
     cpl->func_buf = NULL;
+    cpl->native_ref = 0;
+    cpl->lines = 0;
+    cpl->lazy = NULL;
+    cpl->line_seg = NULL;
+    cpl->consts = NULL;
+
+    cpl->num_vars = 0;
+    cpl->num_clean = 0;
+    cpl->num_check = 0;
+    cpl->num_body = NULL;
+    cpl->expr_num = 0;
+    cpl->scalars = NULL;
+    cpl->hoists = NULL;
+    cpl->pures = NULL;
+    cpl->var_spare = 0;
+    cpl->cse_num = -1;
+    cpl->cse_valid = 0;
+
+    cpl->prog = NULL;
+    cpl->inline_args = NULL;
+    cpl->inline_vars = NULL;
+    cpl->inline_depth = 0;
+    memset(cpl->inline_func, 0, sizeof(cpl->inline_func));
 
     if (env->exe.func_num > 0) {
         cpl->func_offset = env->exe.func_num - 1;
@@ -1318,6 +3532,8 @@ int compile_init(compile_t *cpl, env_t *env, void *heap_ptr, int heap_size)
     // Interactive mode, restore main var history
     if (env->main_var_map && env->main_var_num) {
         int i;
+
+        compile_varmap_check_extend(cpl, env->main_var_num);
         for (i = 0; i < env->main_var_num; i++) {
             compile_var_add(cpl, env->main_var_map[i]);
         }
@@ -1336,7 +3552,6 @@ int compile_deinit(compile_t *cpl)
                 compile_func_t *f = cpl->func_buf + i;
 
                 if (f->var_map) free(f->var_map);
-                if (f->code_buf) free(f->code_buf);
             }
 
             free(cpl->func_buf);
@@ -1356,24 +3571,47 @@ int compile_stmt(compile_t *cpl, stmt_t *stmt)
         return -cpl->error;
     }
 
+    if (!compile_cse_simple(stmt)) {
+        compile_cse_reset(cpl);
+    } else
+    if (cpl->cse_num < 0) {
+        compile_cse_scan(cpl, stmt);
+    }
+
     switch(stmt->type) {
     case STMT_PASS: break;
     case STMT_EXPR:     compile_stmt_expr(cpl, stmt); break;
     case STMT_VAR:      compile_stmt_var(cpl, stmt); break;
+    case STMT_CONST:    compile_stmt_const(cpl, stmt); break;
     case STMT_IF:       compile_stmt_cond(cpl, stmt); break;
     case STMT_WHILE:    compile_stmt_while(cpl, stmt); break;
+    case STMT_SWITCH:   compile_stmt_switch(cpl, stmt); break;
+    case STMT_FOR_IN:
+    case STMT_FOR_OF:   compile_stmt_for(cpl, stmt); break;
     case STMT_BREAK:    compile_stmt_break(cpl, stmt); break;
     case STMT_CONTINUE: compile_stmt_continue(cpl, stmt); break;
     case STMT_RET:      compile_stmt_return(cpl, stmt); break;
     default: cpl->error = ERR_NotImplemented;
     }
 
+    if (!compile_cse_simple(stmt)) {
+        compile_cse_reset(cpl);
+    }
+
     return -cpl->error;
 }
 
-int compile_one_stmt(compile_t *cpl, stmt_t *stmt)
-{
-    int ret = compile_stmt(cpl, stmt);
+int compile_one_stmt(compile_t *cpl, stmt_t *stmt)
+{
+    int ret;
+
+    // memory not enough in compile_init
+    if (cpl->error) {
+        return -1;
+    }
+
+    cpl->var_spare = compile_var_spare(cpl, stmt);
+    ret = compile_stmt(cpl, stmt);
 
     if (ret == 0) {
         compile_code_append(cpl, BC_STOP);
@@ -1385,13 +3623,21 @@ int compile_one_stmt(compile_t *cpl, stmt_t *stmt)
 
 int compile_multi_stmt(compile_t *cpl, stmt_t *s)
 {
+    // memory not enough in compile_init
+    if (cpl->error) {
+        return -1;
+    }
+
+    cpl->var_spare = compile_var_spare(cpl, s);
     while (s) {
         int t = s->type;
+        int func = cpl->func_num;
 
         if (compile_stmt(cpl, s)) {
             break;
         }
-        s= s->next;
+        compile_inline_record(cpl, s, func);
+        s= ast_stmt_next(s);
 
         if (s && t == STMT_EXPR) {
             compile_code_append(cpl, BC_POP);
@@ -1401,151 +3647,431 @@ int compile_multi_stmt(compile_t *cpl, stmt_t *s)
     return compile_save_main_vmap(cpl);
 }
 
-static void compile_func_stack_pop(compile_t *cpl, compile_func_t *fn)
+/*
+ * Stack effect of instruction
+ * return: change of stack depth, need: values required in stack
+ */
+static int compile_code_stack_effect(int code, int p1, int *need)
 {
-    if (fn->stack_space > 0) {
-        //means bug, should be assert here.
-        cpl->error = ERR_SysError;
-    } else {
-        fn->stack_space--;
+    switch (code) {
+    case BC_STOP:
+    case BC_PASS:
+    case BC_RET0:
+    case BC_SJMP:
+    case BC_JMP:        *need = 0; return 0;
+
+    case BC_RET:        *need = 1; return 0;
+
+    case BC_SJMP_T:
+    case BC_SJMP_F:
+    case BC_JMP_T:
+    case BC_JMP_F:      *need = 1; return 0;
+
+    case BC_POP_SJMP_T:
+    case BC_POP_SJMP_F:
+    case BC_POP_JMP_T:
+    case BC_POP_JMP_F:
+    case BC_POP:        *need = 1; return -1;
+
+    case BC_PUSH_UND:
+    case BC_PUSH_NAN:
+    case BC_PUSH_TRUE:
+    case BC_PUSH_FALSE:
+    case BC_PUSH_ZERO:
+    case BC_PUSH_NUM:
+    case BC_PUSH_STR:
+    case BC_PUSH_VAR:
+    case BC_PUSH_REF:
+    case BC_PUSH_SCRIPT:
+    case BC_PUSH_NATIVE:*need = 0; return 1;
+
+    case BC_NEG:
+    case BC_NOT:
+    case BC_LOGIC_NOT:
+    case BC_INC:
+    case BC_INCP:
+    case BC_DEC:
+    case BC_DECP:       *need = 1; return 0;
+
+    case BC_MUL:
+    case BC_DIV:
+    case BC_MOD:
+    case BC_ADD:
+    case BC_SUB:
+    case BC_LSHIFT:
+    case BC_RSHIFT:
+    case BC_AAND:
+    case BC_AOR:
+    case BC_AXOR:
+    case BC_TEQ:
+    case BC_TNE:
+    case BC_TGT:
+    case BC_TGE:
+    case BC_TLT:
+    case BC_TLE:
+    case BC_TIN:
+    case BC_PROP:
+    case BC_ELEM:
+    case BC_ADD_NUM:
+    case BC_SUB_NUM:
+    case BC_MUL_NUM:
+    case BC_TGT_NUM:
+    case BC_TGE_NUM:
+    case BC_TLT_NUM:
+    case BC_TLE_NUM:    *need = 2; return -1;
+
+    case BC_PROP_METH:
+    case BC_ELEM_METH:  *need = 2; return 0;
+
+    case BC_ASSIGN:
+    case BC_ADD_ASSIGN:
+    case BC_SUB_ASSIGN:
+    case BC_MUL_ASSIGN:
+    case BC_DIV_ASSIGN:
+    case BC_MOD_ASSIGN:
+    case BC_AND_ASSIGN:
+    case BC_OR_ASSIGN:
+    case BC_XOR_ASSIGN:
+    case BC_NOT_ASSIGN:
+    case BC_LSHIFT_ASSIGN:
+    case BC_RSHIFT_ASSIGN:
+    case BC_PROP_INC:
+    case BC_PROP_INCP:
+    case BC_PROP_DEC:
+    case BC_PROP_DECP:
+    case BC_ELEM_INC:
+    case BC_ELEM_INCP:
+    case BC_ELEM_DEC:
+    case BC_ELEM_DECP:  *need = 2; return -1;
+
+    case BC_PROP_ASSIGN:
+    case BC_PROP_ADD_ASSIGN:
+    case BC_PROP_SUB_ASSIGN:
+    case BC_PROP_MUL_ASSIGN:
+    case BC_PROP_DIV_ASSIGN:
+    case BC_PROP_MOD_ASSIGN:
+    case BC_PROP_AND_ASSIGN:
+    case BC_PROP_OR_ASSIGN:
+    case BC_PROP_XOR_ASSIGN:
+    case BC_PROP_NOT_ASSIGN:
+    case BC_PROP_LSHIFT_ASSIGN:
+    case BC_PROP_RSHIFT_ASSIGN:
+    case BC_ELEM_ASSIGN:
+    case BC_ELEM_ADD_ASSIGN:
+    case BC_ELEM_SUB_ASSIGN:
+    case BC_ELEM_MUL_ASSIGN:
+    case BC_ELEM_DIV_ASSIGN:
+    case BC_ELEM_MOD_ASSIGN:
+    case BC_ELEM_AND_ASSIGN:
+    case BC_ELEM_OR_ASSIGN:
+    case BC_ELEM_XOR_ASSIGN:
+    case BC_ELEM_NOT_ASSIGN:
+    case BC_ELEM_LSHIFT_ASSIGN:
+    case BC_ELEM_RSHIFT_ASSIGN: *need = 3; return -2;
+
+    // function & arguments be replaced by the result
+    case BC_FUNC_CALL:  *need = p1 + 1; return -p1;
+
+    // elements be replaced by the array or object
+    case BC_ARRAY:
+    case BC_DICT:       *need = p1; return 1 - p1;
+
+    case BC_POP_VAR:    *need = 1; return -1;
+
+    // the value of case be popped, value of switch also be popped at jump
+    case BC_CASE:       *need = 2; return -1;
+
+    case BC_SWITCH_NUM:
+    case BC_SWITCH_HASH:*need = 1; return -1;
+
+    // cursor of iterator be pushed, next value also pushed if not jump
+    case BC_ITER:       *need = 1; return 1;
+    case BC_ITER_KEY:
+    case BC_ITER_VAL:   *need = 2; return 1;
+
+    // variable be updated, the result be pushed
+    case BC_INC_NUM:
+    case BC_INCP_NUM:
+    case BC_DEC_NUM:
+    case BC_DECP_NUM:   *need = 0; return 1;
+
+    default:            *need = -1; return 0;
+    }
+}
+
+static inline int compile_code_is_jmp(int code) {
+    return code >= BC_JMP && code <= BC_POP_SJMP_F;
+}
+
+static inline int compile_code_is_end(int code) {
+    return code == BC_STOP || code == BC_RET || code == BC_RET0 || code == BC_JMP || code == BC_SJMP ||
+           code == BC_SWITCH_NUM || code == BC_SWITCH_HASH;
+}
+
+// number of jump targets of instruction
+static inline int compile_code_jmp_num(const uint8_t *code) {
+    if (compile_code_is_jmp(code[0]) || code[0] == BC_CASE ||
+        code[0] == BC_ITER_KEY || code[0] == BC_ITER_VAL) {
+        return 1;
+    }
+    if (code[0] == BC_SWITCH_NUM || code[0] == BC_SWITCH_HASH) {
+        return 1 + bcode_switch_size(code);
     }
+    return 0;
+}
 
+// stack depth at jump target less than the one after instruction
+static inline int compile_code_jmp_drop(int code) {
+    return code == BC_CASE || code == BC_ITER_KEY || code == BC_ITER_VAL;
 }
 
-static void compile_func_stack_push(compile_t *cpl, compile_func_t *fn)
+// step of jump target i, p1: the first parameter of instruction
+static inline int compile_code_jmp_step(const uint8_t *code, int p1, int i) {
+    return i == 0 ? p1 : bcode_switch_offset(code, i - 1);
+}
+
+typedef struct compile_jmp_target_t {
+    uint16_t pos;
+    int16_t  depth;     // stack depth at target, -1: unknown
+} compile_jmp_target_t;
+
+static int compile_jmp_target_cmp(const void *a, const void *b)
 {
-    (void) cpl;
-    fn->stack_space++;
-    if (fn->stack_space > fn->stack_high) {
-        fn->stack_high = fn->stack_space;
+    return ((const compile_jmp_target_t *)a)->pos - ((const compile_jmp_target_t *)b)->pos;
+}
+
+static int compile_jmp_target_find(compile_jmp_target_t *tgt, int num, int pos)
+{
+    int lo = 0, hi = num;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (tgt[mid].pos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// merge stack depth of the path with jump target
+static int compile_jmp_target_merge(compile_t *cpl, compile_jmp_target_t *t, int depth)
+{
+    if (t->depth < 0) {
+        t->depth = depth;
+        return 1;
+    }
+    if (t->depth != depth) {
+        cpl->error = ERR_InvalidByteCode;
+    }
+    return 0;
+}
+
+/*
+ * Free memory below the flattened code, used by analysis of code
+ */
+static void *compile_code_scratch(compile_t *cpl, compile_func_t *fn, int size)
+{
+    uint8_t *low = ADDR_ALIGN_4(cpl->heap.base + cpl->heap.free);
+    uint8_t *end = cpl->heap.base + cpl->heap.size;
+
+    if (fn->code_buf >= low && fn->code_buf < end) {
+        end = fn->code_buf;
     }
+
+    return low + size <= end ? low : NULL;
 }
 
+/*
+ * Abstract interpretation of the stack: depth of live values in stack
+ * is computed for each instruction, it should be same for all the paths
+ * reaching an instruction. The max one is the stack space required by
+ * the function, which is checked once as the function be entered.
+ */
 static int compile_code_revise(compile_t *cpl, compile_func_t *fn)
 {
-    int off = 0;
-    int end = fn->code_num;
+    compile_jmp_target_t *tgt;
     uint8_t *code = fn->code_buf;
+    int end = fn->code_num;
+    int tgt_num, tgt_max;
+    int off, high, pass;
+    const char *name;
+    int p1, p2;
 
-    while (off < end) {
-        const char *name;
-        int p1, p2;
-        int cp = off;
+    fn->stack_high = 0;
+    if (cpl->error || !code) {
+        return -1;
+    }
+
+    // collect the jump targets, sorted by position
+    for (off = 0, tgt_max = 0; off < end; ) {
+        tgt_max += compile_code_jmp_num(code + off);
+        bcode_parse(code, &off, &name, &p1, &p2);
+    }
+
+    tgt = compile_code_scratch(cpl, fn, tgt_max * sizeof(compile_jmp_target_t));
+    if (!tgt) {
+        cpl->error = ERR_NotEnoughMemory;
+        return -1;
+    }
+
+    for (off = 0, tgt_num = 0; off < end; ) {
+        int cp = off, jmp = compile_code_jmp_num(code + off);
+        int pos, j;
 
         bcode_parse(code, &off, &name, &p1, &p2);
+        for (j = 0; j < jmp; j++) {
+            pos = off + compile_code_jmp_step(code + cp, p1, j);
+            if (pos < 0 || pos > end) {
+                cpl->error = ERR_InvalidByteCode;
+                return -1;
+            }
+            tgt[tgt_num].pos = pos;
+            tgt[tgt_num].depth = -1;
+            tgt_num++;
+        }
+    }
+
+    if (tgt_num > 1) {
+        int i, n;
+
+        qsort(tgt, tgt_num, sizeof(compile_jmp_target_t), compile_jmp_target_cmp);
+        for (i = 1, n = 1; i < tgt_num; i++) {
+            if (tgt[i].pos != tgt[n - 1].pos) {
+                tgt[n++] = tgt[i];
+            }
+        }
+        tgt_num = n;
+    }
+
+    // A backward jump may reach the instruction be skipped as unreachable,
+    // so walk again, until no more target be reached.
+    high = 0;
+    for (pass = 0; pass <= tgt_num; pass++) {
+        int depth = 0, k = 0, again = 0;
+
+        for (off = 0; off < end && !cpl->error; ) {
+            int cp = off, need, delta, n, j;
+
+            bcode_parse(code, &off, &name, &p1, &p2);
+
+            while (k < tgt_num && tgt[k].pos < cp) {
+                k++;
+            }
+            if (k < tgt_num && tgt[k].pos == cp) {
+                if (depth < 0) {
+                    depth = tgt[k].depth;
+                } else {
+                    compile_jmp_target_merge(cpl, tgt + k, depth);
+                }
+            }
+            if (depth < 0) {
+                continue;   // unreachable
+            }
+
+            delta = compile_code_stack_effect(code[cp], p1, &need);
+            if (need < 0 || depth < need) {
+                cpl->error = ERR_InvalidByteCode;
+                break;
+            }
+
+            depth += delta;
+            if (depth > high) {
+                high = depth;
+            }
+
+            for (n = compile_code_jmp_num(code + cp), j = 0; j < n; j++) {
+                int pos = off + compile_code_jmp_step(code + cp, p1, j);
+                int i = compile_jmp_target_find(tgt, tgt_num, pos);
+
+                if (compile_jmp_target_merge(cpl, tgt + i, depth - compile_code_jmp_drop(code[cp])) && pos <= cp) {
+                    again = 1;
+                }
+            }
+
+            if (compile_code_is_end(code[cp])) {
+                depth = -1;
+            }
+        }
+
+        if (!again) {
+            break;
+        }
+    }
+
+    if (cpl->error) {
+        return -1;
+    }
+
+    fn->stack_high = high;
+    return 0;
+}
+
+// Lazy function is added with the constants of main visible to it
+static int compile_lazy_add(compile_t *cpl, compile_func_t *cfp)
+{
+    executable_lazy_const_t *consts = NULL;
+    compile_const_t *c;
+    int n = 0;
 
-        switch (code[cp]) {
-        case BC_STOP: break;
-        case BC_PASS: break;
-
-        /* Return instruction */
-        case BC_RET0: break;
-        case BC_RET:  break;
-
-        /* Jump instruction */
-        case BC_SJMP: break;
-        case BC_JMP:  break;
-
-        case BC_SJMP_T: break;
-        case BC_SJMP_F: break;
-
-        case BC_JMP_T: break;
-        case BC_JMP_F: break;
-
-        case BC_POP_SJMP_T: compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_POP_SJMP_F: compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_POP_JMP_T:  compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_POP_JMP_F:  compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_POP:        compile_func_stack_pop(cpl, fn);
-                            break;
-
-        case BC_PUSH_UND:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_NAN:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_TRUE:  compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_FALSE: compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_ZERO:  compile_func_stack_push(cpl, fn);
-                            break;
-
-        case BC_PUSH_NUM:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_STR:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_VAR:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_REF:   compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_SCRIPT:compile_func_stack_push(cpl, fn);
-                            break;
-        case BC_PUSH_NATIVE:compile_func_stack_push(cpl, fn);
-                            break;
-
-        case BC_NEG:        break;
-        case BC_NOT:
-        case BC_LOGIC_NOT:  break;
-
-        case BC_MUL:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_DIV:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_MOD:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_ADD:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_SUB:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_AAND:       compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_AOR:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_AXOR:       compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_LSHIFT:     compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_RSHIFT:     compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TEQ:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TNE:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TGT:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TGE:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TLT:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TLE:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_TIN:        compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_ASSIGN:     compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_FUNC_CALL:  compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_PROP:       compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_PROP_METH:  compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_ELEM:       compile_func_stack_pop(cpl, fn);
-                            break;
-        case BC_ELEM_METH:  compile_func_stack_pop(cpl, fn);
-                            break;
-        default:            cpl->error = ERR_InvalidByteCode;
-                            break;
+    for (c = cfp->consts; c; c = c->next) {
+        n += c->func == 0;
+    }
+    if (n && !(consts = compile_malloc(cpl, sizeof(executable_lazy_const_t) * n))) {
+        return ERR_NotEnoughMemory;
+    }
+
+    n = 0;
+    for (c = cfp->consts; c; c = c->next) {
+        if (c->func == 0) {
+            consts[n].id = c->id;
+            consts[n].type = c->value ? c->value->type : 0;
+            consts[n].num = c->value && c->value->type == EXPR_NUM ? ast_expr_num(c->value) : 0;
+            consts[n].str = c->value && c->value->type == EXPR_STRING ? ast_expr_text(c->value) : NULL;
+            n++;
         }
     }
 
+    return executable_lazy_add(&cpl->env->exe, cfp->src, cfp->src_size, cfp->owner_var_num, consts, n);
+}
+
+// Constants of main kept with the lazy function, in the order of definition
+static int compile_lazy_consts(compile_t *cpl, uint8_t *entry, int num)
+{
+    executable_lazy_const_t lc;
+    compile_const_t *c;
+    expr_t *value;
+
+    while (num-- > 0) {
+        executable_lazy_const_get(entry, num, &lc);
+        if (!(c = compile_malloc(cpl, sizeof(compile_const_t)))) {
+            return -1;
+        }
+        value = NULL;
+        if (lc.type && !(value = compile_malloc(cpl, sizeof(expr_t)))) {
+            return -1;
+        }
+        if (value) {
+            memset(value, 0, sizeof(expr_t));
+            value->type = lc.type;
+            if (lc.type == EXPR_NUM) {
+                value->body.data.num = lc.num;
+            } else if (lc.type == EXPR_STRING) {
+                value->body.data.str = (char *)lc.str;
+            }
+        }
+        c->func = 0;
+        c->id = lc.id;
+        c->value = value;
+        c->next = cpl->consts;
+        cpl->consts = c;
+    }
     return 0;
 }
 
-static int compile_code_relocate(compile_t *cpl)
+static int compile_code_relocate(compile_t *cpl, int from)
 {
     executable_t   *exe;
     compile_func_t *cfp;
@@ -1556,40 +4082,42 @@ static int compile_code_relocate(compile_t *cpl)
     }
 
     exe = &cpl->env->exe;
-    for (i = 0; i < cpl->func_num; i++) {
-        cfp = cpl->func_buf + i;
-        compile_code_revise(cpl, cfp);
-    }
-
-    /*
-     * Main entry function relocation
-     */
-    cfp = cpl->func_buf;
-    if (env_is_interactive(cpl->env)) {
+    if (from == 0 && env_is_interactive(cpl->env)) {
         // history of main code should be clear to save space, while as interactive mode
         executable_main_clr(exe);
     }
-    err = executable_main_add(exe, cfp->code_buf, cfp->code_num,
-                                   cfp->var_num, cfp->arg_num,
-                                   cfp->stack_high, cfp->closure);
-    if (err) {
-        cpl->error = err;
-        return -1;
-    }
 
     /*
-     * Function relocation
+     * Main entry function is func_buf[0], the others are relocated as functions.
+     * Each one be flattened and revised just before it be copied to executable
      */
-    for (i = 1; err == 0 && i < cpl->func_num; i++) {
+    for (i = from, err = 0; err == 0 && i < cpl->func_num; i++) {
         cfp = cpl->func_buf + i;
-        err = executable_func_add(exe, cfp->code_buf, cfp->code_num,
-                                       cfp->var_num, cfp->arg_num,
-                                       cfp->stack_high, cfp->closure);
+        if (cfp->src) {
+            err = compile_lazy_add(cpl, cfp);
+            continue;
+        }
+        if (!compile_code_flatten(cpl, cfp) && cfp->code_num) {
+            return -1;
+        }
+        if (cfp->code_num && compile_code_revise(cpl, cfp)) {
+            return -1;
+        }
+
+        if (i == 0) {
+            err = executable_main_add(exe, cfp->code_buf, cfp->code_num,
+                                           cfp->var_num, cfp->arg_num,
+                                           cfp->stack_high, cfp->closure);
+        } else {
+            err = executable_func_add(exe, cfp->code_buf, cfp->code_num,
+                                           cfp->var_num, cfp->arg_num,
+                                           cfp->stack_high, cfp->closure);
+        }
     }
 
     cpl->error = err;
 
-    return err;
+    return err ? -1 : 0;
 }
 
 int compile_update(compile_t *cpl)
@@ -1598,7 +4126,7 @@ int compile_update(compile_t *cpl)
         return -1;
     }
 
-    if (0 != compile_code_relocate(cpl)) {
+    if (0 != compile_code_relocate(cpl, 0)) {
         return -1;
     }
 
@@ -1609,7 +4137,7 @@ int compile_update(compile_t *cpl)
 #warning debug function
 void compile_code_dump(compile_t *cpl)
 {
-    uint8_t *code = compile_code_buf(cpl);
+    uint8_t *code = compile_code_flatten(cpl, compile_func_cur(cpl));
     int size = compile_code_pos(cpl);
     int pc = 0;
 
@@ -1657,6 +4185,56 @@ static void parse_callback(void *ud, parse_event_t *e)
     (void) e;
 }
 
+static int compile_map_line(compile_t *cpl, image_info_t *image)
+{
+    compile_line_seg_t *seg;
+    image_line_t *lines;
+    uint32_t *end;
+    int i, n;
+
+    if (image_line_init(image)) {
+        return -1;
+    }
+
+    /*
+     * Records be grouped by function in the free space, code is mapped already:
+     *   end[i]:    end of lines of function i
+     *   lines[n]:  records of all functions
+     */
+    for (i = 0, n = 0; i < cpl->func_num; i++) {
+        n += cpl->func_buf[i].line_num;
+    }
+    end = compile_code_scratch(cpl, cpl->func_buf, cpl->func_num * sizeof(uint32_t) + n * sizeof(image_line_t));
+    if (!end) {
+        return -1;
+    }
+    lines = (image_line_t *)(end + cpl->func_num);
+
+    for (i = 0, n = 0; i < cpl->func_num; i++) {
+        n += cpl->func_buf[i].line_num;
+        end[i] = n;
+    }
+    for (seg = cpl->line_seg; seg; seg = seg->prev) {
+        for (i = seg->used - 1; i >= 0; i--) {
+            compile_line_t *rec = seg->line + i;
+            image_line_t *line = lines + (--end[rec->func]);
+
+            line->pc = rec->pc;
+            line->line = rec->line;
+        }
+    }
+
+    for (i = 0; i < cpl->func_num; i++) {
+        int num = cpl->func_buf[i].line_num;
+
+        if (num && image_fill_line(image, i, lines + end[i], num)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int compile_map_image(compile_t *cpl, void *mem_ptr, int mem_size)
 {
     image_info_t image;
@@ -1674,6 +4252,12 @@ static int compile_map_image(compile_t *cpl, void *mem_ptr, int mem_size)
     }
 
     for (i = 0; i < cpl->func_num; i++) {
+        if (!compile_code_flatten(cpl, cpl->func_buf + i) && cpl->func_buf[i].code_num) {
+            return -1;
+        }
+        if (cpl->func_buf[i].code_num && compile_code_revise(cpl, cpl->func_buf + i)) {
+            return -1;
+        }
         if (image_fill_code(&image, i, cpl->func_buf[i].var_num, cpl->func_buf[i].arg_num,
                 cpl->func_buf[i].stack_high, cpl->func_buf[i].closure,
                 cpl->func_buf[i].code_buf, cpl->func_buf[i].code_num)) {
@@ -1681,14 +4265,67 @@ static int compile_map_image(compile_t *cpl, void *mem_ptr, int mem_size)
         }
     }
 
+    if (cpl->lines && compile_map_line(cpl, &image)) {
+        return -1;
+    }
+
     return image_size(&image);
 }
 
-int compile_exe(env_t *env, const char *input, void *mem_ptr, int mem_size)
+static int compile_exe_parse(env_t *env, parser_t *psr, void *mem_ptr, int mem_size)
 {
-    parser_t psr;
     compile_t cpl;
     stmt_t  *stmt;
+    int size;
+
+    parse_set_cb(psr, parse_callback, NULL);
+    stmt = parse_stmt_multi(psr);
+    if (!stmt) {
+        return psr->error ? -psr->error : 0;
+    }
+
+    compile_init(&cpl, env, heap_free_addr(&psr->heap), heap_free_size(&psr->heap));
+    cpl.prog = LIMIT_INLINE_SIZE > 0 ? stmt : NULL;
+    cpl.lines = DEF_IMAGE_LINE_MAP;
+
+    if (0 != compile_multi_stmt(&cpl, stmt)) {
+        return -cpl.error;
+    }
+
+    size = compile_map_image(&cpl, mem_ptr, mem_size);
+
+    return cpl.error ? -cpl.error : size;
+}
+
+// Upper bound of image size, see image_init and image_fill_*
+static int compile_image_bound(compile_t *cpl)
+{
+    executable_t *exe = &cpl->env->exe;
+    int i, size;
+
+    size = 64 + 8 * exe->number_num + 4 * exe->string_num + 4 * cpl->func_num + 64;
+    for (i = 0; i < exe->string_num; i++) {
+        size += strlen((char *)exe->string_map[i]) + 1;
+    }
+
+    if (cpl->lines) {
+        size += 4 * cpl->func_num + 8;
+    }
+    for (i = 0; i < cpl->func_num; i++) {
+        compile_func_t *fn = cpl->func_buf + i;
+
+        size += SIZE_ALIGN_8(FUNC_HEAD_SIZE + fn->code_num);
+        if (cpl->lines) {
+            size += 10 * fn->line_num + 16;
+        }
+    }
+
+    return size;
+}
+
+int compile_exe(env_t *env, const char *input, void *mem_ptr, int mem_size)
+{
+    parser_t psr;
 
     if (!env || !input) {
         return -1;
@@ -1696,17 +4333,147 @@ int compile_exe(env_t *env, const char *input, void *mem_ptr, int mem_size)
 
     // The free heap can be used for parse and compile process
     parse_init(&psr, input, NULL, mem_ptr, mem_size);
+    return compile_exe_parse(env, &psr, mem_ptr, mem_size);
+}
+
+// Source is read chunk by chunk, as it arrives, see lex_input_t
+int compile_exe_input(env_t *env, lex_input_t input, void *ud, void *mem_ptr, int mem_size)
+{
+    parser_t psr;
+
+    if (!env || !input) {
+        return -1;
+    }
+
+    parse_init_input(&psr, input, ud, mem_ptr, mem_size);
+    return compile_exe_parse(env, &psr, mem_ptr, mem_size);
+}
+
+/*
+ * Single pass: statements are parsed and compiled one by one, and the AST
+ * is released as soon as the statement compiled, so the parse space at
+ * the end of memory only need to hold the biggest top level statement.
+ * Function bodies are compiled in place, within their statement.
+ */
+int compile_exe_stream(env_t *env, lex_input_t input, void *ud, void *mem_ptr, int mem_size)
+{
+    parser_t psr;
+    compile_t cpl;
+    stmt_t *stmt;
+    uint8_t *end, *image;
+    int parse_size, size, n = 0, t = -1;
+
+    if (!env || !input || !mem_ptr) {
+        return -1;
+    }
+
+    end = (uint8_t *)mem_ptr + mem_size;
+    parse_size = (mem_size >> DEF_STREAM_SHIFT) & ~0x0F;
+
+    parse_init_input(&psr, input, ud, end - parse_size, parse_size);
     parse_set_cb(&psr, parse_callback, NULL);
-    stmt = parse_stmt_multi(&psr);
-    if (!stmt) {
-        return psr.error ? -psr.error : 0;
+    if (0 != compile_init(&cpl, env, mem_ptr, mem_size - parse_size)) {
+        return -ERR_NotEnoughMemory;
     }
+    cpl.lines = DEF_IMAGE_LINE_MAP;
 
-    compile_init(&cpl, env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
+    while (!psr.error && !parse_match(&psr, 0)) {
+        while (parse_match(&psr, ';'));
 
-    if (0 != compile_multi_stmt(&cpl, stmt)) {
+        if (!(stmt = parse_stmt(&psr))) {
+            break;
+        }
+
+        if (t == STMT_EXPR) {
+            compile_code_append(&cpl, BC_POP);
+        }
+        t = stmt->type;
+
+        if (compile_stmt(&cpl, stmt)) {
+            return -cpl.error;
+        }
+        n++;
+
+        // chains of cse refer to the AST
+        compile_cse_reset(&cpl);
+        parse_release(&psr);
+    }
+
+    if (psr.error || n == 0) {
+        return -psr.error;
+    }
+
+    compile_code_append(&cpl, BC_STOP);
+    if (0 != compile_save_main_vmap(&cpl)) {
         return -cpl.error;
     }
 
-    return compile_map_image(&cpl, mem_ptr, mem_size);
+    // Image is mapped at the end of memory, below the heap be used by flatten
+    size = compile_image_bound(&cpl);
+    image = (uint8_t *)((intptr_t)(end - size) & ~0x0FL);
+    if (size > mem_size || image < (uint8_t *)heap_free_addr(&cpl.heap)) {
+        return -ERR_NotEnoughMemory;
+    }
+    cpl.heap.size = image - (uint8_t *)mem_ptr;
+
+    size = compile_map_image(&cpl, image, end - image);
+    if (cpl.error || size < 0) {
+        return cpl.error ? -cpl.error : size;
+    }
+
+    memmove(mem_ptr, image, size);
+    return size;
+}
+
+/*
+ * Compile the lazy function on its first call, the function is parsed from
+ * its source again, and compiled as a function of main, only the variables
+ * of main visible at its definition could be referred. The result and the
+ * nested functions are appended to executable.
+ */
+uint8_t *compile_lazy(env_t *env, uint8_t *entry)
+{
+    heap_t *heap = env_heap_get_free(env);
+    executable_lazy_t lazy;
+    lex_iovec_t region;
+    parser_t psr;
+    compile_t cpl;
+    expr_t *e;
+    int curr, id;
+
+    executable_lazy_get(entry, &lazy);
+    if (lazy.entry) {
+        return lazy.entry;
+    }
+
+    region.base = lazy.src;
+    region.size = lazy.size;
+    parse_init_input(&psr, lex_input_region, &region, heap->base, heap->size);
+    parse_set_cb(&psr, parse_callback, NULL);
+    if (!(e = parse_expr(&psr)) || e->type != EXPR_FUNCDEF) {
+        env_set_error(env, psr.error ? psr.error : ERR_InvalidSyntax);
+        return NULL;
+    }
+
+    compile_init(&cpl, env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
+    if (0 > compile_lazy_consts(&cpl, entry, lazy.consts)) {
+        env_set_error(env, ERR_NotEnoughMemory);
+        return NULL;
+    }
+    if (0 <= (curr = compile_func_append(&cpl, 0))) {
+        expr_t *head = ast_expr_lft(e);
+
+        cpl.func_buf[curr].owner_var_num = lazy.vars;
+        compile_func_body(&cpl, curr, head ? ast_expr_rht(head) : NULL,
+                          ast_expr_stmt(ast_expr_rht(e)));
+    }
+
+    id = env->exe.func_num;
+    if (0 != compile_code_relocate(&cpl, curr)) {
+        env_set_error(env, cpl.error ? cpl.error : ERR_NotEnoughMemory);
+        return NULL;
+    }
+
+    executable_lazy_resolve(&env->exe, entry, env->exe.func_map[id]);
+    return env->exe.func_map[id];
 }
@@ -27,20 +27,86 @@
 #include "env.h"
 #include "interp.h"
 
+typedef struct compile_code_seg_t {
+    struct compile_code_seg_t *next;
+    uint16_t size;
+    uint16_t used;
+    uint8_t  code[0];
+} compile_code_seg_t;
+
+typedef struct compile_line_t {
+    uint16_t func;
+    uint16_t pc;
+    int32_t  line;
+} compile_line_t;
+
+typedef struct compile_line_seg_t {
+    struct compile_line_seg_t *prev;
+    uint16_t size;
+    uint16_t used;
+    compile_line_t line[0];
+} compile_line_seg_t;
+
+typedef struct compile_const_t {
+    struct compile_const_t *next;
+    uint16_t func;              // function where the constant defined
+    uint8_t  id;                // variable hold the constant
+    expr_t  *value;             // primitive value, inlined at use; NULL: read only variable
+} compile_const_t;
+
+typedef struct compile_scalar_t {
+    struct compile_scalar_t *next;
+    intptr_t sym;               // variable assigned with the literal
+    expr_t  *def;               // the literal, be replaced
+    uint8_t  base;              // variable hold the first field
+} compile_scalar_t;
+
+typedef struct compile_cse_t {
+    expr_t  *chain;             // property chain, as "a.b.c"
+    int16_t  count;             // loads of the chain in block
+    int16_t  ext;               // max loads of chains extended from it
+    int16_t  var;               // hidden variable hold the value, -1: not allocated
+} compile_cse_t;
+
+typedef struct compile_hoist_t {
+    struct compile_hoist_t *next;
+    expr_t  *call;              // pure call be evaluated before the loop
+    int      var;               // hidden variable hold the result
+} compile_hoist_t;
+
+// Pure native called in compile, the result is reused by the same arguments
+typedef struct compile_pure_t {
+    struct compile_pure_t *next;
+    const native_t *native;
+    int      argc;
+    int      folded;            // result is a number, could be folded
+    val_t    result;
+    val_t    argv[0];
+} compile_pure_t;
+
 typedef struct compile_func_t {
     int16_t owner;
-    uint16_t stack_space;
     uint16_t stack_high;
 
     uint8_t closure;
     uint8_t var_max;
     uint8_t var_num;
     uint8_t arg_num;
+    uint8_t owner_var_num;      // variables of owner, visible to this function
 
-    uint16_t code_max;
     uint16_t code_num;
-    uint8_t  *code_buf;
+    uint16_t line_num;
+    uint8_t  *code_buf;         // continuous code, be set by compile_code_flatten
+    compile_code_seg_t *code_seg;
+    compile_code_seg_t *code_tail;
     intptr_t *var_map;
+
+    expr_t   *args;             // arguments & body, for inline of the function
+    stmt_t   *body;
+
+    const char *src;            // lazy function: source, be compiled on first call
+    int       src_size;
+    compile_const_t *consts;    // lazy function: constants visible at definition
 } compile_func_t;
 
 typedef struct compile_t {
@@ -53,6 +119,39 @@ typedef struct compile_t {
     uint16_t func_num;
     uint16_t func_cur;
     uint16_t func_offset;
+    uint16_t native_ref;  // native function referenced, for compile cache
+    uint16_t lines;       // record source line of code, for image
+    const char *lazy;     // source, functions of main are compiled on first call, NULL: off
+    compile_line_seg_t *line_seg; // records of all functions, the latest segment first
+    compile_const_t *consts;      // constants of all functions, the latest first
+
+    // Type inference of local variables, bit per variable id
+    uint32_t num_vars;    // variables hold number at current compile point
+    uint32_t num_clean;   // variables never be assigned with a foreign value
+    uint32_t num_check;   // variables had been checked for num_clean
+    stmt_t  *num_body;    // body of current function, NULL: inference is off
+    int      expr_num;    // the last compiled expression produce a number
+
+    // Object & array literals be replaced by variables, of current function
+    compile_scalar_t *scalars;
+
+    // Property chains loaded in current basic block, be reused till clobbered
+    int      cse_num;     // chains of the block, -1: block not scanned
+    uint32_t cse_valid;   // chains hold by variable now, bit per chain
+    compile_cse_t cse[LIMIT_CSE_SIZE];
+
+    // Pure calls hoisted out of the loops being compiled
+    compile_hoist_t *hoists;
+    compile_pure_t  *pures;   // pure natives had been called in compile
+
+    int      var_spare;   // hidden variables could be added to current function
+
+    // Inline of small functions, only done in module compile
+    stmt_t  *prog;          // the whole program, NULL: inline is off
+    expr_t  *inline_args;   // arguments of the function being inlined
+    uint8_t *inline_vars;   // variables hold the arguments
+    int      inline_depth;
+    uint16_t inline_func[LIMIT_VMAP_SIZE]; // function could be inlined, by main variable
 
     env_t  *env;
     heap_t  heap;
@@ -74,9 +173,12 @@ int compile_one_stmt(compile_t *cpl, stmt_t *stmt);
 int compile_multi_stmt(compile_t *cpl, stmt_t *stmt);
 
 int compile_update(compile_t *cpl);
+uint8_t *compile_lazy(env_t *env, uint8_t *entry);
 
 int compile_env_init(env_t *env, void *mem_ptr, int mem_size);
 int compile_exe(env_t *env, const char *input, void *mem_ptr, int mem_size);
+int compile_exe_input(env_t *env, lex_input_t input, void *ud, void *mem_ptr, int mem_size);
+int compile_exe_stream(env_t *env, lex_input_t input, void *ud, void *mem_ptr, int mem_size);
 
 
 #endif /* __LANG_COMPILE_INC__ */
@@ -77,9 +77,72 @@ typedef uint64_t val_t;
 # define LIMIT_VMAP_SIZE            (32)    // max variable number in function
 # define LIMIT_FUNC_SIZE            (32767) // max function number in  module
 # define LIMIT_FUNC_CODE_SIZE       (32767) // max code of each function
+# define LIMIT_NATIVE_SIZE          (32767) // max native function number
 
 # define DEF_STRING_SIZE            (8)
 
+// Functions in form of "def f(args) return expr", with the size of expr (nodes)
+// not above the limit, would be inlined in module compile, 0: disable inline
+#ifndef LIMIT_INLINE_SIZE
+# define LIMIT_INLINE_SIZE          (16)
+#endif
+# define LIMIT_INLINE_ARGS          (8)     // max arguments of inlined function
+# define LIMIT_INLINE_DEPTH         (4)     // max nest of inlined calls in arguments
+
+// Object or array literal, which never escape from its function, is replaced
+// by hidden variables, if the number of fields not above the limit, 0: disable
+#ifndef LIMIT_SCALAR_SIZE
+# define LIMIT_SCALAR_SIZE          (8)
+#endif
+
+// Max property chains, as "a.b.c", be reused in a basic block (1 ~ 32)
+#ifndef LIMIT_CSE_SIZE
+# define LIMIT_CSE_SIZE             (8)
+#endif
+# define LIMIT_HOIST_SIZE           (4)     // max pure calls hoisted out of a loop
+
+// Slots of identifiers interned by parser, power of 2, 0: disable
+#ifndef DEF_PARSE_NAME_SLOTS
+# define DEF_PARSE_NAME_SLOTS       (64)
+#endif
+
+// Map of code position to source line be emitted in module image, as an
+// optional section which is only read by tools, 0: disable
+#ifndef DEF_IMAGE_LINE_MAP
+# define DEF_IMAGE_LINE_MAP         (1)
+#endif
+
+// Runs of identifier, space, comment and string characters are scanned 16
+// bytes a time by lexer, with SSE2 if the target support it, 0: disable
+#ifndef DEF_LEX_SIMD
+# define DEF_LEX_SIMD               (1)
+#endif
+
+// Young generation, each of its two halves takes 1/2^N of heap, collected by
+// minor gc; objects survived DEF_GC_PROMOTE_AGE times be moved to old space.
+// Small heap (young half below DEF_GC_YOUNG_MIN) keep only one space, 0: disable
+#ifndef DEF_GC_YOUNG_SHIFT
+# define DEF_GC_YOUNG_SHIFT         (4)
+#endif
+# define DEF_GC_YOUNG_MIN           (1024)
+# define DEF_GC_PROMOTE_AGE         (2)
+
+// Bytes of objects scanned in each allocation by incremental gc, which bound
+// the pause time, could be changed by env_gc_slice_set, 0: stop the world gc
+#ifndef DEF_GC_SLICE_SIZE
+# define DEF_GC_SLICE_SIZE          (0)
+#endif
+
+// Mark compact gc on the whole heap, instead of copy gc which keep half of
+// heap idle; slower in gc, for twice usable memory. Default of interp_env_init_*,
+// could be selected by ENV_FL_GC_COMPACT of env_init; incremental gc not supported
+#ifndef DEF_GC_COMPACT
+# define DEF_GC_COMPACT             (0)
+#endif
+
+# define DEF_CACHE_SHIFT            (2)     // 1/4 of code space used as compile cache, in interactive mode
+# define DEF_STREAM_SHIFT           (2)     // 1/4 of memory used as parse space, in single pass compile
+
 // lang compile resource default and limit
 
 #endif /* __LANG_DEF__ */
@@ -19,6 +19,7 @@
 
 #include "env.h"
 #include "gc.h"
+#include "hash.h"
 #include "type_object.h"
 #include "type_string.h"
 #include "type_array.h"
@@ -36,32 +37,92 @@ typedef struct frame_t {
     intptr_t scope;
 } frame_t;
 
+// Incremental gc is started when half of heap used, in generational it is
+// started by minor gc, when half of old space used
+static void env_heap_gc_limit(env_t *env)
+{
+    if (env->gc_cycle) {
+        env->gc_limit = 0;
+    } else
+    if (env->gc_slice && !env->old) {
+        env->gc_limit = env->heap->size / 2;
+    } else {
+        env->gc_limit = INT_MAX;
+    }
+}
+
+// Heap layout in compact: | heap | mark bits | forward offsets |,
+// a mark word and a forward offset for each GC_MARK_SPACE bytes of heap
 static inline
-int env_is_valid_ptr(env_t *env, void *p) {
-    return heap_is_owned(env->heap, p);
+void env_heap_setup_compact(env_t *env, void *heap_ptr, int heap_size) {
+    int words = heap_size / (GC_MARK_SPACE + sizeof(uint32_t) + sizeof(int));
+    int size = words * GC_MARK_SPACE;
+
+    env->gc_compact = 1;
+    env->gc_slice = 0;
+    env->gc_mark = heap_ptr + size;
+    env->gc_forward = (int *)(env->gc_mark + words);
+
+    heap_init(&env->heap_top, heap_ptr, size);
+    env->heap = &env->heap_top;
 }
 
+// Heap layout in generational: | young top | young bot | remembered set | old top | old bot |
 static inline
-void env_heap_setup(env_t *env, void *heap_ptr, int heap_size) {
-    int half_size = heap_size / 2;
+void env_heap_setup(env_t *env, void *heap_ptr, int heap_size, int compact) {
+    int young_size = DEF_GC_YOUNG_SHIFT ? SIZE_ALIGN_16(heap_size >> DEF_GC_YOUNG_SHIFT) : 0;
+    int half_size;
+
+    env->old = NULL;
+    env->gc_young = NULL;
+    env->remember = NULL;
+    env->remember_num = 0;
+    env->remember_max = 0;
+    env->gc_full = 0;
+    env->gc_cycle = 0;
+    env->gc_slice = DEF_GC_SLICE_SIZE;
+    env->gc_queue_head = NULL;
+    env->gc_queue_tail = NULL;
+    env->gc_compact = 0;
+    env->gc_marking = 0;
+
+    if (compact) {
+        env_heap_setup_compact(env, heap_ptr, heap_size);
+        env_heap_gc_limit(env);
+        return;
+    }
+
+    if (young_size >= DEF_GC_YOUNG_MIN) {
+        int remember_size = SIZE_ALIGN_16(young_size / 8);
+        int remember_max = remember_size / sizeof(void *);
+
+        heap_init(&env->young_top, heap_ptr, young_size);
+        heap_init(&env->young_bot, heap_ptr + young_size, young_size);
+        env->remember = heap_ptr + young_size * 2;
+        env->remember_max = remember_max < UINT16_MAX ? remember_max : UINT16_MAX;
+
+        heap_ptr += young_size * 2 + remember_size;
+        heap_size -= young_size * 2 + remember_size;
+    }
+
+    half_size = heap_size / 2;
     heap_init(&env->heap_top, heap_ptr, half_size);
     heap_init(&env->heap_bot, heap_ptr + half_size, half_size);
-    env->heap = &env->heap_top;
+
+    if (env->remember) {
+        env->old = &env->heap_top;
+        env->heap = &env->young_top;
+    } else {
+        env->heap = &env->heap_top;
+    }
+    env_heap_gc_limit(env);
 }
 
-static heap_t *env_heap_gc_init(env_t *env)
+static void env_heap_gc_root(env_t *env)
 {
-    heap_t  *heap = env_heap_get_free(env);
     val_t   *sb;
     int fp, sp, ss;
 
-    heap_reset(heap);
-    env->heap = heap;
-
-    if (env->callback) {
-        env->callback(env, PANDA_EVENT_GC_START);
-    }
-
     env->scope = gc_scope_copy(env, env->scope);
 
     if (env->ref_num && env->ref_ent) {
@@ -85,8 +146,281 @@ static heap_t *env_heap_gc_init(env_t *env)
             sp = frame->sp;
         }
     }
+}
+
+// Young space in use is limited by free of old space, so all of old and young
+// objects could be copied to the other half of old space, by full gc
+static void env_heap_young_fit(env_t *env, heap_t *young)
+{
+    int size = env->young_bot.base - env->young_top.base;
+    int free = heap_free_size(env->old);
+
+    young->size = free < size ? free : size;
+}
+
+// Copy all of live objects to free half of old space, or the other half of heap
+static void env_heap_gc_full(env_t *env)
+{
+    heap_t *heap = env_heap_get_free(env);
+
+    heap_reset(heap);
+    env->heap = heap;
+
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_START);
+    }
+
+    env_heap_gc_root(env);
+    gc_scan(env);
+
+    if (env->old) {
+        env->old = heap;
+        env->heap = &env->young_top;
+        heap_reset(&env->young_top);
+        heap_reset(&env->young_bot);
+        env_heap_young_fit(env, &env->young_top);
+        env->remember_num = 0;
+        env->gc_full = 0;
+    }
+
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_END);
+    }
+}
+
+// Live objects are marked from roots, their forward addresses are computed
+// from mark bits; then references are updated, and live objects are slid down
+static void env_heap_gc_compact(env_t *env)
+{
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_START);
+    }
+
+    gc_compact_mark_begin(env);
+    env->gc_marking = 1;
+    env_heap_gc_root(env);
+    gc_compact_mark_end(env);
+    env->gc_marking = 0;
+
+    env_heap_gc_root(env);
+    gc_compact_update(env);
+
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_END);
+    }
+}
+
+// Start incremental gc: roots are copied to free half, and other objects
+// are copied and scanned step by step in allocation, or by read barrier
+static void env_heap_gc_flip(env_t *env)
+{
+    heap_t *heap = env_heap_get_free(env);
+    int used = env->old ? env->old->free + env->heap->free : env->heap->free;
+
+    // to space reserved for copy of all used, remain could be allocated in gc
+    env->gc_credit = heap->size - used;
+    heap_reset(heap);
+    env->heap = heap;
+
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_START);
+    }
+
+    env->gc_cycle = 1;
+    env_heap_gc_root(env);
+    env_heap_gc_limit(env);
+}
+
+void env_heap_gc_finish(env_t *env)
+{
+    while (gc_scan_slice(env, INT_MAX))
+        ;
+
+    // values of roots may be created in gc, keep them
+    env_heap_gc_root(env);
+    env->gc_cycle = 0;
+
+    if (env->old) {
+        env->old = env->heap;
+        env->heap = &env->young_top;
+        heap_reset(&env->young_top);
+        heap_reset(&env->young_bot);
+        env_heap_young_fit(env, &env->young_top);
+        env->remember_num = 0;
+        env->gc_full = 0;
+    }
+    env_heap_gc_limit(env);
+
+    if (env->callback) {
+        env->callback(env, PANDA_EVENT_GC_END);
+    }
+}
+
+// Allocation in incremental gc, take a step of scan, return NULL if memory not enough
+static void *env_heap_alloc_step(env_t *env, int size)
+{
+    if (!env->gc_cycle && !env->old) {
+        env_heap_gc_flip(env);
+    }
+
+    if (env->gc_cycle) {
+        if (SIZE_ALIGN(size) > env->gc_credit) {
+            // live objects may be not copied in, complete the gc
+            env_heap_gc_finish(env);
+            return NULL;
+        }
+        env->gc_credit -= SIZE_ALIGN(size);
+
+        if (!gc_scan_slice(env, env->gc_slice)) {
+            env_heap_gc_finish(env);
+        }
+    }
+
+    return heap_alloc(env->heap, size);
+}
+
+void env_heap_gc_gray(env_t *env, void *obj)
+{
+    gc_scan_gray(env, obj);
+}
+
+void env_heap_shade(env_t *env, val_t *v)
+{
+    gc_types_copy(env, 1, v);
+}
+
+int env_gc_slice_set(env_t *env, int slice)
+{
+    if (slice < 0 || (slice && env->gc_compact)) {
+        return -1;
+    }
+
+    if (!slice && env->gc_cycle) {
+        env_heap_gc_finish(env);
+    }
+    env->gc_slice = slice;
+    env_heap_gc_limit(env);
+
+    return 0;
+}
+
+// Copy live objects of young space, to the other half of young space,
+// or to old space if it had been survived DEF_GC_PROMOTE_AGE times.
+// Old objects are not touched, remembered set is used as extra roots
+static void env_heap_gc_young(env_t *env)
+{
+    heap_t *from = env->heap;
+    heap_t *to = from == &env->young_top ? &env->young_bot : &env->young_top;
+    int old_scan = env->old->free;
+
+    // survivors are not more than used of from space
+    heap_reset(to);
+    to->size = from->size;
+    env->heap = to;
+    env->gc_young = from;
+
+    gc_scan_remembered(env);
+    env_heap_gc_root(env);
+    gc_scan_young(env, old_scan);
+
+    env->gc_young = NULL;
+    env_heap_young_fit(env, to);
+}
+
+void env_heap_remember(env_t *env, void *obj)
+{
+    if (env->remember_num < env->remember_max) {
+        *env_heap_age(obj) |= GC_AGE_REMEMBERED;
+        env->remember[env->remember_num++] = obj;
+    } else {
+        env->gc_full = 1;
+    }
+}
+
+// Allocated in old space, the young objects in use should still fit in
+static void *env_heap_alloc_old(env_t *env, int size)
+{
+    void *ptr = NULL;
+
+    if (heap_free_size(env->old) - env->heap->free >= SIZE_ALIGN(size)) {
+        ptr = heap_alloc(env->old, size);
+    }
+    if (!ptr) {
+        env_heap_gc_full(env);
+        ptr = heap_alloc(env->old, size);
+    }
+    if (ptr) {
+        env_heap_young_fit(env, env->heap);
+    }
+
+    return ptr;
+}
+
+// Object too big for young space, is allocated in old space directly,
+// and remembered if it is not a buffer, as its members are stored without barrier
+void *env_heap_alloc_slow(env_t *env, int size, int remember)
+{
+    void *ptr;
+
+    if (env->gc_slice && (ptr = env_heap_alloc_step(env, size))) {
+        return ptr;
+    }
+
+    if (!env->old || size <= env->heap->size / 2) {
+        env_heap_gc(env, size);
+        // incremental gc may be started by the gc, allocation is charged then
+        ptr = env->gc_cycle ? env_heap_alloc_step(env, size) : NULL;
+        ptr = ptr ? ptr : heap_alloc(env->heap, size);
+        if (ptr || !env->old) {
+            return ptr;
+        }
+    }
+
+    ptr = env_heap_alloc_old(env, size);
+    if (ptr && remember) {
+        env_heap_remember(env, ptr);
+    }
 
-    return heap;
+    return ptr;
+}
+
+// Memory extend the object, as properties or elements, allocated in the space of it
+void *env_heap_alloc_buffer(env_t *env, void *owner, int size)
+{
+    void *ptr;
+
+    // buffer in compact heap has a header, as it should be walked
+    if (env->gc_compact) {
+        gc_space_t *space = env_heap_alloc(env, sizeof(gc_space_t) + size);
+
+        if (!space) {
+            return NULL;
+        }
+        space->magic = MAGIC_SPACE;
+        space->age = 0;
+        space->size = SIZE_ALIGN(sizeof(gc_space_t) + size);
+        return space + 1;
+    }
+
+    // Owner not copied yet, its copy would be larger by the buffer at most
+    if (env->gc_cycle && !heap_is_owned(env->heap, owner)) {
+        if (SIZE_ALIGN(size) <= env->gc_credit) {
+            env->gc_credit -= SIZE_ALIGN(size);
+        } else {
+            // owner is moved, to old space in generational heap
+            env_heap_gc_finish(env);
+            if (env->old) {
+                return env_heap_alloc_old(env, size);
+            }
+        }
+    }
+
+    if (env->old && !env->gc_cycle && heap_is_owned(env->old, owner)) {
+        return env_heap_alloc_old(env, size);
+    }
+
+    ptr = env->gc_cycle ? NULL : heap_alloc(env->heap, size);
+    return ptr ? ptr : env_heap_alloc_slow(env, size, 0);
 }
 
 static uint32_t hash_pjw(const void *key)
@@ -213,29 +547,98 @@ int env_string_find_add(env_t *env, intptr_t s)
 
 int env_native_find(env_t *env, intptr_t sym_id)
 {
-    int i;
+    uint32_t size, pos, i;
+    int id;
+
+    if (!env->native_index) {
+        for (i = 0; i < env->native_num; i++) {
+            if (sym_id == (intptr_t) env->native_ent[i].name) {
+                return i;
+            }
+        }
+        return -1;
+    }
 
-    for (i = 0; i < env->native_num; i++) {
-        if (sym_id == (intptr_t) env->native_ent[i].name) {
-            return i;
+    size = env->native_num * 2;
+    pos = hash_ptr(sym_id) % size;
+    for (i = 0; i < size; i++, pos = hash_next(size, pos)) {
+        id = env->native_index[pos];
+        if (id == 0) {
+            break;
+        }
+        if (env->native_sym[id - 1] == sym_id) {
+            return id - 1;
         }
     }
 
     return -1;
 }
 
+static void env_native_index_build(env_t *env, intptr_t *sym, int num)
+{
+    uint32_t size = num * 2;
+    uint32_t pos;
+    int i;
+
+    memset(env->native_index, 0, sizeof(uint16_t) * size);
+    for (i = 0; i < num; i++) {
+        pos = hash_ptr(sym[i]) % size;
+        while (env->native_index[pos]) {
+            pos = hash_next(size, pos);
+        }
+        env->native_index[pos] = i + 1;
+    }
+}
+
 int env_native_set(env_t *env, const native_t *ent, int num)
 {
+    intptr_t *sym;
     int i;
 
+    // native id is 16 bits in code, and so are the index and symbal buffer sizes
+    if (num > LIMIT_NATIVE_SIZE) {
+        env_set_error(env, ERR_ResourceOutLimit);
+        return -1;
+    }
+
+    // names are interned first, natives be kept if fail
     for (i = 0; i < num; i++) {
         if (0 == env_symbal_add_static(env, ent[i].name)) {
             return -1;
         }
     }
 
+    // index memory is taken from symbal buffer, and reused by later call while
+    // num fits in it, fall back to linear lookup if no space
+    sym = env->native_sym;
+    if (num > env->native_max) {
+        sym = ADDR_ALIGN_8(env_symbal_buf_alloc(env, (sizeof(intptr_t) + sizeof(uint16_t) * 2) * num + 8));
+        env->native_max = sym ? num : 0;
+    }
+    env->native_sym = sym;
+    if (num <= 0) {
+        sym = NULL;
+    }
+    env->native_index = sym ? (uint16_t *)(sym + num) : NULL;
+
+    env->native_pure = 0;
+    for (i = 0; i < num; i++) {
+        if (sym) {
+            sym[i] = env_symbal_add_static(env, ent[i].name);
+        }
+        env->native_pure += ent[i].pure ? 1 : 0;
+    }
+
+    if (sym) {
+        env_native_index_build(env, sym, num);
+    }
+
     env->native_num = num;
     env->native_ent = ent;
+
+    // native id in cached code is out of date
+    executable_cache_clr(&env->exe);
+
     return 0;
 }
 
@@ -298,6 +701,12 @@ scope_t *env_scope_create(env_t *env, scope_t *super, uint8_t *entry, int ac, va
     scope->super = super;
     scope->var_buf = buf;
 
+    if (env->gc_cycle) {
+        for (i = 0; i < vc; i++) {
+            env_heap_shade(env, buf + i);
+        }
+    }
+
     return scope;
 }
 
@@ -308,6 +717,17 @@ const uint8_t *env_frame_setup(env_t *env, const uint8_t *pc, val_t *fv, int ac,
     frame_t *frame;
     int fp;
 
+    // lazy function, compiled on first call
+    if (executable_func_is_lazy(fn->entry)) {
+        uint8_t *entry = env->lazy ? env->lazy(env, fn->entry) : NULL;
+
+        if (!entry) {
+            if (!env->error) env->error = ERR_InvalidByteCode;
+            return NULL;
+        }
+        fn->entry = entry;
+    }
+
     // empty function
     if (function_size(fn) == 0) {
         env->sp += ac + 1; // release arguments & fobj in stack
@@ -315,16 +735,16 @@ const uint8_t *env_frame_setup(env_t *env, const uint8_t *pc, val_t *fv, int ac,
         return pc;
     }
 
+    env_read_barrier(env, fn);
     if (NULL == (scope = env_scope_create(env, fn->super, fn->entry, ac, av))) {
         // error had be set in
         return NULL;
     }
 
-    if (!env_is_valid_ptr(env, fn)) {
-        // GC happend? super should be update
-        fn = (function_t *)val_2_intptr(fv); // fv had update, by gc
-        scope->super = fn->super;
-    }
+    // GC happend? super should be update, as fv had update by gc
+    fn = (function_t *)val_2_intptr(fv);
+    env_read_barrier(env, fn);
+    scope->super = fn->super;
 
     //skip arguments & function
     env->sp += ac + 1;
@@ -375,8 +795,22 @@ void env_native_call(env_t *env, val_t *fv, int ac, val_t *av)
     env->sp = sp;
 }
 
+// Stack space of function be checked as entry, no more check while running
+static inline int env_entry_stack_check(env_t *env, uint8_t *entry)
+{
+    if (env->sp < executable_func_get_stack_high(entry)) {
+        env->error = ERR_StackOverflow;
+        return -1;
+    }
+    return 0;
+}
+
 const uint8_t *env_func_entry_setup(env_t *env, uint8_t *entry, int ac, val_t *av)
 {
+    if (env_entry_stack_check(env, entry)) {
+        return NULL;
+    }
+
     // main scope already created, in interactive mode
     if (!env_is_interactive(env)) {
         env->scope = env_scope_create(env, NULL, entry, ac, av);
@@ -389,6 +823,10 @@ const uint8_t *env_main_entry_setup(env_t *env, int ac, val_t *av)
 {
     uint8_t *entry = env_get_main_entry(env);
 
+    if (env_entry_stack_check(env, entry)) {
+        return NULL;
+    }
+
     // main scope already created, in interactive mode
     if (!env_is_interactive(env)) {
         env->scope = env_scope_create(env, NULL, entry, ac, av);
@@ -416,7 +854,7 @@ int env_exe_memery_distribute(int size, int *num_max, int *str_max, int *fn_max,
     if (str_max) {
         // 7/16 of memory as function entry space
         str_space = size * 7 / 8;
-        *str_max = str_space / (sizeof(intptr_t) * 2 + DEF_STRING_SIZE);
+        *str_max = str_space / (sizeof(intptr_t) * 2 + sizeof(uint16_t) * 2 + DEF_STRING_SIZE);
         size -= str_space;
     } else {
         str_space = 0;
@@ -425,7 +863,7 @@ int env_exe_memery_distribute(int size, int *num_max, int *str_max, int *fn_max,
     if (num_max) {
         // 1/32 of memory as number
         num_space = SIZE_ALIGN_8(size / 2);
-        *num_max = num_space / sizeof(double);
+        *num_max = num_space / (sizeof(double) + sizeof(uint16_t) * 2);
         size -= num_space;
     } else {
         num_space = 0;
@@ -452,10 +890,12 @@ int env_exe_memery_distribute(int size, int *num_max, int *str_max, int *fn_max,
 int env_init(env_t *env, void *mem_ptr, int mem_size,
              void *heap_ptr, int heap_size, val_t *stack_ptr, int stack_size,
              int number_max, int string_max, int func_max,
-             int code_max, int interactive)
+             int code_max, int flags)
 {
+    int interactive = flags & ENV_FL_INTERACTIVE;
     int mem_offset;
     int exe_size, symbal_tbl_size;
+    int cache_max;
 
     env->error = 0;
 
@@ -487,7 +927,7 @@ int env_init(env_t *env, void *mem_ptr, int mem_size,
             return -1;
         }
     }
-    env_heap_setup(env, heap_ptr, heap_size);
+    env_heap_setup(env, heap_ptr, heap_size, flags & ENV_FL_GC_COMPACT);
 
     // main_var_map init
     if (interactive) {
@@ -500,15 +940,24 @@ int env_init(env_t *env, void *mem_ptr, int mem_size,
 
     // native init
     env->native_num = 0;
+    env->native_pure = 0;
+    env->native_max = 0;
     env->native_ent = NULL;
+    env->native_sym = NULL;
+    env->native_index = NULL;
 
     // reference init
     env->ref_num = 0;
     env->ref_ent = NULL;
 
     // static memory init
+    // compile cache only used by interactive mode, take it from code space
+    cache_max = interactive ? SIZE_ALIGN_8(code_max >> DEF_CACHE_SHIFT) : 0;
+    if (cache_max >= code_max) {
+        cache_max = 0;
+    }
     exe_size = executable_init(&env->exe, mem_ptr + mem_offset, mem_size - mem_offset,
-                    number_max, string_max, func_max, code_max);
+                    number_max, string_max, func_max, code_max - cache_max, cache_max);
     if (exe_size < 0) {
         return -1;
     }
@@ -544,6 +993,7 @@ int env_init(env_t *env, void *mem_ptr, int mem_size,
 
     // Initialise callbacks
     env->callback = NULL;
+    env->lazy = NULL;
 
     object_proto_init(env);
     string_proto_init(env);
@@ -560,15 +1010,32 @@ int env_deinit(env_t *env)
 
 void env_heap_gc(env_t *env, int flags)
 {
-    env_heap_gc_init(env);
-
     (void) flags;
 
-    gc_scan(env);
+    if (env->gc_compact) {
+        env_heap_gc_compact(env);
+        return;
+    }
 
-    if (env->callback) {
-        env->callback(env, PANDA_EVENT_GC_END);
+    if (env->gc_cycle) {
+        env_heap_gc_finish(env);
+        if (env->old) {
+            return;
+        }
+    }
+
+    // Minor gc only if all of young objects could be promoted
+    if (env->old && !env->gc_full && heap_free_size(env->old) >= env->heap->free) {
+        env_heap_gc_young(env);
+        if (!env->gc_full) {
+            if (env->gc_slice && heap_free_size(env->old) < env->old->size / 2) {
+                env_heap_gc_flip(env);
+            }
+            return;
+        }
     }
+
+    env_heap_gc_full(env);
 }
 
 int env_callback_set(env_t *env, void (*cb)(env_t *, int event))
@@ -32,6 +32,13 @@
 #define PANDA_EVENT_GC_START 1
 #define PANDA_EVENT_GC_END   2
 
+#define ENV_FL_INTERACTIVE  1
+#define ENV_FL_GC_COMPACT   2           // mark compact gc on whole heap, instead of copy gc on halves
+#define ENV_FL_GC_DEFAULT   (DEF_GC_COMPACT ? ENV_FL_GC_COMPACT : 0)
+
+#define GC_MARK_SHIFT       3           // a mark bit for each 8 bytes of compact heap
+#define GC_MARK_SPACE       (32 << GC_MARK_SHIFT)   // heap bytes of each mark word
+
 struct native_t;
 
 typedef struct env_t {
@@ -45,12 +52,40 @@ typedef struct env_t {
 
     scope_t *scope;                     // Root scope
 
-    heap_t *heap;                       // inused heap ptr: top or bot
+    heap_t *heap;                       // inused heap ptr: top or bot, young top or bot in generational
     heap_t heap_top;
     heap_t heap_bot;
 
+    heap_t *old;                        // inused old space: top or bot, NULL: not generational
+    heap_t *gc_young;                   // young space be collected, in minor gc
+    heap_t young_top;
+    heap_t young_bot;
+
+    void   **remember;                  // Old objects which may refer to young objects
+    uint16_t remember_num;
+    uint16_t remember_max;
+    uint8_t  gc_full;                   // remembered set overflow, next gc should be full
+
+    uint8_t  gc_cycle;                  // incremental gc in progress
+    int      gc_slice;                  // bytes scanned in each step of incremental gc, 0: disable
+    int      gc_limit;                  // heap used limit of fast allocation
+    int      gc_credit;                 // bytes could be allocated in incremental gc
+    void    *gc_queue_head;             // from space objects be copied, but not scanned
+    void    *gc_queue_tail;
+
+    uint8_t  gc_compact;                // mark compact gc, heap_bot is the tail used by compiler
+    uint8_t  gc_marking;                // mark phase of compact gc, or update phase
+    uint8_t  gc_overflow;               // mark stack overflow, marked objects should be scanned again
+    uint32_t *gc_mark;                  // mark bits of compact heap
+    int      *gc_forward;               // forward offset of first marked bytes, of each mark word
+    void    **gc_stack;                 // mark stack, in free tail of heap
+    int      gc_stack_num;
+    int      gc_stack_max;
+
     uint16_t ref_num;                   // External reference number
     uint16_t native_num;                // Native function number
+    uint16_t native_pure;               // Native function declared pure number
+    uint16_t native_max;                // Native function number the index could hold
 
     uint16_t symbal_tbl_size;           // Symbal hash table size
     uint16_t symbal_tbl_hold;           // Symbal saved counter
@@ -61,10 +96,13 @@ typedef struct env_t {
     char     *symbal_buf;
     val_t    *ref_ent;                  // External reference entry
     const struct native_t *native_ent;  // Native function entry
+    intptr_t *native_sym;               // Native function symbal, index by native id
+    uint16_t *native_index;             // Hash index of native_sym
 
     intptr_t *main_var_map;
 
     void (*callback)(struct env_t *, int);
+    uint8_t *(*lazy)(struct env_t *, uint8_t *);    // compile lazy function, return: entry
 
     executable_t exe;
 } env_t;
@@ -72,6 +110,8 @@ typedef struct env_t {
 typedef struct native_t {
     const char *name;
     val_t (*fn)(env_t *, int ac, val_t *av);
+    int pure;   // result only depend on arguments, without side effect and error,
+                // could be called by compiler, or called less than written
 } native_t;
 
 
@@ -79,7 +119,7 @@ int env_exe_memery_distribute(int mem_size, int *num_max, int *str_max, int *fn_
 int env_init(env_t *env, void * mem_ptr, int mem_size,
              void *heap_ptr, int heap_size, val_t *stack_ptr, int stack_size,
              int number_max, int string_max, int func_max, int code_max,
-             int interactive);
+             int flags);
 
 int env_deinit(env_t *env);
 int env_reference_set(env_t *env, val_t *ent, int num);
@@ -87,20 +127,71 @@ int env_callback_set(env_t *env, void (*cb)(env_t *, int));
 int env_native_set(env_t *env, const native_t *ent, int num);
 
 void env_heap_gc(env_t *env, int level);
+void *env_heap_alloc_slow(env_t *env, int size, int remember);
+void *env_heap_alloc_buffer(env_t *env, void *owner, int size);
+void env_heap_remember(env_t *env, void *obj);
+void env_heap_shade(env_t *env, val_t *v);
+void env_heap_gc_gray(env_t *env, void *obj);
+void env_heap_gc_finish(env_t *env);
+int  env_gc_slice_set(env_t *env, int slice);
 
 scope_t *env_scope_create(env_t *env, scope_t *super, uint8_t *entry, int ac, val_t *av);
 int env_scope_get(env_t *env, int id, val_t **v);
 int env_scope_set(env_t *env, int id, val_t *v);
 
 static inline void *env_heap_alloc(env_t *env, int size) {
-    void *ptr = heap_alloc(env->heap, size);
+    if (env->heap->free < env->gc_limit) {
+        void *ptr = heap_alloc(env->heap, size);
 
-    if (!ptr) {
-        env_heap_gc(env, size);
-        return heap_alloc(env->heap, size);
+        if (ptr) {
+            return ptr;
+        }
     }
 
-    return ptr;
+    return env_heap_alloc_slow(env, size, 1);
+}
+
+#define GC_AGE_REMEMBERED   0x80        // age flag of object in remembered set
+#define GC_AGE_GRAY         0x40        // age flag of object copied by incremental gc, but not scanned
+
+#define MAGIC_SPACE         (MAGIC_BASE + 17)
+
+// Header of memory extend object or array, in compact heap
+typedef struct gc_space_t {
+    uint8_t magic;
+    uint8_t age;
+    uint16_t reserved;
+    int32_t size;
+} gc_space_t;
+
+static inline uint8_t *env_heap_age(void *obj) {
+    return (uint8_t *)obj + 1;
+}
+
+static inline int env_heap_is_young_ref(env_t *env, val_t *v) {
+    return (val_is_heap_string(v) || val_is_script(v) || val_is_object(v) || val_is_array(v))
+           && !heap_is_owned(env->old, (void *)val_2_intptr(v));
+}
+
+// Write barrier: should be called after a value be stored in object, array or scope,
+// old object which refer to young object, should be remembered for minor gc,
+// value stored in incremental gc, should be shaded as it may not be scanned
+static inline void env_heap_barrier(env_t *env, void *obj, val_t *v) {
+    if (env->gc_cycle) {
+        env_heap_shade(env, v);
+    } else
+    if (env->old && !(*env_heap_age(obj) & GC_AGE_REMEMBERED)
+        && heap_is_owned(env->old, obj) && env_heap_is_young_ref(env, v)) {
+        env_heap_remember(env, obj);
+    }
+}
+
+// Read barrier: should be called before members of object, array, scope or function be read,
+// members of gray object may refer to objects not copied yet
+static inline void env_read_barrier(env_t *env, void *obj) {
+    if (obj && (*env_heap_age(obj) & GC_AGE_GRAY)) {
+        env_heap_gc_gray(env, obj);
+    }
 }
 
 intptr_t env_symbal_insert(env_t *env, const char *symbal, int alloc);
@@ -161,8 +252,10 @@ static inline void env_push_call_function(env_t *env, val_t *v) {
 static inline val_t *env_get_var(env_t *env, uint8_t id, uint8_t generation) {
     scope_t *scope = env->scope;
 
+    env_read_barrier(env, scope);
     while(scope && generation--) {
         scope = scope->super;
+        env_read_barrier(env, scope);
     }
 
     if (scope && id < scope->num) {
@@ -230,14 +323,46 @@ static inline void env_push_native(env_t *env, int id) {
     }
 }
 
+// Memory could be used by parser and compiler: the idle half of heap, or the
+// free tail of compact heap, which is collected first if it is below half of
+// heap (as copy gc give), while nothing in stack
 static inline
 heap_t *env_heap_get_free(env_t *env) {
-    return env->heap == &env->heap_top ? &env->heap_bot : &env->heap_top;
+    heap_t *used;
+
+    // idle half is the from space of incremental gc
+    if (env->gc_cycle) {
+        env_heap_gc_finish(env);
+    }
+
+    if (env->gc_compact) {
+        heap_t *tail = &env->heap_bot;
+
+        if (env->fp == env->ss && env->sp == env->ss && heap_free_size(env->heap) < env->heap->size / 2) {
+            env_heap_gc(env, 0);
+        }
+        tail->base = heap_free_addr(env->heap);
+        tail->size = heap_free_size(env->heap);
+        tail->free = 0;
+        return tail;
+    }
+
+    used = env->old ? env->old : env->heap;
+    return used == &env->heap_top ? &env->heap_bot : &env->heap_top;
 }
 
 static inline
-int env_is_heap_memory(env_t *env, void *p) {
-    return heap_is_owned(env->heap, p);
+void env_var_barrier(env_t *env, int generation, val_t *v) {
+    if (env->old || env->gc_cycle) {
+        scope_t *scope = env->scope;
+
+        while (scope && generation--) {
+            scope = scope->super;
+        }
+        if (scope) {
+            env_heap_barrier(env, scope, v);
+        }
+    }
 }
 
 static inline
@@ -18,11 +18,12 @@
  **/
 
 #include "err.h"
+#include "hash.h"
 #include "executable.h"
 #include "type_function.h"
 
 int executable_init(executable_t *exe, void *mem_ptr, int mem_size,
-                    int number_max, int string_max, int func_max, int code_max)
+                    int number_max, int string_max, int func_max, int code_max, int cache_max)
 {
     int mem_offset = 0;
 
@@ -50,26 +51,56 @@ int executable_init(executable_t *exe, void *mem_ptr, int mem_size,
     exe->func_map = (uint8_t **) (mem_ptr + mem_offset);
     mem_offset += sizeof(uint8_t **) * func_max;
 
+    // hash index of constant pools
+    exe->number_index = (uint16_t *) (mem_ptr + mem_offset);
+    mem_offset += sizeof(uint16_t) * 2 * number_max;
+    exe->string_index = (uint16_t *) (mem_ptr + mem_offset);
+    mem_offset += sizeof(uint16_t) * 2 * string_max;
+    mem_offset = SIZE_ALIGN_8(mem_offset);
+
+    // compile cache init
+    exe->cache = (uint8_t *) (mem_ptr + mem_offset);
+    exe->cache_size = SIZE_ALIGN_8(cache_max);
+    exe->cache_used = 0;
+    exe->cache_tick = 0;
+    exe->cache_pending = exe->cache_size;
+    mem_offset += exe->cache_size;
+
     if (mem_offset > mem_size) {
         return -1;
-    } else {
-        return mem_offset;
     }
+
+    memset(exe->number_index, 0, sizeof(uint16_t) * 2 * (number_max + string_max));
+
+    return mem_offset;
 }
 
 int executable_number_find_add(executable_t *exe, double n)
 {
-    int i;
+    uint32_t size = exe->number_max * 2;
+    uint32_t pos, i;
+    int id;
 
-    for (i = 0; i < exe->number_num; i++) {
-        if (exe->number_map[i] == n) {
-            return i;
+    if (size == 0) {
+        return -1;
+    }
+
+    pos = hash_number(n) % size;
+    for (i = 0; i < size; i++, pos = hash_next(size, pos)) {
+        id = exe->number_index[pos];
+        if (id == 0) {
+            break;
+        }
+        if (exe->number_map[id - 1] == n) {
+            return id - 1;
         }
     }
 
     if (exe->number_num < exe->number_max) {
-        exe->number_map[exe->number_num++] = n;
-        return i;
+        id = exe->number_num++;
+        exe->number_map[id] = n;
+        exe->number_index[pos] = id + 1;
+        return id;
     } else {
         return -1;
     }
@@ -77,26 +108,177 @@ int executable_number_find_add(executable_t *exe, double n)
 
 int executable_string_find_add(executable_t *exe, intptr_t s)
 {
-    int i;
+    uint32_t size = exe->string_max * 2;
+    uint32_t pos, i;
+    int id;
 
-    if (s == 0) {
+    if (s == 0 || size == 0) {
         return -1;
     }
 
-    for (i = 0; i < exe->string_num; i++) {
-        if (exe->string_map[i] == s) {
-            return i;
+    pos = hash_ptr(s) % size;
+    for (i = 0; i < size; i++, pos = hash_next(size, pos)) {
+        id = exe->string_index[pos];
+        if (id == 0) {
+            break;
+        }
+        if (exe->string_map[id - 1] == s) {
+            return id - 1;
         }
     }
 
     if (exe->string_num < exe->string_max) {
-        exe->string_map[exe->string_num++] = s;
-        return i;
+        id = exe->string_num++;
+        exe->string_map[id] = s;
+        exe->string_index[pos] = id + 1;
+        return id;
     } else {
         return -1;
     }
 }
 
+static inline executable_cache_t *executable_cache_entry(executable_t *exe, uint32_t offset) {
+    return (executable_cache_t *)(exe->cache + offset);
+}
+
+executable_cache_t *executable_cache_find(executable_t *exe, const char *text)
+{
+    uint32_t offset, hash, len;
+
+    hash = hash_text(text, &len);
+    for (offset = 0; offset < exe->cache_used; ) {
+        executable_cache_t *ent = executable_cache_entry(exe, offset);
+
+        if (offset != exe->cache_pending && ent->hash == hash && ent->text_len == len &&
+            !memcmp(ent + 1, text, len)) {
+            ent->tick = ++exe->cache_tick;
+            return ent;
+        }
+        offset += ent->size;
+    }
+
+    return NULL;
+}
+
+void executable_cache_remove(executable_t *exe, executable_cache_t *ent)
+{
+    uint32_t offset = (uint8_t *)ent - exe->cache;
+    uint32_t size = ent->size;
+
+    memmove(ent, exe->cache + offset + size, exe->cache_used - offset - size);
+    exe->cache_used -= size;
+
+    if (exe->cache_pending < exe->cache_size && exe->cache_pending > offset) {
+        exe->cache_pending -= size;
+    }
+}
+
+void executable_cache_clr(executable_t *exe)
+{
+    exe->cache_used = 0;
+    exe->cache_pending = exe->cache_size;
+}
+
+// Evict least recently used entries, until there is enough space
+static int executable_cache_reserve(executable_t *exe, uint32_t size)
+{
+    while (exe->cache_used + size > exe->cache_size) {
+        executable_cache_t *lru = NULL;
+        uint32_t offset;
+
+        for (offset = 0; offset < exe->cache_used; ) {
+            executable_cache_t *ent = executable_cache_entry(exe, offset);
+
+            if (offset != exe->cache_pending && (!lru || ent->tick < lru->tick)) {
+                lru = ent;
+            }
+            offset += ent->size;
+        }
+
+        if (!lru) {
+            return -1;
+        }
+        executable_cache_remove(exe, lru);
+    }
+
+    return 0;
+}
+
+int executable_cache_begin(executable_t *exe, const char *text)
+{
+    executable_cache_t *ent;
+    uint32_t hash, len, size;
+
+    executable_cache_abort(exe);
+
+    hash = hash_text(text, &len);
+    size = sizeof(executable_cache_t) + SIZE_ALIGN_8(len + 1);
+    if (0 != executable_cache_reserve(exe, size)) {
+        return -1;
+    }
+
+    exe->cache_pending = exe->cache_used;
+    exe->cache_used += size;
+
+    ent = executable_cache_entry(exe, exe->cache_pending);
+    ent->hash = hash;
+    ent->tick = ++exe->cache_tick;
+    ent->size = size;
+    ent->text_len = len;
+    ent->seg_num = 0;
+    ent->stamp = 0;
+    memcpy(ent + 1, text, len + 1);
+
+    return 0;
+}
+
+int executable_cache_append(executable_t *exe, const uint8_t *entry)
+{
+    executable_cache_t *ent;
+    const uint8_t *end;
+    uint32_t size = FUNC_HEAD_SIZE + executable_func_get_code_size(entry);
+    int i;
+
+    if (exe->cache_pending >= exe->cache_size) {
+        return -1;
+    }
+
+    if (0 != executable_cache_reserve(exe, SIZE_ALIGN_8(size))) {
+        executable_cache_abort(exe);
+        return -1;
+    }
+
+    // segments are packed, only the entry is padded to 8 bytes
+    ent = executable_cache_entry(exe, exe->cache_pending);
+    end = executable_cache_segment(ent);
+    for (i = 0; i < ent->seg_num; i++) {
+        end = executable_cache_segment_next(end);
+    }
+    memcpy((uint8_t *)end, entry, size);
+
+    ent->seg_num++;
+    ent->size = SIZE_ALIGN_8(end + size - (uint8_t *)ent);
+    exe->cache_used = exe->cache_pending + ent->size;
+
+    return 0;
+}
+
+void executable_cache_commit(executable_t *exe, uint16_t stamp)
+{
+    if (exe->cache_pending < exe->cache_size) {
+        executable_cache_entry(exe, exe->cache_pending)->stamp = stamp;
+        exe->cache_pending = exe->cache_size;
+    }
+}
+
+void executable_cache_abort(executable_t *exe)
+{
+    if (exe->cache_pending < exe->cache_size) {
+        exe->cache_used = exe->cache_pending;
+        exe->cache_pending = exe->cache_size;
+    }
+}
+
 int executable_func_set_head(void *buf, uint8_t vc, uint8_t ac, uint32_t code_size, uint16_t stack_size, int closure) {
     uint8_t *head = (uint8_t *)buf;
     int mark = 0;
@@ -138,7 +320,7 @@ int executable_func_get_head(void *buf, uint8_t *vc, uint8_t *ac, uint32_t *code
     *stack_size = size;
     *closure = mark;
 
-    size = (head[4] * 0x1000000 + head[5] * 0x10000 + head[6] * 0x100 + head[7]);
+    size = ((head[4] & 0x7F) * 0x1000000 + head[5] * 0x10000 + head[6] * 0x100 + head[7]);
     *code_size = size;
 
     return 0;
@@ -180,11 +362,55 @@ int executable_func_add(executable_t *exe, void *code, uint16_t size, uint8_t vc
 
     exe->func_map[exe->func_num++] = entry;
     executable_func_set_head(entry, vc, ac, size, stack_need, closure);
-    memcpy(entry + FUNC_HEAD_SIZE, code, size);
+    if (code) {
+        memcpy(entry + FUNC_HEAD_SIZE, code, size);
+    }
 
     return 0;
 }
 
+int executable_lazy_add(executable_t *exe, const char *src, uint32_t size, uint16_t vars,
+                        const executable_lazy_const_t *consts, int const_num)
+{
+    executable_lazy_t lazy;
+    int err, code_size = sizeof(lazy) + sizeof(executable_lazy_const_t) * const_num;
+
+    if (code_size > UINT16_MAX) {
+        return ERR_ResourceOutLimit;
+    }
+
+    lazy.src = src;
+    lazy.entry = NULL;
+    lazy.size = size;
+    lazy.vars = vars;
+    lazy.id = exe->func_num;
+    lazy.consts = const_num;
+
+    // constants follow the lazy record
+    if (0 == (err = executable_func_add(exe, NULL, code_size, 0, 0, 0, 0))) {
+        uint8_t *code = exe->func_map[lazy.id] + FUNC_HEAD_SIZE;
+
+        memcpy(code, &lazy, sizeof(lazy));
+        if (const_num) {
+            memcpy(code + sizeof(lazy), consts, sizeof(executable_lazy_const_t) * const_num);
+        }
+        exe->func_map[lazy.id][4] |= EXEC_FUNC_LAZY;
+    }
+    return err;
+}
+
+// The lazy function is compiled, new instances of it use the compiled entry
+void executable_lazy_resolve(executable_t *exe, uint8_t *entry, uint8_t *to)
+{
+    executable_lazy_t lazy;
+
+    executable_lazy_get(entry, &lazy);
+    lazy.entry = to;
+    memcpy(entry + FUNC_HEAD_SIZE, &lazy, sizeof(lazy));
+
+    exe->func_map[lazy.id] = to;
+}
+
 
 
 static inline
@@ -246,6 +472,7 @@ int image_load(image_info_t *img, uint8_t *input, int size)
     image_read_uint32(img, 28, &img->str_ent);
     image_read_uint32(img, 32, &img->fn_cnt);
     image_read_uint32(img, 36, &img->fn_ent);
+    image_read_uint32(img, 40, &img->line_ent);
 
     return 0;
 }
@@ -269,6 +496,7 @@ int image_init(image_info_t *img, void *mem_ptr, int mem_size, int byte_order, i
     img->num_ent = 64;
     img->str_ent = SIZE_ALIGN_8(img->num_ent + 8 * num_cnt);
     img->fn_ent  = SIZE_ALIGN_8(img->str_ent + 4 * str_cnt);
+    img->line_ent = 0;
 
     img->end = SIZE_ALIGN_16(img->fn_ent + 4 * fn_cnt + 16);
 
@@ -350,6 +578,148 @@ int image_fill_code(image_info_t *img, unsigned int entry, uint8_t vc, uint8_t a
     return 0;
 }
 
+/*
+ * Line map section be placed behind all of the code,
+ * so it should be initialized after code filled.
+ */
+int image_line_init(image_info_t *img)
+{
+    unsigned int end;
+
+    if (!img) {
+        return -1;
+    }
+
+    end = SIZE_ALIGN_8(img->end + 4 * img->fn_cnt);
+    if (end > img->size) {
+        return -1;
+    }
+
+    img->line_ent = img->end;
+    image_write_zero(img, img->line_ent, end - img->line_ent);
+    image_write_uint32(img, 40, img->line_ent);
+    img->end = end;
+
+    return 0;
+}
+
+static int image_line_put(uint8_t *buf, uint32_t v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+        buf[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = v;
+
+    return n;
+}
+
+static int image_line_get(const uint8_t *buf, int size, uint32_t *v)
+{
+    uint32_t d = 0;
+    int n = 0, shift = 0;
+
+    while (n < size && shift < 32) {
+        uint8_t b = buf[n++];
+
+        d |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = d;
+            return n;
+        }
+        shift += 7;
+    }
+
+    return 0;
+}
+
+int image_fill_line(image_info_t *img, unsigned int entry, const image_line_t *lines, unsigned int num)
+{
+    unsigned int offset, end, i;
+    uint32_t pc = 0;
+    int32_t line = -1;
+
+    if (!img || !img->line_ent || entry >= img->fn_cnt) {
+        return -1;
+    }
+
+    offset = img->end;
+    for (i = 0; i < num; i++) {
+        int32_t delta = lines[i].line - line;
+
+        // worst case: two varint of 5 bytes
+        if (offset + 10 > img->size || lines[i].pc < pc) {
+            return -1;
+        }
+        offset += image_line_put(img->base + offset, lines[i].pc - pc);
+        offset += image_line_put(img->base + offset, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+
+        pc = lines[i].pc;
+        line = lines[i].line;
+    }
+
+    end = SIZE_ALIGN_8(offset + 2);
+    if (end > img->size) {
+        return -1;
+    }
+
+    image_write_uint32(img, img->line_ent + entry * 4, img->end);
+
+    // end pair, and padding fill with zero
+    image_write_zero(img, offset, end - offset);
+    img->end = end;
+
+    return 0;
+}
+
+/*
+ * return: source line (from 0) of the code at pc, -1: unknown
+ */
+int image_get_line(image_info_t *img, int index, unsigned int pc)
+{
+    unsigned int offset;
+    uint32_t entry, at = 0;
+    int32_t line = -1;
+
+    if (!img || !img->line_ent || index < 0 || (unsigned)index >= img->fn_cnt) {
+        return -1;
+    }
+
+    image_read_uint32(img, img->line_ent + index * 4, &entry);
+    if (!entry || entry >= img->end) {
+        return -1;
+    }
+
+    offset = entry;
+    while (1) {
+        uint32_t d_pc, d_line;
+        int n;
+
+        if (0 == (n = image_line_get(img->base + offset, img->end - offset, &d_pc))) {
+            return -1;
+        }
+        offset += n;
+        if (0 == (n = image_line_get(img->base + offset, img->end - offset, &d_line))) {
+            return -1;
+        }
+        offset += n;
+
+        if (d_pc == 0 && d_line == 0) {
+            break;
+        }
+
+        at += d_pc;
+        if (at > pc) {
+            break;
+        }
+        line += (int32_t)(d_line >> 1) ^ -(int32_t)(d_line & 1);
+    }
+
+    return line;
+}
+
 double *image_number_entry(image_info_t *img)
 {
     if (!img) {
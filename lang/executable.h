@@ -30,6 +30,8 @@
 #define EXEC_FL_BE     1
 #define EXEC_FL_64     2
 
+#define EXEC_FUNC_LAZY 0x80     // mark in high byte of code size, code is executable_lazy_t
+
 typedef struct executable_t {
     uint16_t  string_max;
     uint16_t  string_num;
@@ -44,12 +46,63 @@ typedef struct executable_t {
     intptr_t *string_map;
     uint8_t **func_map;
 
+    uint16_t *number_index;     // hash index of number_map, size: number_max * 2
+    uint16_t *string_index;     // hash index of string_map, size: string_max * 2
+
     uint32_t  main_code_end;
     uint32_t  func_code_end;
 
     uint8_t  *code;
+
+    // compile cache: compiled main code of source text, evicted by LRU
+    uint32_t  cache_size;
+    uint32_t  cache_used;
+    uint32_t  cache_tick;
+    uint32_t  cache_pending;    // offset of entry in building, or cache_size
+    uint8_t  *cache;
 } executable_t;
 
+/* cache entry:
+ *        +--------------+
+ *        | head         |
+ *        +--------------+
+ *        | source text  |  text_len + 1, align 8
+ *        +--------------+
+ *        | main code 0  |  FUNC_HEAD_SIZE + code size
+ *        +--------------+
+ *        |     ...      |
+ */
+typedef struct executable_cache_t {
+    uint32_t hash;
+    uint32_t tick;              // last used, for LRU
+    uint32_t size;              // whole entry size
+    uint32_t text_len;
+    uint16_t seg_num;           // main code segment number
+    uint16_t stamp;             // set by user, to check the entry still valid
+} executable_cache_t;
+
+/* Function to be compiled on first call, see compile_lazy:
+ *   src, size: source of function, from "def" to the end of body
+ *   vars:      number of main variables visible to the function
+ *   id:        function id, its entry be replaced by the compiled one
+ *   consts:    number of main constants visible to the function, follow it
+ */
+typedef struct executable_lazy_t {
+    const char *src;
+    uint8_t    *entry;          // compiled function, NULL before the first call
+    uint32_t    size;
+    uint16_t    vars;
+    uint16_t    id;
+    uint16_t    consts;
+} executable_lazy_t;
+
+typedef struct executable_lazy_const_t {
+    const char *str;            // value of string, as symbol
+    double      num;            // value of number
+    uint8_t     id;             // main variable hold the constant
+    uint8_t     type;           // type of value, as type of expression; 0: read only variable
+} executable_lazy_const_t;
+
 typedef struct image_info_t {
     int8_t      error;
     uint8_t     addr_size;
@@ -62,13 +115,30 @@ typedef struct image_info_t {
     uint32_t    num_cnt, num_ent;
     uint32_t    str_cnt, str_ent;
     uint32_t    fn_cnt, fn_ent;
+    uint32_t    line_ent;       // line map section, 0: not present
 
     uint8_t    *base;
 } image_info_t;
 
+/* line map section:
+ *        +--------------+
+ *        | table offset |  4 * fn_cnt, 0: function has no table
+ *        +--------------+
+ *        | table 0      |  pairs of varint: pc delta, zigzag line delta
+ *        +--------------+  end with pair (0, 0)
+ *        |     ...      |
+ *
+ * Delta of the first pair is from pc 0 and line -1, so the pair (0, 0)
+ * never appear in table, pc of pairs are increasing.
+ */
+typedef struct image_line_t {
+    uint32_t pc;
+    int32_t  line;
+} image_line_t;
+
 
 int executable_init(executable_t *exe, void *memory, int size,
-                    int number_max, int string_max, int func_max, int code_max);
+                    int number_max, int string_max, int func_max, int code_max, int cache_max);
 
 static inline
 void executable_main_clr(executable_t *exe)
@@ -80,6 +150,9 @@ int executable_func_set_head(void *buf, uint8_t vc, uint8_t ac, uint32_t code_si
 int executable_func_get_head(void *buf, uint8_t *vc, uint8_t *ac, uint32_t *code_size, uint16_t *stack_size, int *closure);
 int executable_main_add(executable_t *exe, void *code, uint16_t size, uint8_t vc, uint8_t ac, uint16_t stack_size, int closure);
 int executable_func_add(executable_t *exe, void *code, uint16_t size, uint8_t vc, uint8_t ac, uint16_t stack_size, int closure);
+int executable_lazy_add(executable_t *exe, const char *src, uint32_t size, uint16_t vars,
+                        const executable_lazy_const_t *consts, int const_num);
+void executable_lazy_resolve(executable_t *exe, uint8_t *entry, uint8_t *to);
 
 static inline
 uint8_t executable_func_get_var_cnt(const uint8_t *entry) {
@@ -98,7 +171,7 @@ uint16_t executable_func_get_stack_high(const uint8_t *entry) {
 
 static inline
 uint32_t executable_func_get_code_size(const uint8_t *entry) {
-    return (entry[4] * 0x1000000 + entry[5] * 0x10000 + entry[6] * 0x100 + entry[7]);
+    return ((entry[4] & 0x7F) * 0x1000000 + entry[5] * 0x10000 + entry[6] * 0x100 + entry[7]);
 }
 
 static inline
@@ -111,13 +184,50 @@ int executable_func_is_closure(const uint8_t *entry) {
     return (entry[2] & 0x80) == 0x80;
 }
 
+static inline
+int executable_func_is_lazy(const uint8_t *entry) {
+    return (entry[4] & EXEC_FUNC_LAZY) == EXEC_FUNC_LAZY;
+}
+
+static inline
+void executable_lazy_get(const uint8_t *entry, executable_lazy_t *lazy) {
+    memcpy(lazy, entry + FUNC_HEAD_SIZE, sizeof(executable_lazy_t));
+}
+
+static inline
+void executable_lazy_const_get(const uint8_t *entry, int i, executable_lazy_const_t *c) {
+    memcpy(c, entry + FUNC_HEAD_SIZE + sizeof(executable_lazy_t) + sizeof(executable_lazy_const_t) * i,
+           sizeof(executable_lazy_const_t));
+}
+
 int executable_number_find_add(executable_t *exe, double n);
 int executable_string_find_add(executable_t *exe, intptr_t s);
 
+executable_cache_t *executable_cache_find(executable_t *exe, const char *text);
+void executable_cache_remove(executable_t *exe, executable_cache_t *ent);
+void executable_cache_clr(executable_t *exe);
+int  executable_cache_begin(executable_t *exe, const char *text);
+int  executable_cache_append(executable_t *exe, const uint8_t *entry);
+void executable_cache_commit(executable_t *exe, uint16_t stamp);
+void executable_cache_abort(executable_t *exe);
+
+static inline
+const uint8_t *executable_cache_segment(executable_cache_t *ent) {
+    return (const uint8_t *)(ent + 1) + SIZE_ALIGN_8(ent->text_len + 1);
+}
+
+static inline
+const uint8_t *executable_cache_segment_next(const uint8_t *seg) {
+    return seg + FUNC_HEAD_SIZE + executable_func_get_code_size(seg);
+}
+
 int image_init(image_info_t *img, void *mem_ptr, int mem_size, int byte_order, int nc, int sc, int fc);
 int image_load(image_info_t *img, uint8_t *input, int size);
 int image_fill_data(image_info_t *img, unsigned int nc, double *nv, unsigned int sc, intptr_t *sv);
 int image_fill_code(image_info_t *img, unsigned int entry, uint8_t vc, uint8_t ac, uint16_t stack_need, int closure, uint8_t *code, unsigned int size);
+int image_line_init(image_info_t *img);
+int image_fill_line(image_info_t *img, unsigned int entry, const image_line_t *lines, unsigned int num);
+int image_get_line(image_info_t *img, int index, unsigned int pc);
 double *image_number_entry(image_info_t *img);
 double image_get_number(image_info_t *img, int index);
 const char *image_get_string(image_info_t *img, int index);
@@ -31,25 +31,79 @@
 
 #define MAGIC_BYTE(x) (*((uint8_t *)(x)))
 #define ADDR_VALUE(x) (*((void **)(x)))
+#define QUEUE_NEXT(x) (((void **)(x))[1])
+
+// Object is not moved: had be copied to new space, or not in collected space
+static inline int gc_is_kept(env_t *env, void *p) {
+    if (env->gc_young) {
+        return !heap_is_owned(env->gc_young, p);
+    } else {
+        return heap_is_owned(env->heap, p);
+    }
+}
+
+static inline int gc_is_young(env_t *env, void *p) {
+    return env->gc_young && heap_is_owned(env->heap, p);
+}
+
+// In minor gc, object is promoted to old space when it is old enough.
+// Space of copy is reserved by the gc policy, failure is only reported,
+// the object is left in place.
+static inline void *gc_alloc(env_t *env, void *src, int size) {
+    void *dup;
+
+    if (env->gc_young && (*env_heap_age(src) + 1) >= DEF_GC_PROMOTE_AGE) {
+        dup = heap_alloc(env->old, size);
+    } else {
+        dup = heap_alloc(env->heap, size);
+    }
+    if (!dup) {
+        env_set_error(env, ERR_NotEnoughMemory);
+    }
+    return dup;
+}
+
+static inline void gc_age(env_t *env, void *dup, void *src) {
+    *env_heap_age(dup) = gc_is_young(env, dup) ? *env_heap_age(src) + 1 : 0;
+}
+
+// In incremental gc, copied object is gray until it be scanned, its source
+// in from space (forward address, next) is linked in the scan queue
+static inline void gc_enqueue(env_t *env, void *src, void *dup) {
+    if (env->gc_cycle) {
+        *env_heap_age(dup) |= GC_AGE_GRAY;
+        QUEUE_NEXT(src) = NULL;
+        if (env->gc_queue_tail) {
+            QUEUE_NEXT(env->gc_queue_tail) = src;
+        } else {
+            env->gc_queue_head = src;
+        }
+        env->gc_queue_tail = src;
+    }
+}
 
 static inline scope_t *scope_gc_dup(void *env, scope_t *scope) {
     scope_t *dup;
     val_t   *buf = NULL;
 
-    dup = env_heap_alloc(env, scope_mem_space(scope));
+    dup = gc_alloc(env, scope, scope_mem_space(scope));
+    if (!dup) {
+        return NULL;
+    }
     buf = (val_t *)(dup + 1);
 
     //printf("%s: free %d\n", __func__, heap->free);
     memcpy(dup, scope, sizeof(scope_t));
     memcpy(buf, scope->var_buf, sizeof(val_t) * scope->num);
     dup->var_buf = buf;
+    gc_age(env, dup, scope);
 
     return dup;
 }
 
-static inline void scope_gc_scan(void *env, scope_t *scope) {
+static inline int scope_gc_scan(void *env, scope_t *scope) {
     scope->super = gc_scope_copy(env, scope->super);
-    gc_types_copy(env, scope->num, scope->var_buf);
+    return gc_is_young(env, scope->super) | gc_types_copy(env, scope->num, scope->var_buf);
 }
 
 static inline object_t *object_gc_dup(void *env, object_t *obj)
@@ -59,7 +113,10 @@ static inline object_t *object_gc_dup(void *env, object_t *obj)
     val_t    *vals;
 
     //dup = heap_alloc(heap, sizeof(scope_t) + sizeof(val_t) * scope->num);
-    dup = env_heap_alloc(env, object_mem_space(obj));
+    dup = gc_alloc(env, obj, object_mem_space(obj));
+    if (!dup) {
+        return NULL;
+    }
     keys = (intptr_t *) (dup + 1);
     vals = (val_t *)(keys + obj->prop_size);
 
@@ -69,13 +126,14 @@ static inline object_t *object_gc_dup(void *env, object_t *obj)
     memcpy(vals, obj->vals, sizeof(val_t) * obj->prop_num);
     dup->keys = keys;
     dup->vals = vals;
+    gc_age(env, dup, obj);
 
     return dup;
 }
 
-static inline void object_gc_scan(void *env, object_t *obj)
+static inline int object_gc_scan(void *env, object_t *obj)
 {
-    gc_types_copy(env, obj->prop_num, obj->vals);
+    return gc_types_copy(env, obj->prop_num, obj->vals);
 }
 
 static inline array_t *array_gc_dup(void *env, array_t *a)
@@ -83,30 +141,38 @@ static inline array_t *array_gc_dup(void *env, array_t *a)
     array_t *dup;
     val_t   *vals;
 
-    dup = env_heap_alloc(env, array_mem_space(a));
+    dup = gc_alloc(env, a, array_mem_space(a));
+    if (!dup) {
+        return NULL;
+    }
     vals = (val_t *)(dup + 1);
 
     //printf("%s: free %d\n", __func__, heap->free);
     memcpy(dup, a, sizeof(array_t));
-    memcpy(vals, array_values(a), sizeof(val_t) * array_length(a));
+    memcpy(vals + a->elem_bgn, array_values(a), sizeof(val_t) * array_length(a));
     dup->elems = vals;
+    gc_age(env, dup, a);
 
     return dup;
 }
 
-static inline void array_gc_scan(void *env, array_t *a)
+static inline int array_gc_scan(void *env, array_t *a)
 {
-    gc_types_copy(env, array_length(a), array_values(a));
+    return gc_types_copy(env, array_length(a), array_values(a));
 }
 
 static inline intptr_t string_gc_dup(void *env, intptr_t str)
 {
     int size = string_mem_space(str);
-    void *dup = env_heap_alloc(env, size);
+    void *dup = gc_alloc(env, (void *)str, size);
 
+    if (!dup) {
+        return 0;
+    }
     //printf("%s: free %d, %d, %s\n", __func__, heap->free, size, (char *)(str + 3));
     //printf("[str size: %d, '%s']", size, (char *)str + 3);
     memcpy(dup, (void*)str, size);
+    gc_age(env, dup, (void *)str);
     //printf("[dup size: %d, '%s']", string_mem_space((intptr_t)dup), dup + 3);
 
     return (intptr_t) dup;
@@ -114,32 +180,40 @@ static inline intptr_t string_gc_dup(void *env, intptr_t str)
 
 static inline function_t *function_gc_dup(void *env, function_t *func)
 {
-    function_t *dup = env_heap_alloc(env, function_mem_space(func));
+    function_t *dup = gc_alloc(env, func, function_mem_space(func));
 
+    if (!dup) {
+        return NULL;
+    }
     //printf("%s: free %d\n", __func__, heap->free);
     memcpy(dup, (void*)func, sizeof(function_t));
+    gc_age(env, dup, func);
 
     return dup;
 }
 
-static inline void function_gc_scan(void *env, function_t *func)
+static inline int function_gc_scan(void *env, function_t *func)
 {
     func->super = gc_scope_copy(env, func->super);
+    return gc_is_young(env, func->super);
 }
 
 static inline object_t *gc_object_copy(void *env, object_t *obj)
 {
     object_t *dup;
 
-    if (!obj || env_is_heap_memory(env, obj)) {
+    if (!obj || gc_is_kept(env, obj)) {
         return obj;
     }
 
     if (MAGIC_BYTE(obj) != MAGIC_OBJECT) {
         return ADDR_VALUE(obj);
     }
-    dup = object_gc_dup(env, obj);
+    if (!(dup = object_gc_dup(env, obj))) {
+        return obj;
+    }
     ADDR_VALUE(obj) = dup;
+    gc_enqueue(env, obj, dup);
 
     return dup;
 }
@@ -148,22 +222,25 @@ static inline array_t *gc_array_copy(void *env, array_t *a)
 {
     array_t *dup;
 
-    if (!a || env_is_heap_memory(env, a)) {
+    if (!a || gc_is_kept(env, a)) {
         return a;
     }
 
     if (MAGIC_BYTE(a) != MAGIC_ARRAY) {
         return ADDR_VALUE(a);
     }
-    dup = array_gc_dup(env, a);
+    if (!(dup = array_gc_dup(env, a))) {
+        return a;
+    }
     ADDR_VALUE(a) = dup;
+    gc_enqueue(env, a, dup);
 
     return dup;
 }
 
 static inline intptr_t gc_string_copy(void *env, intptr_t str)
 {
-    if (!str || env_is_heap_memory(env, (void*)str)) {
+    if (!str || gc_is_kept(env, (void*)str)) {
         return (intptr_t) str;
     }
 
@@ -171,15 +248,18 @@ static inline intptr_t gc_string_copy(void *env, intptr_t str)
         return (intptr_t) ADDR_VALUE(str);
     } else {
         intptr_t dup = string_gc_dup(env, str);
-        ADDR_VALUE(str) = (void *)dup;
 
+        if (!dup) {
+            return str;
+        }
+        ADDR_VALUE(str) = (void *)dup;
         return dup;
     }
 }
 
 static inline function_t *gc_function_copy(void *env, function_t *func)
 {
-    if (!func || env_is_heap_memory(env, func)) {
+    if (!func || gc_is_kept(env, func)) {
         return func;
     }
 
@@ -187,16 +267,168 @@ static inline function_t *gc_function_copy(void *env, function_t *func)
         return ADDR_VALUE(func);
     } else {
         function_t *dup = function_gc_dup(env, func);
+
+        if (!dup) {
+            return func;
+        }
         ADDR_VALUE(func) = dup;
+        gc_enqueue(env, func, dup);
         return dup;
     }
 }
 
+// Compact gc: objects are marked in bitmap, forward address is the offset
+// of marked bytes before it. Members moved out to a buffer (with header) are
+// not included in the space of object, which is marked separately
+static inline int gc_compact_is_inline(void *p) {
+    if (MAGIC_BYTE(p) == MAGIC_OBJECT) {
+        return ((object_t *)p)->keys == (intptr_t *)((object_t *)p + 1);
+    } else {
+        return ((array_t *)p)->elems == (val_t *)((array_t *)p + 1);
+    }
+}
+
+static inline gc_space_t *gc_compact_space(void *p) {
+    if (MAGIC_BYTE(p) == MAGIC_OBJECT) {
+        return (gc_space_t *)((object_t *)p)->keys - 1;
+    } else {
+        return (gc_space_t *)((array_t *)p)->elems - 1;
+    }
+}
+
+static int gc_compact_size(uint8_t *p)
+{
+    switch(*p) {
+    case MAGIC_STRING:  return string_mem_space((intptr_t)p);
+    case MAGIC_FUNCTION:return function_mem_space((function_t *)p);
+    case MAGIC_SCOPE:   return scope_mem_space((scope_t *)p);
+    case MAGIC_OBJECT:  return gc_compact_is_inline(p) ? object_mem_space((object_t *)p) : SIZE_ALIGN(sizeof(object_t));
+    case MAGIC_ARRAY:   return gc_compact_is_inline(p) ? array_mem_space((array_t *)p) : SIZE_ALIGN(sizeof(array_t));
+    case MAGIC_SPACE:   return ((gc_space_t *)p)->size;
+    default:            return 0;
+    }
+}
+
+static inline int gc_compact_is_marked(env_t *env, void *p) {
+    int n = (p - env->heap->base) >> GC_MARK_SHIFT;
+
+    return env->gc_mark[n / 32] & (1u << (n % 32));
+}
+
+static void gc_compact_mark_range(env_t *env, void *p, int size)
+{
+    int n = (p - env->heap->base) >> GC_MARK_SHIFT;
+    int end = n + (size >> GC_MARK_SHIFT);
+
+    while (n < end) {
+        int bits = 32 - n % 32 < end - n ? 32 - n % 32 : end - n;
+        uint32_t mask = bits < 32 ? ((1u << bits) - 1) << (n % 32) : 0xffffffff;
+
+        env->gc_mark[n / 32] |= mask;
+        n += bits;
+    }
+}
+
+// Offset of first marked (or unmarked) bytes from off, or free of heap if not found
+static int gc_compact_next(env_t *env, int off, int marked)
+{
+    int n = off >> GC_MARK_SHIFT;
+    int end = env->heap->free >> GC_MARK_SHIFT;
+
+    while (n < end) {
+        uint32_t bits = env->gc_mark[n / 32];
+
+        bits = (marked ? bits : ~bits) >> (n % 32);
+        if (bits) {
+            n += __builtin_ctz(bits);
+            break;
+        }
+        n = (n / 32 + 1) * 32;
+    }
+
+    return n < end ? n << GC_MARK_SHIFT : env->heap->free;
+}
+
+static inline void *gc_compact_forward(env_t *env, void *p) {
+    int n = (p - env->heap->base) >> GC_MARK_SHIFT;
+    uint32_t bits = env->gc_mark[n / 32] & ((1u << (n % 32)) - 1);
+
+    return env->heap->base + env->gc_forward[n / 32] + (__builtin_popcount(bits) << GC_MARK_SHIFT);
+}
+
+static void gc_compact_mark(env_t *env, void *p)
+{
+    if (gc_compact_is_marked(env, p)) {
+        return;
+    }
+
+    gc_compact_mark_range(env, p, gc_compact_size(p));
+    if ((MAGIC_BYTE(p) == MAGIC_OBJECT || MAGIC_BYTE(p) == MAGIC_ARRAY) && !gc_compact_is_inline(p)) {
+        gc_space_t *space = gc_compact_space(p);
+
+        gc_compact_mark_range(env, space, space->size);
+    }
+
+    if (MAGIC_BYTE(p) == MAGIC_STRING) {
+        return;
+    }
+
+    if (env->gc_stack_num < env->gc_stack_max) {
+        env->gc_stack[env->gc_stack_num++] = p;
+    } else {
+        env->gc_overflow = 1;
+    }
+}
+
+// Mark the object in mark phase, return its forward address in update phase
+static void *gc_compact_ref(env_t *env, void *p)
+{
+    if (!p || !heap_is_owned(env->heap, p)) {
+        return p;
+    }
+
+    if (env->gc_marking) {
+        gc_compact_mark(env, p);
+        return p;
+    } else {
+        return gc_compact_forward(env, p);
+    }
+}
+
+static void gc_compact_types(env_t *env, int n, val_t *p)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        val_t *v = p + i;
+
+        if (val_is_heap_string(v)) {
+            val_set_heap_string(v, (intptr_t)gc_compact_ref(env, (void *)val_2_intptr(v)));
+        } else
+        if (val_is_script(v)) {
+            val_set_script(v, (intptr_t)gc_compact_ref(env, (void *)val_2_intptr(v)));
+        } else
+        if (val_is_object(v)) {
+            val_set_object(v, (intptr_t)gc_compact_ref(env, (void *)val_2_intptr(v)));
+        } else
+        if (val_is_array(v)) {
+            val_set_array(v, (intptr_t)gc_compact_ref(env, (void *)val_2_intptr(v)));
+        } else
+        if (val_is_foreign(v) && env->gc_marking) {
+            foreign_keep(val_2_intptr(v));
+        }
+    }
+}
+
 scope_t *gc_scope_copy(void *env, scope_t *scope)
 {
     scope_t *dup;
 
-    if (!scope || env_is_heap_memory(env, scope)) {
+    if (((env_t *)env)->gc_compact) {
+        return gc_compact_ref(env, scope);
+    }
+
+    if (!scope || gc_is_kept(env, scope)) {
         return scope;
     }
 
@@ -204,15 +436,24 @@ scope_t *gc_scope_copy(void *env, scope_t *scope)
         return ADDR_VALUE(scope);
     }
 
-    dup = scope_gc_dup(env, scope);
+    if (!(dup = scope_gc_dup(env, scope))) {
+        return scope;
+    }
     ADDR_VALUE(scope) = dup;
+    gc_enqueue(env, scope, dup);
 
     return dup;
 }
 
-void gc_types_copy(void *env, int n, val_t *p)
+// return: 1 if any of values refer to young object, in minor gc
+int gc_types_copy(void *env, int n, val_t *p)
 {
-    int i = 0;
+    int i = 0, young = 0;
+
+    if (((env_t *)env)->gc_compact) {
+        gc_compact_types(env, n, p);
+        return 0;
+    }
 
     while (i < n) {
         val_t *v = p + i;
@@ -229,12 +470,43 @@ void gc_types_copy(void *env, int n, val_t *p)
         } else
         if (val_is_array(v)) {
             val_set_array(v, (intptr_t)gc_array_copy(env, (array_t *)val_2_intptr(v)));
-        } else
-        if (val_is_foreign(v)) {
-            foreign_keep(val_2_intptr(v));
+        } else {
+            if (val_is_foreign(v)) {
+                foreign_keep(val_2_intptr(v));
+            }
+            i++;
+            continue;
         }
+        young |= gc_is_young(env, (void *)val_2_intptr(v));
         i++;
     }
+
+    return young;
+}
+
+// Scan members of object, return: memory space of it, 0 if it is unknown
+static int gc_scan_one(void *env, uint8_t *p, int *young)
+{
+    switch(*p) {
+    case MAGIC_STRING:
+        *young = 0;
+        return string_mem_space((intptr_t)p);
+    case MAGIC_FUNCTION:
+        *young = function_gc_scan(env, (function_t *)p);
+        return function_mem_space((function_t *)p);
+    case MAGIC_SCOPE:
+        *young = scope_gc_scan(env, (scope_t *)p);
+        return scope_mem_space((scope_t *)p);
+    case MAGIC_OBJECT:
+        *young = object_gc_scan(env, (object_t *)p);
+        return object_mem_space((object_t *)p);
+    case MAGIC_ARRAY:
+        *young = array_gc_scan(env, (array_t *)p);
+        return array_mem_space((array_t *)p);
+    default:
+        *young = 0;
+        return 0;
+    }
 }
 
 void gc_scan(void *env)
@@ -244,46 +516,195 @@ void gc_scan(void *env)
     int      scan = 0;
 
     while(scan < heap->free) {
-        uint8_t magic = base[scan];
+        int young, size = gc_scan_one(env, base + scan, &young);
 
-        switch(magic) {
-        case MAGIC_STRING:
-            scan += string_mem_space((intptr_t)(base + scan));
+        if (!size) {
             break;
-        case MAGIC_FUNCTION: {
-            function_t *func = (function_t *)(base + scan);
-            scan += function_mem_space(func);
+        }
+        scan += size;
+    }
+}
 
-            function_gc_scan(env, func);
+// Scan remembered old objects, keep the one still refer to young objects
+void gc_scan_remembered(void *env)
+{
+    env_t *e = env;
+    int i, n = e->remember_num;
 
-            break;
-            }
-        case MAGIC_SCOPE: {
-            scope_t *scope = (scope_t *) (base + scan);
-            scan += scope_mem_space(scope);
+    for (i = 0; i < n; i++) {
+        *env_heap_age(e->remember[i]) &= ~GC_AGE_REMEMBERED;
+    }
 
-            scope_gc_scan(env, scope);
+    e->remember_num = 0;
+    for (i = 0; i < n; i++) {
+        void *obj = e->remember[i];
+        int young;
 
-            break;
+        if (*env_heap_age(obj) & GC_AGE_REMEMBERED) {
+            continue;
+        }
+
+        gc_scan_one(env, obj, &young);
+        if (young) {
+            env_heap_remember(e, obj);
+        }
+    }
+}
+
+// Scan objects copied to young space, and promoted to old space from old_scan
+void gc_scan_young(void *env, int old_scan)
+{
+    env_t   *e = env;
+    heap_t  *young = e->heap;
+    heap_t  *old = e->old;
+    int      scan = 0;
+
+    while (scan < young->free || old_scan < old->free) {
+        while (scan < young->free) {
+            int refer, size = gc_scan_one(env, (uint8_t *)young->base + scan, &refer);
+
+            if (!size) {
+                return;
             }
-        case MAGIC_OBJECT: {
-            object_t *obj = (object_t *) (base + scan);
-            scan += object_mem_space(obj);
+            scan += size;
+        }
 
-            object_gc_scan(env, obj);
+        while (old_scan < old->free) {
+            uint8_t *p = (uint8_t *)old->base + old_scan;
+            int refer, size = gc_scan_one(env, p, &refer);
 
-            break;
+            if (!size) {
+                return;
+            }
+            if (refer) {
+                env_heap_remember(e, p);
             }
-        case MAGIC_ARRAY: {
-            array_t *array= (array_t*) (base + scan);
-            scan += array_mem_space(array);
+            old_scan += size;
+        }
+    }
+}
+
+void gc_scan_gray(void *env, void *obj)
+{
+    int young;
+
+    *env_heap_age(obj) &= ~GC_AGE_GRAY;
+    gc_scan_one(env, obj, &young);
+}
+
+// Scan gray objects in queue, until budget bytes scanned, return: 0 if queue empty
+int gc_scan_slice(void *env, int budget)
+{
+    env_t *e = env;
+
+    while (e->gc_queue_head && budget > 0) {
+        void *src = e->gc_queue_head;
+        uint8_t *obj = ADDR_VALUE(src);
+
+        e->gc_queue_head = QUEUE_NEXT(src);
+        if (!e->gc_queue_head) {
+            e->gc_queue_tail = NULL;
+        }
+
+        if (*env_heap_age(obj) & GC_AGE_GRAY) {
+            int young;
+
+            *env_heap_age(obj) &= ~GC_AGE_GRAY;
+            budget -= gc_scan_one(env, obj, &young);
+        }
+    }
+
+    return e->gc_queue_head != NULL;
+}
+
+void gc_compact_mark_begin(void *env)
+{
+    env_t  *e = env;
+    heap_t *heap = e->heap;
+
+    memset(e->gc_mark, 0, sizeof(uint32_t) * ((heap->free + GC_MARK_SPACE - 1) / GC_MARK_SPACE));
+    e->gc_stack = heap_free_addr(heap);
+    e->gc_stack_num = 0;
+    e->gc_stack_max = heap_free_size(heap) / sizeof(void *);
+    e->gc_overflow = 0;
+}
+
+// Scan objects in mark stack, and the marked objects in heap again if the
+// stack had been overflow, then compute the forward offset of each mark word
+void gc_compact_mark_end(void *env)
+{
+    env_t  *e = env;
+    heap_t *heap = e->heap;
+    int i, n, off, young;
 
-            array_gc_scan(env, array);
+    while (1) {
+        while (e->gc_stack_num) {
+            gc_scan_one(env, e->gc_stack[--e->gc_stack_num], &young);
+        }
 
+        if (!e->gc_overflow) {
             break;
+        }
+
+        e->gc_overflow = 0;
+        off = 0;
+        while ((off = gc_compact_next(e, off, 1)) < heap->free) {
+            uint8_t *p = (uint8_t *)heap->base + off;
+
+            off += gc_compact_size(p);
+            gc_scan_one(env, p, &young);
+            while (e->gc_stack_num) {
+                gc_scan_one(env, e->gc_stack[--e->gc_stack_num], &young);
             }
-        default: break;
         }
     }
+
+    n = (heap->free + GC_MARK_SPACE - 1) / GC_MARK_SPACE;
+    for (i = 0, off = 0; i < n; i++) {
+        e->gc_forward[i] = off;
+        off += __builtin_popcount(e->gc_mark[i]) << GC_MARK_SHIFT;
+    }
 }
 
+// Update members of marked objects, roots should be updated before;
+// then marked runs of heap are moved down to their forward address
+void gc_compact_update(void *env)
+{
+    env_t  *e = env;
+    heap_t *heap = e->heap;
+    int off = 0, end, free = 0, young;
+
+    while ((off = gc_compact_next(e, off, 1)) < heap->free) {
+        uint8_t *p = (uint8_t *)heap->base + off;
+        uint8_t *dst = gc_compact_forward(e, p);
+
+        off += gc_compact_size(p);
+        gc_scan_one(env, p, &young);
+
+        if (*p == MAGIC_SCOPE) {
+            ((scope_t *)p)->var_buf = (val_t *)((scope_t *)dst + 1);
+        } else
+        if (*p == MAGIC_OBJECT) {
+            object_t *o = (object_t *)p;
+
+            o->keys = gc_compact_is_inline(o) ? (intptr_t *)((object_t *)dst + 1)
+                    : (intptr_t *)((gc_space_t *)gc_compact_forward(e, gc_compact_space(o)) + 1);
+            o->vals = (val_t *)(o->keys + o->prop_size);
+        } else
+        if (*p == MAGIC_ARRAY) {
+            array_t *a = (array_t *)p;
+
+            a->elems = gc_compact_is_inline(a) ? (val_t *)((array_t *)dst + 1)
+                     : (val_t *)((gc_space_t *)gc_compact_forward(e, gc_compact_space(a)) + 1);
+        }
+    }
+
+    off = 0;
+    while ((off = gc_compact_next(e, off, 1)) < heap->free) {
+        end = gc_compact_next(e, off, 0);
+        memmove(heap->base + free, heap->base + off, end - off);
+        free += end - off;
+        off = end;
+    }
+    heap->free = free;
+}
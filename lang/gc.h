@@ -23,8 +23,16 @@
 #include "scope.h"
 
 void gc_scan(void *env);
+void gc_scan_young(void *env, int old_scan);
+void gc_scan_remembered(void *env);
+void gc_scan_gray(void *env, void *obj);
+int  gc_scan_slice(void *env, int budget);
 
-void     gc_types_copy(void *env, int n, val_t *p);
+void gc_compact_mark_begin(void *env);
+void gc_compact_mark_end(void *env);
+void gc_compact_update(void *env);
+
+int      gc_types_copy(void *env, int n, val_t *p);
 scope_t *gc_scope_copy(void *env, scope_t *scope);
 
 #endif /* __LANG_GC_INC__ */
@@ -0,0 +1,72 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+
+
+#ifndef __LANG_HASH_INC__
+#define __LANG_HASH_INC__
+
+#include "def.h"
+
+/*
+ * Index tables used by constant pools, variable maps and native table.
+ * A slot hold (id + 1) of the entry, 0 mean empty slot.
+ * The table size is always double of the entry capacity, so linear probing
+ * can always find an empty slot.
+ */
+
+static inline uint32_t hash_ptr(intptr_t p) {
+    uint64_t h = (uint64_t)p;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+static inline uint32_t hash_number(double d) {
+    uint64_t bits;
+
+    // 0 and -0 are equal
+    if (d == 0) {
+        return 0;
+    }
+    memcpy(&bits, &d, sizeof(bits));
+
+    return hash_ptr((intptr_t)bits);
+}
+
+static inline uint32_t hash_text(const char *s, uint32_t *len) {
+    const char *p = s;
+    uint32_t h = 2166136261u;
+
+    while (*p) {
+        h = (h ^ (uint8_t)*p++) * 16777619u;
+    }
+    if (len) *len = p - s;
+
+    return h;
+}
+
+static inline uint32_t hash_next(uint32_t size, uint32_t pos) {
+    return pos + 1 < size ? pos + 1 : 0;
+}
+
+#endif /* __LANG_HASH_INC__ */
@@ -19,6 +19,7 @@
 
 #include "err.h"
 #include "val.h"
+#include "hash.h"
 #include "bcode.h"
 #include "parse.h"
 #include "compile.h"
@@ -42,6 +43,16 @@ static inline val_t *interp_var_ref(env_t *env, val_t *reg)
     }
 }
 
+// Write barrier of variable store, reg is the reference
+static inline void interp_var_barrier(env_t *env, val_t *reg, val_t *v)
+{
+    if (env->old || env->gc_cycle) {
+        uint8_t id, generation;
+        val_2_reference(reg, &id, &generation);
+        env_var_barrier(env, generation, v);
+    }
+}
+
 static inline void interp_op(env_t *env, val_opxx_t operate) {
     val_t *reg2 = env_stack_peek(env); // Note: keep in stack, deffence GC!
     val_t *reg1 = reg2 + 1;
@@ -87,8 +98,14 @@ static inline void interp_op_set(env_t *env, val_opxx_t operate) {
     val_t *reg1 = reg2 + 1;
     val_t *lft = interp_var_ref(env, reg1);
     if (lft) {
-        operate(env, lft, reg2, lft);
+        val_t ref = *reg1;
+
+        // operate in stack, as scope may be moved by gc in it
         *reg1 = *lft;
+        operate(env, reg1, reg2, reg1);
+        lft = interp_var_ref(env, &ref);
+        *lft = *reg1;
+        interp_var_barrier(env, &ref, lft);
         env_stack_pop(env);
     } else {
         env_set_error(env, ERR_InvalidLeftValue);
@@ -100,7 +117,9 @@ static inline void interp_prop_op_set(env_t *env, val_opxx_t operate) {
     val_t *reg2 = reg3 + 1;
     val_t *reg1 = reg2 + 1;
 
-    val_prop_opxx(env, reg1, reg2, reg3, reg1, operate);
+    // result in place of key, the object is kept in stack
+    val_prop_opxx(env, reg1, reg2, reg3, reg2, operate);
+    *reg1 = *reg2;
     env_stack_release(env, 2);
 }
 
@@ -109,7 +128,9 @@ static inline void interp_elem_op_set(env_t *env, val_opxx_t operate) {
     val_t *reg2 = reg3 + 1;
     val_t *reg1 = reg2 + 1;
 
-    val_prop_opxx(env, reg1, reg2, reg3, reg1, operate);
+    // result in place of key, the object is kept in stack
+    val_prop_opxx(env, reg1, reg2, reg3, reg2, operate);
+    *reg1 = *reg2;
     env_stack_release(env, 2);
 }
 
@@ -165,6 +186,222 @@ static inline void interp_tle(env_t *env) {
     val_set_boolean(reg1, val_is_le(reg1, reg2));
 }
 
+/*
+ * Typed instructions: operands are proven be number by compiler,
+ * no type check or dispatch is required.
+ */
+static inline void interp_add_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_number(reg1, val_2_double(reg1) + val_2_double(reg2));
+}
+
+static inline void interp_sub_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_number(reg1, val_2_double(reg1) - val_2_double(reg2));
+}
+
+static inline void interp_mul_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_number(reg1, val_2_double(reg1) * val_2_double(reg2));
+}
+
+static inline void interp_tgt_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_boolean(reg1, val_2_double(reg1) > val_2_double(reg2));
+}
+
+static inline void interp_tge_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_boolean(reg1, val_2_double(reg1) >= val_2_double(reg2));
+}
+
+static inline void interp_tlt_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_boolean(reg1, val_2_double(reg1) < val_2_double(reg2));
+}
+
+static inline void interp_tle_num(env_t *env) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    val_set_boolean(reg1, val_2_double(reg1) <= val_2_double(reg2));
+}
+
+// Variable of current scope, NaN or infinity is not changed, as val_inc
+static inline void interp_inc_num(env_t *env, int id, int step, int pre) {
+    val_t *var = env_get_var(env, id, 0);
+    val_t *res = env_stack_push(env);
+
+    if (var && val_is_number(var)) {
+        double d = val_2_double(var);
+
+        val_set_number(var, d + step);
+        val_set_number(res, pre ? d + step : d);
+    } else {
+        val_set_nan(res);
+    }
+}
+
+// Store to variable of current scope, without foreign setter
+static inline void interp_pop_var(env_t *env, int id) {
+    val_t *var = env_get_var(env, id, 0);
+    val_t *val = env_stack_pop(env);
+
+    if (var) {
+        *var = *val;
+        env_var_barrier(env, 0, val);
+    } else {
+        env_set_error(env, ERR_SysError);
+    }
+}
+
+static inline void interp_tin(env_t *env) {
+    val_t *obj = env_stack_pop(env);
+    val_t *key = obj + 1;
+    int in = 0;
+
+    if (val_is_array(obj)) {
+        double d = val_is_number(key) ? val_2_double(key) : -1;
+
+        // Index should be an integer in the range
+        in = d >= 0 && d < array_length((array_t *)val_2_intptr(obj)) && d == (int) d;
+    } else if (val_is_object(obj)) {
+        const char *name = val_2_cstring(key);
+
+        in = name && object_has_prop(env, obj, name);
+    }
+    val_set_boolean(key, in);
+}
+
+static inline void interp_iter(env_t *env) {
+    val_set_number(env_stack_push(env), 0);
+}
+
+static inline const uint8_t *interp_iter_next(env_t *env, int key, int step, const uint8_t *pc) {
+    val_t *cur = env_stack_peek(env);
+    val_t *obj;
+    int i;
+
+    // skip the reference of loop variable
+    if (val_is_reference(cur)) {
+        cur++;
+    }
+    obj = cur + 1;
+    i = val_2_integer(cur);
+
+    if (val_is_object(obj)) {
+        object_iter_t it;
+        const char *name;
+        val_t *v;
+
+        env_read_barrier(env, (void *)val_2_intptr(obj));
+        _object_iter_init(&it, (object_t *)val_2_intptr(obj));
+        it.cur = i;
+        if (object_iter_next(&it, &name, &v)) {
+            val_set_number(cur, it.cur);
+            if (key) {
+                val_set_foreign_string(env_stack_push(env), (intptr_t)name);
+            } else {
+                *env_stack_push(env) = *v;
+            }
+            return pc;
+        }
+    } else if (val_is_array(obj)) {
+        array_t *a = (array_t *)val_2_intptr(obj);
+
+        env_read_barrier(env, a);
+        if (i < array_length(a)) {
+            val_set_number(cur, i + 1);
+            if (key) {
+                val_set_number(env_stack_push(env), i);
+            } else {
+                *env_stack_push(env) = array_values(a)[i];
+            }
+            return pc;
+        }
+    }
+
+    return pc + step;
+}
+
+static inline const uint8_t *interp_case(env_t *env, int step, const uint8_t *pc) {
+    val_t *reg2 = env_stack_pop(env);
+    val_t *reg1 = reg2 + 1;
+
+    if (val_is_equal(reg1, reg2)) {
+        env_stack_pop(env);
+        pc += step;
+    }
+    return pc;
+}
+
+// pc: the switch instruction, return: the target
+static inline const uint8_t *interp_switch_num(env_t *env, const uint8_t *pc) {
+    val_t *v = env_stack_pop(env);
+    int min = (int16_t)(pc[1] * 0x100 + pc[2]);
+    int num = pc[3] * 0x100 + pc[4];
+    int step = bcode_switch_default(pc);
+
+    if (val_is_number(v)) {
+        double d = val_2_double(v);
+
+        // same as TEQ: 0 not equal to -0
+        if (d >= min && d < min + num && val_mk_number((int)d) == *v) {
+            step = bcode_switch_offset(pc, (int)d - min);
+        }
+    }
+
+    return pc + bcode_switch_length(pc) + step;
+}
+
+static inline const uint8_t *interp_switch_hash(env_t *env, const uint8_t *pc) {
+    val_t *v = env_stack_pop(env);
+    const uint8_t *seed = pc + 5, *slot;
+    const char *str = NULL;
+    int step = bcode_switch_default(pc);
+    int id;
+    uint32_t h;
+
+    if (val_is_number(v)) {
+        h = hash_number(val_2_double(v));
+    } else
+    if (NULL != (str = val_2_cstring(v))) {
+        h = hash_text(str, NULL);
+    } else {
+        return pc + bcode_switch_length(pc) + step;
+    }
+
+    slot = bcode_switch_table(pc) + 4 * bcode_switch_slot(h, seed[h & ((1 << pc[2]) - 1)], pc[1]);
+    id = slot[0] * 0x100 + slot[1];
+    if (id != BCODE_SWITCH_NONE) {
+        int hit;
+
+        if (id & BCODE_SWITCH_NUMBER) {
+            hit = !str && val_mk_number(env->exe.number_map[id & ~BCODE_SWITCH_NUMBER]) == *v;
+        } else {
+            const char *s = (const char *)env->exe.string_map[id];
+            hit = str && (str == s || !strcmp(str, s));
+        }
+        if (hit) {
+            step = (int16_t)(slot[2] * 0x100 + slot[3]);
+        }
+    }
+
+    return pc + bcode_switch_length(pc) + step;
+}
+
 static inline void interp_set(env_t *env) {
     val_t *reg2 = env_stack_peek(env);
     val_t *reg1 = reg2 + 1;
@@ -173,6 +410,7 @@ static inline void interp_set(env_t *env) {
 
     if (lft) {
         if (!val_is_foreign(lft)) {
+            interp_var_barrier(env, reg1, reg2);
             *lft = *reg1 = *reg2;
         } else {
             *reg1 = foreign_set(env, lft, reg2);
@@ -450,7 +688,7 @@ static int interp_run(env_t *env, const uint8_t *pc)
         case BC_TLT:        interp_tlt(env); break;
         case BC_TLE:        interp_tle(env); break;
 
-        case BC_TIN:        env_set_error(env, ERR_InvalidByteCode); break;
+        case BC_TIN:        interp_tin(env); break;
 
         case BC_PROP:               interp_prop_get(env);  break;
         case BC_PROP_METH:          interp_prop_meth(env); break;
@@ -520,6 +758,36 @@ static int interp_run(env_t *env, const uint8_t *pc)
         case BC_DICT:       index = (*pc++); index = (index << 8) | (*pc++);
                             interp_object_build(env, index); break;
 
+        case BC_ADD_NUM:    interp_add_num(env); break;
+        case BC_SUB_NUM:    interp_sub_num(env); break;
+        case BC_MUL_NUM:    interp_mul_num(env); break;
+
+        case BC_TGT_NUM:    interp_tgt_num(env); break;
+        case BC_TGE_NUM:    interp_tge_num(env); break;
+        case BC_TLT_NUM:    interp_tlt_num(env); break;
+        case BC_TLE_NUM:    interp_tle_num(env); break;
+
+        case BC_INC_NUM:    interp_inc_num(env, *pc++, 1, 0); break;
+        case BC_INCP_NUM:   interp_inc_num(env, *pc++, 1, 1); break;
+        case BC_DEC_NUM:    interp_inc_num(env, *pc++, -1, 0); break;
+        case BC_DECP_NUM:   interp_inc_num(env, *pc++, -1, 1); break;
+
+        case BC_POP_VAR:    interp_pop_var(env, *pc++); break;
+
+        case BC_CASE:       index = (int8_t) (*pc++); index = (index << 8) | (*pc++);
+                            pc = interp_case(env, index, pc);
+                            break;
+        case BC_SWITCH_NUM: pc = interp_switch_num(env, pc - 1); break;
+        case BC_SWITCH_HASH:pc = interp_switch_hash(env, pc - 1); break;
+
+        case BC_ITER:       interp_iter(env); break;
+        case BC_ITER_KEY:   index = (int8_t) (*pc++); index = (index << 8) | (*pc++);
+                            pc = interp_iter_next(env, 1, index, pc);
+                            break;
+        case BC_ITER_VAL:   index = (int8_t) (*pc++); index = (index << 8) | (*pc++);
+                            pc = interp_iter_next(env, 0, index, pc);
+                            break;
+
         default:            env_set_error(env, ERR_InvalidByteCode);
         }
     }
@@ -532,6 +800,69 @@ static inline void interp_reset_parser_heap(env_t *env, parser_t *psr)
     heap_t *heap = env_heap_get_free((env_t*)env);
 
     heap_init(&psr->heap, heap->base, heap->size);
+    psr->names = NULL;
+}
+
+#define CACHE_STAMP_NATIVE  0x8000
+
+static inline uint16_t interp_cache_stamp(env_t *env, int native_ref)
+{
+    return env->main_var_num | (native_ref ? CACHE_STAMP_NATIVE : 0);
+}
+
+/*
+ * Cached code is valid while the main variables it used are unchanged.
+ * A main variable defined later may shadow the native function referenced.
+ */
+static executable_cache_t *interp_cache_lookup(env_t *env, const char *input)
+{
+    executable_cache_t *ent;
+    int var_num;
+
+    if (!env_is_interactive(env) || !env->exe.cache_size) {
+        return NULL;
+    }
+
+    ent = executable_cache_find(&env->exe, input);
+    if (ent) {
+        var_num = ent->stamp & ~CACHE_STAMP_NATIVE;
+        if ((ent->stamp & CACHE_STAMP_NATIVE) ? var_num == env->main_var_num : var_num <= env->main_var_num) {
+            return ent;
+        }
+        executable_cache_remove(&env->exe, ent);
+    }
+
+    return NULL;
+}
+
+static int interp_cache_execute(env_t *env, executable_cache_t *ent, val_t **v)
+{
+    const uint8_t *seg = executable_cache_segment(ent);
+    int i, n = ent->seg_num;
+
+    for (i = 0; i < n; i++, seg = executable_cache_segment_next(seg)) {
+        executable_main_clr(&env->exe);
+        if (0 != executable_main_add(&env->exe, (void *)executable_func_get_code(seg),
+                                     executable_func_get_code_size(seg),
+                                     executable_func_get_var_cnt(seg),
+                                     executable_func_get_arg_cnt(seg),
+                                     executable_func_get_stack_high(seg),
+                                     executable_func_is_closure(seg))) {
+            return -ERR_NotEnoughMemory;
+        }
+
+        if (0 != interp_run(env, env_main_entry_setup(env, 0, NULL))) {
+            return -env->error;
+        }
+
+        if (env->fp > env->sp) {
+            *v = env_stack_pop(env);
+        } else {
+            *v = NULL;
+        }
+    }
+
+    return 1;
 }
 
 static void parse_callback(void *u, parse_event_t *e)
@@ -560,7 +891,7 @@ int interp_env_init_interactive(env_t *env, void *mem_ptr, int mem_size, void *h
     return env_init(env, mem_ptr, mem_size,
                 heap_ptr, heap_size, stack_ptr, stack_size,
                 exe_num_max, exe_str_max, exe_fn_max,
-                exe_code_max, 1);
+                exe_code_max, ENV_FL_INTERACTIVE | ENV_FL_GC_DEFAULT);
 }
 
 int interp_env_init_interpreter(env_t *env, void *mem_ptr, int mem_size, void *heap_ptr, int heap_size, val_t *stack_ptr, int stack_size)
@@ -583,7 +914,7 @@ int interp_env_init_interpreter(env_t *env, void *mem_ptr, int mem_size, void *h
     return env_init(env, mem_ptr, mem_size,
                 heap_ptr, heap_size, stack_ptr, stack_size,
                 exe_num_max, exe_str_max, exe_fn_max,
-                exe_code_max, 0);
+                exe_code_max, ENV_FL_GC_DEFAULT);
 }
 
 int interp_env_init_image(env_t *env, void *mem_ptr, int mem_size, void *heap_ptr, int heap_size, val_t *stack_ptr, int stack_size, image_info_t *image)
@@ -610,7 +941,7 @@ int interp_env_init_image(env_t *env, void *mem_ptr, int mem_size, void *heap_pt
 
     if (0 != env_init(env, mem_ptr, mem_size,
                     heap_ptr, heap_size, stack_ptr, stack_size,
-                    0, exe_str_max, exe_fn_max, 0, 0)) {
+                    0, exe_str_max, exe_fn_max, 0, ENV_FL_GC_DEFAULT)) {
         return -1;
     }
 
@@ -675,11 +1006,16 @@ int interp_execute_string(env_t *env, const char *input, val_t **v)
     heap_t *heap = env_heap_get_free((env_t*)env);
     parser_t psr;
     compile_t cpl;
+    executable_cache_t *cache;
 
     if (!env || !input || !v) {
         return -1;
     }
 
+    if (NULL != (cache = interp_cache_lookup(env, input))) {
+        return interp_cache_execute(env, cache, v);
+    }
+
     // The free heap can be used for parse and compile process
     parse_init(&psr, input, NULL, heap->base, heap->size);
     parse_set_cb(&psr, parse_callback, NULL);
@@ -691,6 +1027,11 @@ int interp_execute_string(env_t *env, const char *input, val_t **v)
 
     compile_init(&cpl, env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
     if (0 == compile_multi_stmt(&cpl, stmt) && 0 == compile_update(&cpl)) {
+        if (0 == executable_cache_begin(&env->exe, input) &&
+            0 == executable_cache_append(&env->exe, env_get_main_entry(env))) {
+            executable_cache_commit(&env->exe, interp_cache_stamp(env, cpl.native_ref));
+        }
+
         if (0 != interp_run(env, env_main_entry_setup(env, 0, NULL))) {
             //printf("execute error: %d\n", env->error);
             return -env->error;
@@ -709,6 +1050,47 @@ int interp_execute_string(env_t *env, const char *input, val_t **v)
     return 1;
 }
 
+int interp_execute_lazy(env_t *env, const char *input, val_t **v)
+{
+    stmt_t *stmt;
+    heap_t *heap = env_heap_get_free((env_t*)env);
+    parser_t psr;
+    compile_t cpl;
+
+    if (!env || !input || !v || !env_is_interactive(env)) {
+        return -1;
+    }
+
+    // The free heap can be used for parse and compile process
+    parse_init(&psr, input, NULL, heap->base, heap->size);
+    parse_set_cb(&psr, parse_callback, NULL);
+    // Functions of main are compiled from source, their bodies are not parsed
+    psr.lazy = 1;
+    stmt = parse_stmt_multi(&psr);
+    if (!stmt) {
+        return psr.error ? -psr.error : 0;
+    }
+
+    compile_init(&cpl, env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
+    cpl.lazy = input;
+    env->lazy = compile_lazy;
+    if (0 == compile_multi_stmt(&cpl, stmt) && 0 == compile_update(&cpl)) {
+        if (0 != interp_run(env, env_main_entry_setup(env, 0, NULL))) {
+            return -env->error;
+        }
+    } else {
+        return -cpl.error;
+    }
+
+    if (env->fp > env->sp) {
+        *v = env_stack_pop(env);
+    } else {
+        *v = NULL;
+    }
+
+    return 1;
+}
+
 int interp_execute_interactive(env_t *env, const char *input, char *(*input_more)(void), val_t **v)
 {
     stmt_t *stmt;
@@ -752,11 +1134,18 @@ int interp_execute_stmts(env_t *env, const char *input, val_t **v)
     parser_t psr;
     compile_t cpl;
     heap_t *heap = env_heap_get_free((env_t*)env);
+    executable_cache_t *cache;
+    int caching, native_ref = 0;
 
     if (!env || !input || !v) {
         return -1;
     }
 
+    if (NULL != (cache = interp_cache_lookup(env, input))) {
+        return interp_cache_execute(env, cache, v);
+    }
+    caching = env_is_interactive(env) && 0 == executable_cache_begin(&env->exe, input);
+
     // The free heap can be used for parse and compile process
     parse_init(&psr, input, NULL, heap->base, heap->size);
     parse_set_cb(&psr, parse_callback, NULL);
@@ -765,23 +1154,36 @@ int interp_execute_stmts(env_t *env, const char *input, val_t **v)
     while (stmt) {
         compile_init(&cpl, env, heap_free_addr(&psr.heap), heap_free_size(&psr.heap));
         if (0 == compile_one_stmt(&cpl, stmt) && 0 == compile_update(&cpl)) {
+            if (caching) {
+                native_ref |= cpl.native_ref;
+                caching = 0 == executable_cache_append(&env->exe, env_get_main_entry(env));
+            }
             if (0 != interp_run(env, env_main_entry_setup(env, 0, NULL))) {
+                executable_cache_abort(&env->exe);
                 return -env->error;
             }
         } else {
+            executable_cache_abort(&env->exe);
             return -cpl.error;
         }
 
+        // the result is kept in stack, compact heap may be collected in reset
+        interp_reset_parser_heap(env, &psr);
         if (env->fp > env->sp) {
             *v = env_stack_pop(env);
         } else {
             *v = NULL;
         }
 
-        interp_reset_parser_heap(env, &psr);
         stmt = parse_stmt(&psr);
     }
 
+    if (caching && !psr.error) {
+        executable_cache_commit(&env->exe, interp_cache_stamp(env, native_ref));
+    } else {
+        executable_cache_abort(&env->exe);
+    }
+
     return 1;
 }
 
@@ -32,6 +32,8 @@ int interp_env_init_image(env_t *env, void *mem_ptr, int mem_size, void *heap_pt
 
 int interp_execute_interactive(env_t *env, const char *input, char *(*input_more)(void), val_t **v);
 int interp_execute_string(env_t *env, const char *input, val_t **result);
+// Functions of main are compiled on first call, input should be kept till then
+int interp_execute_lazy(env_t *env, const char *input, val_t **result);
 int interp_execute_image(env_t *env, val_t **result);
 
 val_t interp_execute_call(env_t *env, int ac);
@@ -19,9 +19,41 @@
 
 #include "lex.h"
 
+#if DEF_LEX_SIMD && defined(__SSE2__)
+# include <emmintrin.h>
+# define LEX_SSE2
+#endif
+
 #define CURR_CH     (lex->curr_ch)
 #define NEXT_CH     (lex->next_ch)
 
+// Class of characters, a run of which is scanned at once
+#define LEX_C_ID    0x01    // identifier: alpha, digit, '_', '$'
+#define LEX_C_SPACE 0x02    // space
+#define LEX_C_LINE  0x04    // body of line comment: not '\n', '\r', 0
+#define LEX_C_BLOCK 0x08    // body of block comment: not '*', 0
+#define LEX_C_STR1  0x10    // body of string in '': not '\'', '\\', 0
+#define LEX_C_STR2  0x20    // body of string in "": not '"', '\\', 0
+
+static const uint8_t lex_ctype[256] = {
+    0x00, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3e, 0x3a, 0x3e, 0x3e, 0x3a, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3e, 0x3c, 0x1c, 0x3c, 0x3d, 0x3c, 0x3c, 0x2c, 0x3c, 0x3c, 0x34, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d,
+    0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3c, 0x0c, 0x3c, 0x3c, 0x3d,
+    0x3c, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d,
+    0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3d, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+    0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c, 0x3c,
+};
+
 /*
 static int to_number(const char *s, int len)
 {
@@ -36,76 +68,275 @@ static int to_number(const char *s, int len)
 }
 */
 
-static void lex_get_next_ch(lexer_t *lex)
+// Switch to the next chunk of input, return: first character or 0 at end
+static int lex_get_more(lexer_t *lex)
 {
-    int ch;
+    const char *chunk;
+    int size;
 
-    if (lex->line_pos >= lex->line_end) {
-        lex->line_end = 0;
-        lex->line_pos = 0;
-        ch = 0;
-    } else {
-        ch = lex->line_buf[lex->line_pos ++];
+    lex->line_end = 0;
+    lex->line_pos = 0;
+
+    while (lex->input) {
+        size = lex->input(lex->input_ud, &chunk);
+        if (size <= 0) {
+            lex->input = NULL;
+        } else {
+            lex->line_buf = (char *)chunk;
+            lex->line_end = size;
+            lex->line_pos = 1;
+            return (uint8_t)chunk[0];
+        }
     }
+    return 0;
+}
 
-    if (lex->curr_ch == '\n') {
+// Update position, after the character consumed
+static inline void lex_locate(lexer_t *lex, int ch)
+{
+    if (ch == '\n') {
         lex->line++;
         lex->col = 0;
     } else {
         lex->col++;
     }
+}
+
+static inline void lex_get_next_ch(lexer_t *lex)
+{
+    int ch;
+
+    if (lex->line_pos < lex->line_end) {
+        ch = (uint8_t)lex->line_buf[lex->line_pos ++];
+    } else {
+        ch = lex_get_more(lex);
+    }
+
+    lex_locate(lex, lex->curr_ch);
 
+    lex->offset++;
     lex->curr_ch = lex->next_ch;
     lex->next_ch = ch;
 }
 
+#ifdef LEX_SSE2
+static inline __m128i lex_sse2_range(__m128i v, int lo, int hi)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+static inline __m128i lex_sse2_either(__m128i v, int a, int b)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+}
+
+// Length of the run of class, in blocks of 16 bytes
+static int lex_span_sse2(const uint8_t *s, int n, int mask)
+{
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i zero = _mm_setzero_si128();
+        int bits;
+
+        switch (mask) {
+        case LEX_C_ID:
+            bits = _mm_movemask_epi8(_mm_or_si128(
+                        _mm_or_si128(lex_sse2_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                                     lex_sse2_range(v, '0', '9')),
+                        lex_sse2_either(v, '_', '$')));
+            break;
+        case LEX_C_SPACE:
+            bits = _mm_movemask_epi8(_mm_or_si128(lex_sse2_range(v, '\t', '\r'),
+                                                  _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+            break;
+        case LEX_C_LINE:
+            bits = ~_mm_movemask_epi8(_mm_or_si128(lex_sse2_either(v, '\n', '\r'), _mm_cmpeq_epi8(v, zero)));
+            break;
+        case LEX_C_BLOCK:
+            bits = ~_mm_movemask_epi8(lex_sse2_either(v, '*', 0));
+            break;
+        case LEX_C_STR1:
+            bits = ~_mm_movemask_epi8(_mm_or_si128(lex_sse2_either(v, '\'', '\\'), _mm_cmpeq_epi8(v, zero)));
+            break;
+        case LEX_C_STR2:
+            bits = ~_mm_movemask_epi8(_mm_or_si128(lex_sse2_either(v, '"', '\\'), _mm_cmpeq_epi8(v, zero)));
+            break;
+        default:
+            return i;
+        }
+
+        bits = ~bits & 0xFFFF;
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return i;
+}
+#endif
+
+// Length of the run of class from s, not above n
+static inline int lex_span(const uint8_t *s, int n, int mask)
+{
+    int i = 0;
+
+#ifdef LEX_SSE2
+    i = lex_span_sse2(s, n, mask);
+#endif
+    while (i < n && (lex_ctype[s[i]] & mask)) {
+        i++;
+    }
+    return i;
+}
+
+static inline void lex_append(lexer_t *lex, int *len, int ch)
+{
+    if (len && *len + 1 < lex->token_buf_size) {
+        lex->token_buf[(*len)++] = ch;
+    }
+}
+
+/*
+ * Consume the run of characters in class, which are appended to token from
+ * *len if len given, return: number of characters consumed.
+ * Characters in the current chunk are scanned at once, except the current
+ * and next one.
+ */
+static int lex_run(lexer_t *lex, int mask, int *len)
+{
+    int n = 0;
+
+    while (lex_ctype[CURR_CH] & mask) {
+        const uint8_t *s = (const uint8_t *)lex->line_buf + lex->line_pos;
+        int rest = lex->line_end - lex->line_pos;
+        int k = 0;
+
+        if (rest > 2 && (lex_ctype[NEXT_CH] & mask)) {
+            k = lex_span(s, rest - 2, mask);
+        }
+
+        if (k == 0) {
+            lex_append(lex, len, CURR_CH);
+            lex_get_next_ch(lex);
+            n++;
+            continue;
+        }
+
+        lex_append(lex, len, CURR_CH);
+        lex_append(lex, len, NEXT_CH);
+        if (len) {
+            int room = lex->token_buf_size - 1 - *len;
+
+            room = room < k ? room : k;
+            memcpy(lex->token_buf + *len, s, room);
+            *len += room;
+        }
+
+        lex_locate(lex, CURR_CH);
+        lex_locate(lex, NEXT_CH);
+        if (lex_ctype['\n'] & mask) {
+            const uint8_t *p = s, *nl;
+
+            while (NULL != (nl = memchr(p, '\n', s + k - p))) {
+                lex->line++;
+                lex->col = 0;
+                p = nl + 1;
+            }
+            lex->col += s + k - p;
+        } else {
+            lex->col += k;
+        }
+
+        lex->curr_ch = s[k];
+        lex->next_ch = s[k + 1];
+        lex->line_pos += k + 2;
+        lex->offset += k + 2;
+        n += k + 2;
+    }
+
+    return n;
+}
+
+/*
+ * Keywords are found by a perfect hash of the first, last character and the
+ * length of identifier, which is compared with one keyword at most.
+ */
+#define LEX_KEYWORD_HASH(s, n)  (((uint8_t)(s)[0] + (uint8_t)(s)[(n) - 1] * 3 + (n) * 7) & 63)
+
+static const struct {
+    const char *name;
+    int type;
+} lex_keywords[] = {
+    {NULL, TOK_ID},
+    {"if", TOK_IF},
+    {"in", TOK_IN},
+    {"def", TOK_DEF},
+    {"var", TOK_VAR},
+    {"NaN", TOK_NAN},
+    {"try", TOK_TRY},
+    {"for", TOK_FOR},
+    {"else", TOK_ELSE},
+    {"elif", TOK_ELIF},
+    {"case", TOK_CASE},
+    {"true", TOK_TRUE},
+    {"null", TOK_NULL},
+    {"false", TOK_FALSE},
+    {"while", TOK_WHILE},
+    {"break", TOK_BREAK},
+    {"catch", TOK_CATCH},
+    {"throw", TOK_THROW},
+    {"const", TOK_CONST},
+    {"return", TOK_RET},
+    {"switch", TOK_SWITCH},
+    {"default", TOK_DEFAULT},
+    {"continue", TOK_CONTINUE},
+    {"function", TOK_DEF},
+    {"undefined", TOK_UND},
+};
+
+// Index of keyword by hash
+static const uint8_t lex_keyword_index[64] = {
+     0,  2,  0,  0,  0,  0, 15,  0,
+     0, 14, 22,  0,  0,  5, 12,  0,
+     0,  7,  0,  0,  0, 20,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,
+    24,  4, 18,  0,  0,  0, 19,  0,
+    23,  1,  0,  3,  0,  0, 10,  0,
+     8, 21,  0,  9,  6,  0,  0,  0,
+    13,  0,  0,  0, 17,  0, 16, 11,
+};
+
 static int lex_chk_token_type(const char *str, int len)
 {
-    switch(len) {
-    case 2:
-        if (0 == strcmp("if", str)) return TOK_IF;
-        if (0 == strcmp("in", str)) return TOK_IN;
-    case 3:
-        if (0 == strcmp("def", str)) return TOK_DEF;
-        if (0 == strcmp("var", str)) return TOK_VAR;
-        if (0 == strcmp("NaN", str)) return TOK_NAN;
-        if (0 == strcmp("try", str)) return TOK_TRY;
-    case 4:
-        if (0 == strcmp("else", str)) return TOK_ELSE;
-        if (0 == strcmp("elif", str)) return TOK_ELIF;
-        if (0 == strcmp("true", str)) return TOK_TRUE;
-        if (0 == strcmp("null", str)) return TOK_NULL;
-    case 5:
-        if (0 == strcmp("false", str)) return TOK_FALSE;
-        if (0 == strcmp("while", str)) return TOK_WHILE;
-        if (0 == strcmp("break", str)) return TOK_BREAK;
-        if (0 == strcmp("catch", str)) return TOK_CATCH;
-        if (0 == strcmp("throw", str)) return TOK_THROW;
-    case 6:
-        if (0 == strcmp("return", str)) return TOK_RET;
-    case 8:
-        if (0 == strcmp("continue", str)) return TOK_CONTINUE;
-        if (0 == strcmp("function", str)) return TOK_DEF;
-    case 9:
-        if (0 == strcmp("undefined", str)) return TOK_UND;
-    default:
+    int i;
+
+    if (len < 2 || len > 9) {
         return TOK_ID;
     }
+
+    i = lex_keyword_index[LEX_KEYWORD_HASH(str, len)];
+    if (i && 0 == strcmp(lex_keywords[i].name, str)) {
+        return lex_keywords[i].type;
+    }
+    return TOK_ID;
 }
 
 static void lex_eat_comments(lexer_t *lex)
 {
     if ('#' == CURR_CH || '/' == NEXT_CH) {
-        do {
-            lex_get_next_ch(lex);
-        } while (CURR_CH && '\n' != CURR_CH && '\r' != CURR_CH);
+        lex_run(lex, LEX_C_LINE, NULL);
     } else
     if ('*' == NEXT_CH) {
         lex_get_next_ch(lex);
         lex_get_next_ch(lex);
-        do {
-            lex_get_next_ch(lex);
-        } while (CURR_CH && !('*' == CURR_CH && '/' == NEXT_CH));
+        lex_get_next_ch(lex);
+        while (CURR_CH && !('*' == CURR_CH && '/' == NEXT_CH)) {
+            if (!lex_run(lex, LEX_C_BLOCK, NULL)) {
+                lex_get_next_ch(lex);
+            }
+        }
         lex_get_next_ch(lex);
         lex_get_next_ch(lex);
     }
@@ -115,12 +346,7 @@ static void lex_get_id_token(lexer_t *lex)
 {
     int len  = 0;
 
-    do {
-        if (len + 1 < lex->token_buf_size) {
-            lex->token_buf[len++] = CURR_CH;
-        }
-        lex_get_next_ch(lex);
-    } while (isalnum(CURR_CH) || '_' == CURR_CH || '$' == CURR_CH);
+    lex_run(lex, LEX_C_ID, &len);
 
     lex->token_buf[len] = 0;
     lex->token_len = len;
@@ -130,11 +356,14 @@ static void lex_get_id_token(lexer_t *lex)
 static void lex_get_str_token(lexer_t *lex)
 {
     int term = CURR_CH;
+    int mask = term == '"' ? LEX_C_STR2 : LEX_C_STR1;
     int len  = 0;
 
     // Eat the head ' Or "
     lex_get_next_ch(lex);
 
+    // Characters need not be escaped are taken by run
+    lex_run(lex, mask, &len);
     while (CURR_CH != term) {
         int ch = CURR_CH;
 
@@ -156,10 +385,9 @@ static void lex_get_str_token(lexer_t *lex)
             lex->curr_tok = TOK_EOF;
             return;
         }
-        if (len + 1 < lex->token_buf_size) {
-            lex->token_buf[len++] = ch;
-        }
+        lex_append(lex, &len, ch);
         lex_get_next_ch(lex);
+        lex_run(lex, mask, &len);
     }
 
     // Eat the tail '\'' Or '"'
@@ -184,16 +412,17 @@ static int lex_get_num_digit(lexer_t *lex, int len)
     return len;
 }
 
-static void lex_get_hex_token(lexer_t *lex)
+// "0x" hex or "0b" binary number, prefix is given in lower case
+static void lex_get_radix_token(lexer_t *lex, int prefix)
 {
     int len = 2;
 
     lex->token_buf[0] = '0';
-    lex->token_buf[1] = 'x';
+    lex->token_buf[1] = prefix;
     lex_get_next_ch(lex);
     lex_get_next_ch(lex);
 
-    while (isxdigit(CURR_CH)) {
+    while (prefix == 'x' ? isxdigit(CURR_CH) : (CURR_CH == '0' || CURR_CH == '1')) {
         if (len + 1 < lex->token_buf_size) {
             lex->token_buf[len++] = CURR_CH;
         } else {
@@ -206,7 +435,6 @@ static void lex_get_hex_token(lexer_t *lex)
     lex->curr_tok = TOK_NUM;
 }
 
-
 static void lex_get_num_token(lexer_t *lex)
 {
     int len = 0;
@@ -242,9 +470,7 @@ static void lex_get_next_token(lexer_t *lex)
 
 TOKEN_LOCATE:
     // eat space
-    while (isspace(CURR_CH)) {
-        lex_get_next_ch(lex);
-    }
+    lex_run(lex, LEX_C_SPACE, NULL);
 
     tok = CURR_CH;
     // eat comments
@@ -253,6 +479,10 @@ TOKEN_LOCATE:
         goto TOKEN_LOCATE;
     }
 
+    lex->tok_line = lex->line;
+    lex->tok_col = lex->col;
+    lex->tok_offset = lex->offset;
+
     if (isalpha(tok) || '_' == tok || '$' == tok) {
         lex_get_id_token(lex);
     } else
@@ -261,7 +491,10 @@ TOKEN_LOCATE:
     } else
     if (isdigit(tok)) {
         if (tok == '0' && (NEXT_CH == 'x' || NEXT_CH == 'X')) {
-            lex_get_hex_token(lex);
+            lex_get_radix_token(lex, 'x');
+        } else
+        if (tok == '0' && (NEXT_CH == 'b' || NEXT_CH == 'B')) {
+            lex_get_radix_token(lex, 'b');
         } else {
             lex_get_num_token(lex);
         }
@@ -330,24 +563,53 @@ TOKEN_LOCATE:
     }
 }
 
+static void lex_start(lexer_t *lex)
+{
+    lex->token_buf_size = TOKEN_MAX_SIZE;
+    lex->curr_tok = TOK_EOF;
+    lex->token_len = 0;
+    lex->curr_ch = 0;
+    lex->next_ch = 0;
+
+    lex->line = 0;
+    lex->col = 0;
+    lex->offset = -2;
+    lex_get_next_ch(lex);
+    lex_get_next_ch(lex);
+    lex_get_next_token(lex);
+}
+
 int lex_init(lexer_t *lex, const char *input, char *(*more)(void))
 {
     if (lex && input) {
         lex->line_buf_size = strlen(input);
         lex->line_buf = (char *)input;
-        lex->token_buf_size = TOKEN_MAX_SIZE;
         lex->line_more = more;
+        lex->input = NULL;
+        lex->input_ud = NULL;
 
         lex->line_end = lex->line_buf_size;
         lex->line_pos = 0;
-        lex->curr_tok = TOK_EOF;
-        lex->token_len = 0;
+        lex_start(lex);
 
-        lex->line = 0;
-        lex->col = 0;
-        lex_get_next_ch(lex);
-        lex_get_next_ch(lex);
-        lex_get_next_token(lex);
+        return 0;
+    }
+
+    return -1;
+}
+
+int lex_init_input(lexer_t *lex, lex_input_t input, void *ud)
+{
+    if (lex && input) {
+        lex->line_buf_size = 0;
+        lex->line_buf = NULL;
+        lex->line_more = NULL;
+        lex->input = input;
+        lex->input_ud = ud;
+
+        lex->line_end = 0;
+        lex->line_pos = 0;
+        lex_start(lex);
 
         return 0;
     }
@@ -355,6 +617,36 @@ int lex_init(lexer_t *lex, const char *input, char *(*more)(void))
     return -1;
 }
 
+// ud: lex_iovec_t, the region is given once
+int lex_input_region(void *ud, const char **chunk)
+{
+    lex_iovec_t *region = ud;
+    int size = region->size;
+
+    *chunk = region->base;
+    region->size = 0;
+
+    return size;
+}
+
+// ud: lex_iovec_list_t, regions are given one by one
+int lex_input_iovec(void *ud, const char **chunk)
+{
+    lex_iovec_list_t *list = ud;
+
+    while (list->num > 0) {
+        const lex_iovec_t *iov = list->iov;
+
+        list->iov++;
+        list->num--;
+        if (iov->size > 0) {
+            *chunk = iov->base;
+            return iov->size;
+        }
+    }
+    return 0;
+}
+
 int lex_deinit(lexer_t *lex)
 {
     (void) lex;
@@ -365,8 +657,8 @@ int lex_token(lexer_t *lex, token_t *tok)
 {
     if (tok) {
         tok->type = lex->curr_tok;
-        tok->line = lex->line;
-        tok->col  = lex->col;
+        tok->line = lex->tok_line;
+        tok->col  = lex->tok_col;
         tok->text = lex->token_buf;
 
         if (tok->type == TOK_ID || tok->type == TOK_STR) {
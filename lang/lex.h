@@ -75,14 +75,35 @@ enum LEX_TOKEN_TYPE{
     TOK_BREAK,
     TOK_CATCH,
     TOK_THROW,
-    TOK_CONTINUE
+    TOK_CONTINUE,
+    TOK_SWITCH,
+    TOK_CASE,
+    TOK_DEFAULT,
+    TOK_FOR,
+    TOK_CONST
 };
 
+// Input of lexer, give the next chunk of source, return: size of chunk, 0 at end.
+// The chunk should be kept until the next call.
+typedef int (*lex_input_t)(void *ud, const char **chunk);
+
+typedef struct lex_iovec_t {
+    const char *base;
+    int         size;
+} lex_iovec_t;
+
+typedef struct lex_iovec_list_t {
+    const lex_iovec_t *iov;
+    int                num;
+} lex_iovec_list_t;
+
 typedef struct lexer_t {
     int  curr_ch;
     int  next_ch;
     int  curr_tok;
     int  line, col;
+    int  tok_line, tok_col;     // position of current token
+    int  offset, tok_offset;    // offset in input of current character and token
     int  line_end, line_pos;
 
     int  token_buf_size;
@@ -92,6 +113,8 @@ typedef struct lexer_t {
     heap_t heap;
     char *line_buf;
     char *(*line_more)(void);
+    lex_input_t input;
+    void *input_ud;
     char token_buf[TOKEN_MAX_SIZE];
 } lexer_t;
 
@@ -103,6 +126,11 @@ typedef struct token_t {
 } token_t;
 
 int lex_init(lexer_t *lex, const char *input, char *(*more)(void));
+int lex_init_input(lexer_t *lex, lex_input_t input, void *ud);
+
+// Inputs of the memory region and list of regions
+int lex_input_region(void *ud, const char **chunk);
+int lex_input_iovec(void *ud, const char **chunk);
 int lex_deinit(lexer_t *lex);
 
 int lex_token(lexer_t *lex, token_t *tok);
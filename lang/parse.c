@@ -18,9 +18,11 @@
  **/
 
 #include "err.h"
+#include "hash.h"
 #include "ast.h"
 #include "lex.h"
 #include "parse.h"
+#include "type_number.h"
 
 static expr_t *parse_expr_funcdef(parser_t *psr);
 static expr_t *parse_expr_form_parenth(parser_t *psr);
@@ -67,13 +69,46 @@ static inline char *parse_strdup(parser_t *psr, const char *s) {
     return dup;
 }
 
+// Identifier appeared again share the text, until the slots are full
+static char *parse_intern(parser_t *psr, const char *s)
+{
+    uint32_t pos, n;
+
+    if (!DEF_PARSE_NAME_SLOTS) {
+        return parse_strdup(psr, s);
+    }
+
+    if (!psr->names) {
+        if (!(psr->names = heap_alloc(&psr->heap, DEF_PARSE_NAME_SLOTS * sizeof(char *)))) {
+            return NULL;
+        }
+        memset(psr->names, 0, DEF_PARSE_NAME_SLOTS * sizeof(char *));
+    }
+
+    pos = hash_text(s, NULL) & (DEF_PARSE_NAME_SLOTS - 1);
+    for (n = 0; n < DEF_PARSE_NAME_SLOTS; n++, pos = hash_next(DEF_PARSE_NAME_SLOTS, pos)) {
+        char *name = psr->names[pos];
+
+        if (!name) {
+            return psr->names[pos] = parse_strdup(psr, s);
+        }
+        if (0 == strcmp(name, s)) {
+            return name;
+        }
+    }
+
+    return parse_strdup(psr, s);
+}
+
 static inline expr_t *parse_expr_alloc_type(parser_t *psr, int type) {
     expr_t *e = (expr_t *) heap_alloc(&psr->heap, sizeof(expr_t));
 
     if (e) {
         e->type = type;
-        e->body.child.lft = NULL;
-        e->body.child.rht = NULL;
+        e->line = psr->lex.tok_line;
+        e->col  = psr->lex.tok_col < 65535 ? psr->lex.tok_col : 65535;
+        e->body.child.lft = 0;
+        e->body.child.rht = 0;
     }
 
     return e;
@@ -83,7 +118,7 @@ static inline expr_t *parse_expr_alloc_str(parser_t *psr, int type, const char *
     expr_t *e = (expr_t *) parse_expr_alloc_type(psr, type);
 
     if (e) {
-        char *str = parse_strdup(psr, text);
+        char *str = type == EXPR_ID ? parse_intern(psr, text) : parse_strdup(psr, text);
 
         if (!str) {
             return NULL;
@@ -97,16 +132,22 @@ static inline expr_t *parse_expr_alloc_num(parser_t *psr, const char *text) {
     expr_t *e = (expr_t *) parse_expr_alloc_type(psr, EXPR_NUM);
 
     if (e) {
-        e->body.data.num = atof(text);
+        number_parse(text, &e->body.data.num);
     }
     return e;
 }
 
-static inline expr_t *parse_expr_alloc_proc(parser_t *psr, stmt_t * s) {
+static inline expr_t *parse_expr_alloc_proc(parser_t *psr, stmt_t * s, int start) {
     expr_t *e = (expr_t *) parse_expr_alloc_type(psr, EXPR_FUNCPROC);
+    ast_span_t *span;
 
     if (e) {
+        if (!(span = heap_alloc(&psr->heap, sizeof(ast_span_t)))) {
+            return NULL;
+        }
         e->body.data.proc = s;
+        span->start = start;
+        span->size = parse_offset(psr) - start;
     }
 
     return e;
@@ -117,10 +158,10 @@ static inline stmt_t *parse_stmt_alloc_0(parser_t *psr, int type) {
 
     if (s) {
         s->type = type;
-        s->expr = NULL;
-        s->block = NULL;
-        s->other = NULL;
-        s->next = NULL;
+        s->expr = 0;
+        s->block = 0;
+        s->other = 0;
+        s->next = 0;
     }
 
     return s;
@@ -131,10 +172,10 @@ static inline stmt_t *parse_stmt_alloc_1(parser_t *psr, int t, expr_t *e) {
 
     if (s) {
         s->type = t;
-        s->expr = e;
-        s->block = NULL;
-        s->other = NULL;
-        s->next = NULL;
+        s->expr = ast_ref_make(s, e);
+        s->block = 0;
+        s->other = 0;
+        s->next = 0;
     }
 
     return s;
@@ -145,10 +186,10 @@ static inline stmt_t *parse_stmt_alloc_2(parser_t *psr, int t, expr_t *e, stmt_t
 
     if (s) {
         s->type = t;
-        s->expr = e;
-        s->block = block;
-        s->other = NULL;
-        s->next = NULL;
+        s->expr = ast_ref_make(s, e);
+        s->block = ast_ref_make(s, block);
+        s->other = 0;
+        s->next = 0;
     }
 
     return s;
@@ -159,10 +200,10 @@ static inline stmt_t *parse_stmt_alloc_3(parser_t *psr, int t, expr_t *e, stmt_t
 
     if (s) {
         s->type = t;
-        s->expr = e;
-        s->block = block;
-        s->other = other;
-        s->next = NULL;
+        s->expr = ast_ref_make(s, e);
+        s->block = ast_ref_make(s, block);
+        s->other = ast_ref_make(s, other);
+        s->next = 0;
     }
 
     return s;
@@ -499,10 +540,35 @@ static expr_t *parse_expr_comma(parser_t *psr)
     return expr;
 }
 
+// Tokens of braced block are matched to the end of it, without AST built,
+// errors in the block are not found
+static stmt_t *parse_stmt_skip(parser_t *psr)
+{
+    stmt_t *s;
+    int depth = 0;
+
+    do {
+        int tok = parse_token(psr, NULL);
+
+        if (tok == TOK_EOF) {
+            parse_fail(psr, ERR_InvalidToken);
+            return NULL;
+        }
+        depth += tok == '{' ? 1 : (tok == '}' ? -1 : 0);
+        parse_match(psr, tok);
+    } while (depth > 0);
+
+    if (!(s = parse_stmt_alloc_0(psr, STMT_PASS))) {
+        parse_fail(psr, ERR_NotEnoughMemory);
+    }
+    return s;
+}
+
 static expr_t *parse_expr_funcdef(parser_t *psr)
 {
     expr_t *name = NULL, *args = NULL, *head = NULL, *proc = NULL;
     stmt_t *block = NULL;
+    int start = parse_offset(psr);
 
     parse_match(psr, TOK_DEF);
 
@@ -527,7 +593,8 @@ static expr_t *parse_expr_funcdef(parser_t *psr)
         }
     }
 
-    if (!(block = parse_stmt_block(psr))) {
+    block = psr->lazy && '{' == parse_token(psr, NULL) ? parse_stmt_skip(psr) : parse_stmt_block(psr);
+    if (!block) {
         goto DO_ERROR;
     }
 
@@ -540,7 +607,7 @@ static expr_t *parse_expr_funcdef(parser_t *psr)
         ast_expr_set_rht(head, args);
     }
 
-    if (!(proc = parse_expr_alloc_proc(psr, block))) {
+    if (!(proc = parse_expr_alloc_proc(psr, block, start))) {
         parse_fail(psr, ERR_NotEnoughMemory);
         goto DO_ERROR;
     }
@@ -713,6 +780,7 @@ static expr_t *parse_expr_form_unary(parser_t *psr, int type, expr_t *lft)
         parse_fail(psr, ERR_NotEnoughMemory);
     } else {
         ast_expr_set_lft(expr, lft);
+        ast_expr_set_pos(expr, lft);
     }
 
     return expr;
@@ -731,6 +799,7 @@ static expr_t *parse_expr_form_binary(parser_t *psr, int type, expr_t *lft, expr
     } else {
         ast_expr_set_lft(expr, lft);
         ast_expr_set_rht(expr, rht);
+        ast_expr_set_pos(expr, lft ? lft : rht);
     }
 
     return expr;
@@ -755,7 +824,8 @@ static stmt_t *parse_stmt_block(parser_t *psr)
             }
 
             if (s) {
-                last = last->next = curr;
+                ast_stmt_set_next(last, curr);
+                last = curr;
             } else {
                 s = last = curr;
             }
@@ -886,6 +956,36 @@ static stmt_t *parse_stmt_var(parser_t *psr)
     return NULL;
 }
 
+static stmt_t *parse_stmt_const(parser_t *psr)
+{
+    expr_t *expr, *e;
+    stmt_t *s;
+
+    parse_match(psr, TOK_CONST);
+    if (!(expr = parse_expr_vardef_list(psr))) {
+        return NULL;
+    }
+
+    // constant must be initialized
+    for (e = expr; e; e = e->type == EXPR_COMMA ? ast_expr_rht(e) : NULL) {
+        expr_t *def = e->type == EXPR_COMMA ? ast_expr_lft(e) : e;
+
+        if (def->type != EXPR_ASSIGN || ast_expr_rht(def)->type == EXPR_ASSIGN) {
+            parse_fail(psr, ERR_InvalidSyntax);
+            return NULL;
+        }
+    }
+
+    if (';' == parse_token(psr, NULL)) {
+        parse_match(psr, ';');
+    }
+
+    if (!(s = parse_stmt_alloc_1(psr, STMT_CONST, expr))) {
+        parse_fail(psr, ERR_NotEnoughMemory);
+    }
+    return s;
+}
+
 static stmt_t *parse_stmt_ret(parser_t *psr)
 {
     expr_t *expr = NULL;
@@ -932,6 +1032,131 @@ static stmt_t *parse_stmt_while(parser_t *psr)
     return s;
 }
 
+static stmt_t *parse_stmt_for(parser_t *psr)
+{
+    token_t token;
+    expr_t *id, *head;
+    stmt_t *decl = NULL, *block, *s;
+    int parenth, vardef, tok, type;
+
+    parse_match(psr, TOK_FOR);
+    parenth = parse_match(psr, '(');
+    vardef = parse_match(psr, TOK_VAR);
+
+    if (parse_token(psr, NULL) != TOK_ID) {
+        parse_fail(psr, ERR_InvalidToken);
+        return NULL;
+    }
+    if (!(id = parse_expr_factor(psr))) {
+        return NULL;
+    }
+
+    // "of" is not a keyword, only in here
+    tok = parse_token(psr, &token);
+    if (tok == TOK_IN) {
+        type = STMT_FOR_IN;
+    } else if (tok == TOK_ID && 0 == strcmp(token.text, "of")) {
+        type = STMT_FOR_OF;
+    } else {
+        parse_fail(psr, ERR_InvalidToken);
+        return NULL;
+    }
+    parse_match(psr, tok);
+
+    if (!(head = parse_expr_form_binary(psr, EXPR_TIN, id, parse_expr(psr)))) {
+        return NULL;
+    }
+    if (parenth && !parse_match(psr, ')')) {
+        parse_fail(psr, ERR_InvalidToken);
+        return NULL;
+    }
+
+    if (vardef && !(decl = parse_stmt_alloc_1(psr, STMT_VAR, id))) {
+        parse_fail(psr, ERR_NotEnoughMemory);
+        return NULL;
+    }
+
+    if (!(block = parse_stmt_block(psr))) {
+        return NULL;
+    }
+
+    if (!(s = parse_stmt_alloc_3(psr, type, head, block, decl))) {
+        parse_fail(psr, ERR_NotEnoughMemory);
+    }
+
+    return s;
+}
+
+static stmt_t *parse_stmt_switch(parser_t *psr)
+{
+    expr_t *value;
+    stmt_t *cases = NULL, *last = NULL, *tail = NULL, *s;
+
+    parse_match(psr, TOK_SWITCH);
+
+    if (!(value = parse_expr(psr))) {
+        return NULL;
+    }
+
+    parse_post(psr, PARSE_ENTER_BLOCK);
+    if (!parse_match(psr, '{')) {
+        parse_fail(psr, ERR_InvalidToken);
+        return NULL;
+    }
+
+    while (!parse_match(psr, '}')) {
+        int tok = parse_token(psr, NULL);
+
+        if (tok == TOK_CASE || tok == TOK_DEFAULT) {
+            expr_t *e = NULL;
+
+            parse_match(psr, tok);
+            if (tok == TOK_CASE && !(e = parse_expr(psr))) {
+                return NULL;
+            }
+            if (!parse_match(psr, ':')) {
+                parse_fail(psr, ERR_InvalidToken);
+                return NULL;
+            }
+
+            if (!(s = parse_stmt_alloc_1(psr, STMT_CASE, e))) {
+                parse_fail(psr, ERR_NotEnoughMemory);
+                return NULL;
+            }
+            if (last) {
+                ast_stmt_set_next(last, s);
+                last = s;
+            } else {
+                cases = last = s;
+            }
+            tail = NULL;
+        } else
+        if (!parse_match(psr, ';')) {
+            if (!last && tok != TOK_EOF) {
+                parse_fail(psr, ERR_InvalidToken);
+                return NULL;
+            }
+
+            if (!(s = parse_stmt(psr))) {
+                return NULL;
+            }
+            if (tail) {
+                ast_stmt_set_next(tail, s);
+            } else {
+                ast_stmt_set_block(last, s);
+            }
+            tail = s;
+        }
+    }
+    parse_post(psr, PARSE_LEAVE_BLOCK);
+
+    if (!(s = parse_stmt_alloc_2(psr, STMT_SWITCH, value, cases))) {
+        parse_fail(psr, ERR_NotEnoughMemory);
+    }
+
+    return s;
+}
+
 static stmt_t *parse_stmt_throw(parser_t *psr)
 {
     expr_t *expr = NULL;
@@ -1014,8 +1239,11 @@ stmt_t *parse_stmt(parser_t *psr)
         case TOK_IF:        parse_post(psr, PARSE_COMPOSE); return parse_stmt_if(psr);
         case TOK_TRY:       parse_post(psr, PARSE_SIMPLE); return parse_stmt_try(psr);
         case TOK_VAR:       parse_post(psr, PARSE_SIMPLE); return parse_stmt_var(psr);
+        case TOK_CONST:     parse_post(psr, PARSE_SIMPLE); return parse_stmt_const(psr);
         case TOK_RET:       parse_post(psr, PARSE_SIMPLE); return parse_stmt_ret(psr);
         case TOK_WHILE:     parse_post(psr, PARSE_COMPOSE); return parse_stmt_while(psr);
+        case TOK_SWITCH:    parse_post(psr, PARSE_COMPOSE); return parse_stmt_switch(psr);
+        case TOK_FOR:       parse_post(psr, PARSE_COMPOSE); return parse_stmt_for(psr);
         case TOK_BREAK:     parse_post(psr, PARSE_SIMPLE); return parse_stmt_break(psr);
         case TOK_THROW:     parse_post(psr, PARSE_SIMPLE); return parse_stmt_throw(psr);
         case TOK_CONTINUE:  parse_post(psr, PARSE_SIMPLE); return parse_stmt_continue(psr);
@@ -1035,7 +1263,8 @@ stmt_t *parse_stmt_multi(parser_t *psr)
         }
 
         if (head) {
-            last = last->next = curr;
+            ast_stmt_set_next(last, curr);
+            last = curr;
         } else {
             last = head = curr;
         }
@@ -47,6 +47,8 @@ typedef struct parser_t {
     int      error;
     lexer_t  lex;
     heap_t   heap;
+    char   **names;             // slots of identifiers interned
+    int      lazy;              // braced bodies of functions are skipped, compiled later from source
     void (*usr_cb) (void *, parse_event_t *);
     void *usr_data;
 } parser_t;
@@ -58,6 +60,23 @@ static inline int parse_init(parser_t *psr, const char *input, char *(*more)(voi
         psr->error = 0;
         lex_init(&psr->lex, input, more);
         heap_init(&psr->heap, mem, size);
+        psr->names = NULL;
+        psr->lazy = 0;
+        psr->usr_cb = NULL;
+        psr->usr_data = NULL;
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+static inline int parse_init_input(parser_t *psr, lex_input_t input, void *ud, void *mem, int size) {
+    if (psr && input && mem) {
+        psr->error = 0;
+        lex_init_input(&psr->lex, input, ud);
+        heap_init(&psr->heap, mem, size);
+        psr->names = NULL;
+        psr->lazy = 0;
         psr->usr_cb = NULL;
         psr->usr_data = NULL;
         return 0;
@@ -73,6 +92,12 @@ static inline void parse_set_cb(parser_t *psr, parse_callback_t cb, void *data)
     }
 }
 
+// Release the AST parsed, the state of lexer is kept
+static inline void parse_release(parser_t *psr) {
+    heap_reset(&psr->heap);
+    psr->names = NULL;
+}
+
 static inline void parse_disable_more(parser_t *psr) {
     psr->lex.line_more = NULL;
 }
@@ -84,6 +109,10 @@ stmt_t *parse_stmt_multi(parser_t *psr);
 static inline int parse_position(parser_t *psr, int *line, int *col) {
     return lex_position(&psr->lex, line, col);
 }
+// Offset of current token in input
+static inline int parse_offset(parser_t *psr) {
+    return psr->lex.tok_offset;
+}
 static inline int parse_token(parser_t *psr, token_t *token) {
     return lex_token(&psr->lex, token);
 }
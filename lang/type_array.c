@@ -24,8 +24,9 @@
 #include "type_array.h"
 #include "type_object.h"
 
-static array_t *array_space_extend_tail(env_t *env, array_t *a, int n)
+static array_t *array_space_extend_tail(env_t *env, val_t *self, int n)
 {
+    array_t *a = (array_t *)val_2_intptr(self);
     val_t *elems;
     int len;
 
@@ -35,7 +36,7 @@ static array_t *array_space_extend_tail(env_t *env, array_t *a, int n)
 
     len = array_length(a);
     if (a->elem_size - len > n) {
-        memmove(a->elems, a->elems + a->elem_bgn, len);
+        memmove(a->elems, a->elems + a->elem_bgn, sizeof(val_t) * len);
         a->elem_bgn = 0;
         a->elem_end = len;
         return a;
@@ -45,9 +46,11 @@ static array_t *array_space_extend_tail(env_t *env, array_t *a, int n)
             env_set_error(env, ERR_ResourceOutLimit);
             return NULL;
         }
-        elems = env_heap_alloc(env, size * sizeof(val_t));
+        elems = env_heap_alloc_buffer(env, a, size * sizeof(val_t));
         if (elems) {
+            a = (array_t *)val_2_intptr(self);
             memcpy(elems, a->elems + a->elem_bgn, sizeof(val_t) * len);
+            a->elems = elems;
             a->elem_size = size;
             a->elem_bgn = 0;
             a->elem_end = len;
@@ -71,7 +74,7 @@ static array_t *array_space_extend_head(env_t *env, val_t *self, int n)
 
     if (a->elem_size - len > n) {
         n = a->elem_size - a->elem_end;
-        memmove(a->elems + a->elem_bgn + n, a->elems + a->elem_bgn, len);
+        memmove(a->elems + a->elem_bgn + n, a->elems + a->elem_bgn, sizeof(val_t) * len);
         a->elem_bgn += n;
         a->elem_end += n;
         return a;
@@ -81,10 +84,11 @@ static array_t *array_space_extend_head(env_t *env, val_t *self, int n)
             env_set_error(env, ERR_ResourceOutLimit);
             return NULL;
         }
-        elems = env_heap_alloc(env, size * sizeof(val_t));
+        elems = env_heap_alloc_buffer(env, a, size * sizeof(val_t));
         if (elems) {
             a = (array_t *)val_2_intptr(self);
             memcpy(elems + size - len, a->elems + a->elem_bgn, sizeof(val_t) * len);
+            a->elems = elems;
             a->elem_size = size;
             a->elem_bgn = size - len;
             a->elem_end = size;
@@ -95,12 +99,14 @@ static array_t *array_space_extend_head(env_t *env, val_t *self, int n)
     }
 }
 
-static int array_space_set(array_t *a, env_t *env, int length)
+static int array_space_set(val_t *self, env_t *env, int length)
 {
+    array_t *a = array_entry(self);
+
     if (a) {
         int n = length - array_length(a);
         if (n > 0) {
-            if (!(a = array_space_extend_tail(env, a, n))) {
+            if (!(a = array_space_extend_tail(env, self, n))) {
                 int i;
 
                 for (i = 0; i < n; i++) {
@@ -147,7 +153,12 @@ intptr_t array_create(env_t *env, int ac, val_t *av)
     array_t *array = _array_create(env, ac);
 
     if (array) {
+        int i;
+
         memcpy(array->elems + array->elem_bgn, av, sizeof(val_t) * ac);
+        for (i = 0; env->gc_cycle && i < ac; i++) {
+            env_heap_shade(env, av + i);
+        }
     }
 
     return (intptr_t) array;
@@ -207,11 +218,16 @@ static val_t native_push(env_t *env, int ac, val_t *av)
     if (ac > 1 && a) {
         int n = ac - 1;
 
-        a = array_space_extend_tail(env, a, n);
+        a = array_space_extend_tail(env, av, n);
 
         if (a) {
+            int i;
+
             memcpy(a->elems + a->elem_end, av + 1, sizeof(val_t) * n);
             a->elem_end += n;
+            for (i = 1; i <= n; i++) {
+                env_heap_barrier(env, a, av + i);
+            }
             return val_mk_number(array_length(a));
         }
     } else {
@@ -227,8 +243,13 @@ static val_t native_unshift(env_t *env, int ac, val_t *av)
         array_t *a = array_space_extend_head(env, av, n);
 
         if (a) {
+            int i;
+
             memcpy(a->elems + a->elem_bgn - n, av + 1, sizeof(val_t) * n);
             a->elem_bgn -= n;
+            for (i = 1; i <= n; i++) {
+                env_heap_barrier(env, a, av + i);
+            }
             return val_mk_number(array_length(a));
         }
     } else {
@@ -242,6 +263,7 @@ static val_t native_pop(env_t *env, int ac, val_t *av)
     if (ac > 0 && val_is_array(av)) {
         array_t *a = (array_t *)val_2_intptr(av);
 
+        env_read_barrier(env, a);
         if (array_length(a)) {
             return a->elems[--a->elem_end];
         }
@@ -256,6 +278,7 @@ static val_t native_shift(env_t *env, int ac, val_t *av)
     if (ac > 0 && val_is_array(av)) {
         array_t *a = (array_t *)val_2_intptr(av);
 
+        env_read_barrier(env, a);
         if (array_length(a)) {
             return a->elems[a->elem_bgn++];
         }
@@ -274,6 +297,9 @@ static val_t native_foreach(env_t *env, int ac, val_t *av)
         for (i = 0; i < max && !env->error; i++) {
             val_t key = val_mk_number(i);
 
+            // array may be moved by gc, in callback
+            a = (array_t *)val_2_intptr(av);
+            env_read_barrier(env, a);
             env_push_call_argument(env, &key);
             env_push_call_argument(env, array_values(a) + i);
             env_push_call_function(env, av + 1);
@@ -382,7 +408,7 @@ static void set_prop(void *env, val_t *self, const char *name, val_t *data)
 
     if (a && val_is_number(data)) {
         if (env_symbal_get(env, name) == proto[0].symbal) {
-            array_space_set(a, env, val_2_integer(data));
+            array_space_set(self, env, val_2_integer(data));
         }
     }
 }
@@ -391,8 +417,8 @@ static val_t get_elem(void *env, val_t *self, int id)
 {
     array_t *a = array_entry(self);
 
-    (void) env;
     if (a) {
+        env_read_barrier(env, a);
         if (id >= 0 && id < array_length(a)) {
             return a->elems[a->elem_bgn + id];
         }
@@ -404,10 +430,10 @@ static void set_elem(void *env, val_t *self, int id, val_t *data)
 {
     array_t *a = array_entry(self);
 
-    (void) env;
     if (a) {
         if (id >= 0 && id < array_length(a)) {
             a->elems[a->elem_bgn + id] = *data;
+            env_heap_barrier(env, a, data);
         }
     }
 }
@@ -416,7 +442,7 @@ static void opx_elem(void *env, val_t *self, int id, val_t *res, val_opx_t op)
 {
     array_t *a = array_entry(self);
 
-    (void) env;
+    env_read_barrier(env, a);
     if (a && id >= 0 && id < array_length(a)) {
         op(env, a->elems + a->elem_bgn + id, res);
     } else {
@@ -428,11 +454,18 @@ static void opxx_elem(void *env, val_t *self, int id, val_t *data, val_t *res, v
 {
     array_t *a = array_entry(self);
 
-    (void) env;
+    env_read_barrier(env, a);
     if (a && id >= 0 && id < array_length(a)) {
-        val_t *elem = a->elems + a->elem_bgn + id;
-        op(env, elem, data, elem);
-        *res = *elem;
+        val_t *elem;
+
+        // operate in res, array may be moved by gc in it
+        *res = a->elems[a->elem_bgn + id];
+        op(env, res, data, res);
+        a = array_entry(self);
+        env_read_barrier(env, a);
+        elem = a->elems + a->elem_bgn + id;
+        *elem = *res;
+        env_heap_barrier(env, a, elem);
     } else {
         val_set_nan(res);
     }
@@ -21,6 +21,148 @@
 #include "type_string.h"
 #include "type_number.h"
 
+#include <float.h>
+
+// Powers of ten those are exact in double
+static const double number_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Digits of power of 2 radix: 64 bits are kept at least, the digits out of
+ * them are folded into the lowest bit, which is enough to round correctly.
+ */
+static int number_parse_radix(const char *s, int bits, double *v)
+{
+    const char *p = s + 2;
+    uint64_t m = 0;
+    int shift = 0, sticky = 0;
+
+    for (; ; p++) {
+        int d;
+
+        if (*p >= '0' && *p <= '9') {
+            d = *p - '0';
+        } else if (bits == 4 && *p >= 'a' && *p <= 'f') {
+            d = *p - 'a' + 10;
+        } else if (bits == 4 && *p >= 'A' && *p <= 'F') {
+            d = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        if (d >> bits) {
+            break;
+        }
+
+        if (m >> (64 - bits)) {
+            sticky |= d;
+            shift = shift < 2048 ? shift + bits : shift;
+        } else {
+            m = (m << bits) | d;
+        }
+    }
+
+    if (p == s + 2) {
+        // "0x" without digit is 0, as strtod
+        *v = 0;
+        return 1;
+    }
+
+    // scaled by power of 2, it is exact
+    *v = (double)(m | (sticky != 0));
+    for (; shift >= 32; shift -= 32) {
+        *v *= 4294967296.0;
+    }
+    *v *= (double)(1u << shift);
+    return p - s;
+}
+
+/*
+ * Text to number, as literal of source: decimal, "0x" hex or "0b" binary.
+ * Integers and short decimals are computed directly, which is exact as
+ * both the digits and the power of ten are exact in double, the others
+ * fall back to strtod.
+ * return: characters consumed, 0 if text is not a number
+ */
+int number_parse(const char *s, double *v)
+{
+    const char *p = s;
+    uint64_t w = 0;
+    int digits = 0, scale = 0, exp = 0;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        return number_parse_radix(s, 4, v);
+    }
+    if (s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+        return number_parse_radix(s, 1, v);
+    }
+
+    if (!isdigit((uint8_t)*p) && !(*p == '.' && isdigit((uint8_t)p[1]))) {
+        return 0;
+    }
+
+    for (; isdigit((uint8_t)*p); p++) {
+        if (w || *p != '0') {
+            w = w * 10 + (*p - '0');
+            digits++;
+        }
+        if (digits > 19) {
+            break;
+        }
+    }
+    if (*p == '.' && isdigit((uint8_t)p[1])) {
+        for (p++; digits <= 19 && isdigit((uint8_t)*p); p++, scale--) {
+            if (w || *p != '0') {
+                w = w * 10 + (*p - '0');
+                digits++;
+            }
+        }
+    }
+
+    if (digits <= 19 && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int neg = 0;
+
+        if (*q == '-' || *q == '+') {
+            neg = *q++ == '-';
+        }
+        if (isdigit((uint8_t)*q)) {
+            for (; isdigit((uint8_t)*q); q++) {
+                exp = exp < 10000 ? exp * 10 + (*q - '0') : exp;
+            }
+            exp = neg ? -exp : exp;
+            p = q;
+        }
+    }
+
+#if FLT_EVAL_METHOD == 0 || FLT_EVAL_METHOD == 1
+    if (digits <= 19 && w <= (1ULL << 53)) {
+        int e = scale + exp;
+
+        if (w == 0) {
+            *v = 0;
+            return p - s;
+        }
+        if (e >= 0 && e <= 22) {
+            *v = (double)w * number_pow10[e];
+            return p - s;
+        }
+        if (e < 0 && e >= -22) {
+            *v = (double)w / number_pow10[-e];
+            return p - s;
+        }
+    }
+#endif
+
+    {
+        char *end;
+
+        *v = strtod(s, &end);
+        return end - s;
+    }
+}
+
 static int number_is_true(val_t *self) {
     return val_2_double(self) != 0;
 }
@@ -28,5 +28,7 @@
 
 extern const val_metadata_t metadata_num;
 
+int number_parse(const char *s, double *v);
+
 #endif /* __LANG_NUMBER_INC__ */
 
@@ -27,7 +27,8 @@ static inline object_t *object_entry(val_t *v) {
     return val_is_object(v) ? (object_t *)val_2_intptr(v) : NULL;
 }
 
-static val_t *object_add_prop(env_t *env, object_t *obj, intptr_t symbal) {
+static val_t *object_add_prop(env_t *env, val_t *self, intptr_t symbal) {
+    object_t *obj = object_entry(self);
     val_t *vals;
     intptr_t *keys;
 
@@ -41,17 +42,19 @@ static val_t *object_add_prop(env_t *env, object_t *obj, intptr_t symbal) {
         size = obj->prop_size * 2;
         size = size < UINT16_MAX ? size : UINT16_MAX;
 
-        keys = (intptr_t*) env_heap_alloc(env, sizeof(intptr_t) * size + sizeof(val_t) * size);
+        keys = (intptr_t*) env_heap_alloc_buffer(env, obj, sizeof(intptr_t) * size + sizeof(val_t) * size);
         if (!keys) {
             env_set_error(env, ERR_NotEnoughMemory);
             return NULL;
         }
         vals = (val_t *)(keys + size);
 
+        obj = object_entry(self);
         memcpy(keys, obj->keys, sizeof(intptr_t) * obj->prop_num);
         memcpy(vals, obj->vals, sizeof(val_t) * obj->prop_num);
         obj->keys = keys;
         obj->vals = vals;
+        obj->prop_size = size;
     } else {
         vals = obj->vals;
         keys = obj->keys;
@@ -87,7 +90,12 @@ static val_t native_object_foreach(env_t *env, int ac, val_t *av)
         int i, max = o->prop_num;
 
         for (i = 0; i < max && !env->error; i++) {
-            val_t key = val_mk_foreign_string(o->keys[i]);
+            val_t key;
+
+            // object may be moved by gc, in callback
+            o = (object_t *)val_2_intptr(av);
+            env_read_barrier(env, o);
+            key = val_mk_foreign_string(o->keys[i]);
 
             env_push_call_argument(env, &key);
             env_push_call_argument(env, o->vals + i);
@@ -143,6 +151,9 @@ intptr_t object_create(env_t *env, int n, val_t *av)
             }
             obj->keys[off] = key;
             obj->vals[off] = *val;
+            if (env->gc_cycle) {
+                env_heap_shade(env, val);
+            }
 
             off++;
         }
@@ -182,9 +193,9 @@ val_t *object_prop_ref(env_t *env, val_t *self, val_t *key)
             if (prop) {
                 return prop;
             }
-            prop = object_add_prop(env, obj, sym_id);
+            prop = object_add_prop(env, self, sym_id);
         } else {
-            prop = object_add_prop(env, obj, env_symbal_add(env, name));
+            prop = object_add_prop(env, self, env_symbal_add(env, name));
         }
 
         if (prop) {
@@ -262,6 +273,31 @@ static inline int is_true(val_t *v) {
     return object_entry(v) != NULL;
 };
 
+int object_has_prop(env_t *env, val_t *self, const char *name)
+{
+    object_t *cur = object_entry(self);
+    intptr_t symbal;
+    unsigned i;
+
+    // property name must be a symbal
+    if (!cur || !(symbal = env_symbal_get(env, name))) {
+        return 0;
+    }
+
+    for (; cur; cur = cur->proto) {
+        if (object_find_prop_owned(cur, symbal)) {
+            return 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(proto) / sizeof(object_prop_t); i++) {
+        if (proto[i].symbal == symbal) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static val_t get_prop(void *env, val_t *self, const char *name)
 {
     object_t *obj = val_is_object(self) ? (object_t *)val_2_intptr(self) : NULL;
@@ -270,6 +306,8 @@ static val_t get_prop(void *env, val_t *self, const char *name)
 
     if (obj) {
         object_t *cur = obj;
+
+        env_read_barrier(env, obj);
         while (cur) {
             intptr_t *keys = cur->keys;
 
@@ -316,14 +354,15 @@ static void set_prop(void *env, val_t *self, const char *name, val_t *data)
         prop = object_find_prop_owned(obj, sym);
 
         if (!prop) {
-            prop = object_add_prop(env, obj, sym);
+            prop = object_add_prop(env, self, sym);
         }
     } else {
-        prop = object_add_prop(env, obj, env_symbal_add(env, name));
+        prop = object_add_prop(env, self, env_symbal_add(env, name));
     }
 
     if (prop) {
         *prop = *data;
+        env_heap_barrier(env, object_entry(self), data);
     }
 }
 
@@ -334,6 +373,7 @@ static void opx_prop(void *env, val_t *self, const char *name, val_t *res, val_o
     val_t *prop = NULL;
 
     if (sym) {
+        env_read_barrier(env, obj);
         prop = object_find_prop_owned(obj, sym);
 
         if (prop) {
@@ -341,10 +381,10 @@ static void opx_prop(void *env, val_t *self, const char *name, val_t *res, val_o
             return;
 
         } else {
-            prop = object_add_prop(env, obj, sym);
+            prop = object_add_prop(env, self, sym);
         }
     } else {
-        prop = object_add_prop(env, obj, env_symbal_add(env, name));
+        prop = object_add_prop(env, self, env_symbal_add(env, name));
     }
 
     // vaule of prop is Undefined
@@ -363,19 +403,28 @@ static void opxx_prop(void *env, val_t *self, const char *name, val_t *data, val
     val_t *prop = NULL;
 
     if (sym) {
+        env_read_barrier(env, obj);
         prop = object_find_prop_owned(obj, sym);
         if (!prop) {
-            prop = object_add_prop(env, obj, sym);
+            prop = object_add_prop(env, self, sym);
             val_set_undefined(prop);
         }
     } else {
-        prop = object_add_prop(env, obj, env_symbal_add(env, name));
+        prop = object_add_prop(env, self, env_symbal_add(env, name));
         val_set_undefined(prop);
     }
 
     if (prop) {
-        op(env, prop, data, prop);
+        int i = prop - object_entry(self)->vals;
+
+        // operate in res, object may be moved by gc in it
         *res = *prop;
+        op(env, res, data, res);
+        obj = object_entry(self);
+        env_read_barrier(env, obj);
+        prop = obj->vals + i;
+        *prop = *res;
+        env_heap_barrier(env, obj, prop);
     } else {
         val_set_nan(res);
     }
@@ -81,6 +81,7 @@ static inline int object_iter_init(object_iter_t *it, val_t *obj)
 }
 
 int object_iter_next(object_iter_t *it, const char **k, val_t **v);
+int object_has_prop(env_t *env, val_t *self, const char *name);
 
 void object_proto_init(env_t *env);
 extern const val_metadata_t metadata_object;
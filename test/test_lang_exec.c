@@ -23,6 +23,7 @@
 #include "cunit/CUnit.h"
 #include "cunit/CUnit_Basic.h"
 
+#include "lang/compile.h"
 #include "lang/interp.h"
 
 
@@ -61,6 +62,7 @@ static void test_exec_simple(void)
 
     CU_ASSERT(0 < interp_execute_string(&env, "0x10", &res) && val_is_number(res) && val_2_integer(res) == 16);
     CU_ASSERT(0 < interp_execute_string(&env, "0X10", &res) && val_is_number(res) && val_2_integer(res) == 16);
+    CU_ASSERT(0 < interp_execute_string(&env, "0b1010", &res) && val_is_number(res) && val_2_integer(res) == 10);
 
     // float token is not supported by lex
     //CU_ASSERT(0 < interp_execute_string((envenv, "1.0001", &res) && val_is_number(*res) && val_2_double(*res) == 1.0001);
@@ -512,6 +514,99 @@ static void test_exec_while(void)
     env_deinit(&env);
 }
 
+static void test_exec_switch(void)
+{
+    env_t env;
+    val_t *res;
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+
+    // dense number cases, fallthrough, default
+    CU_ASSERT(0 < interp_execute_string(&env, "var a = 0, b = 0, k = 9;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "switch 2 {case 1: a = 1; break; case 2: a = 2; case 3: b = 3; break; default: a = 9}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 2 && b == 3", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "switch 7 {case 1: a = 1; default: a = 9}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 9", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "switch '1' {case 1: a = 1;}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 9", &res) && val_is_boolean(res) && val_is_true(res));
+
+    // sparse and string cases
+    CU_ASSERT(0 < interp_execute_string(&env, "switch 'bb' {case 'a': a = 1; break; case 'bb': a = 2; break; case 3000: a = 3}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 2", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "switch 3000 {case 'a': a = 1; break; case -7: a = 2; break; case 3000: a = 3}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 3", &res) && val_is_boolean(res) && val_is_true(res));
+
+    // none constant cases
+    CU_ASSERT(0 < interp_execute_string(&env, "switch 10 {case k: a = 1; break; case k + 1: a = 2; break; default: a = 0}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a == 2", &res) && val_is_boolean(res) && val_is_true(res));
+
+    // break and continue in loop
+    CU_ASSERT(0 < interp_execute_string(&env, "a = 0, b = 0;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "while (a < 6) {a = a + 1; switch a {case 2: continue; case 4: break; default: b = b + 1} b = b + 10}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "b == 54", &res) && val_is_boolean(res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
+static void test_exec_for(void)
+{
+    env_t env;
+    val_t *res;
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var o = {a: 1, b: 2}, a = [1, 2, 3], k, s = 0;", &res));
+
+    // in
+    CU_ASSERT(0 < interp_execute_string(&env, "'a' in o && !('c' in o) && 2 in a && !(3 in a)", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "'a' in 1", &res) && val_is_boolean(res) && !val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "1.5 in a || -0.5 in a || NaN in a", &res) && val_is_boolean(res) && !val_is_true(res));
+
+    // for in
+    CU_ASSERT(0 < interp_execute_string(&env, "for (k in o) s = s + o[k]", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 3 && k == 'b'", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "for k in a {s = s + k}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 6", &res) && val_is_boolean(res) && val_is_true(res));
+
+    // for of, break & continue
+    CU_ASSERT(0 < interp_execute_string(&env, "for (var v of a) {if (v == 1) continue; if (v == 3) break; s = s + v}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 8 && v == 3", &res) && val_is_boolean(res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def f(x) {var n = 0; for (var i of x) n = n + i; return n}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f(o) == 3 && f(a) == 6 && f(1) == 0", &res) && val_is_boolean(res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
+#define MOD_CPL_SIZE    10240
+#define MOD_IMG_SIZE    4096
+
+static uint8_t mod_cpl_buf[MOD_CPL_SIZE];
+static uint8_t mod_img_buf[MOD_IMG_SIZE];
+
+static void test_exec_for_rebind(void)
+{
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    int img_sz;
+    const char *input = "                                       \
+        def f(x) return x + 1;                                  \
+        var a = [1];                                            \
+        def g() { for (f of a) {} }                             \
+        g();                                                    \
+        f(2);                                                   \
+        ";
+
+    // function rebound by the loop is not inlined, the call fails
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, mod_cpl_buf, MOD_CPL_SIZE));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, mod_img_buf, MOD_IMG_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, mod_img_buf, img_sz));
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE, &image));
+    CU_ASSERT(-ERR_InvalidCallor == interp_execute_image(&env, &res));
+
+    env_deinit(&env);
+}
+
 static void test_exec_function(void)
 {
     env_t env;
@@ -608,6 +703,7 @@ static void test_exec_native(void)
 {
     env_t env;
     val_t *res;
+    int used;
     native_t native_entry[] = {
         {"one", test_native_one},
         {"add", test_native_add},
@@ -632,6 +728,49 @@ static void test_exec_native(void)
     CU_ASSERT(0 < interp_execute_string(&env, "a = (0 + add(b, one())) * 1;", &res) && val_is_number(res) && 1000 == val_2_double(res));
     CU_ASSERT(0 < interp_execute_string(&env, "a == 1000", &res) && val_is_boolean(res) && val_is_true(res));
 
+    // Index memory of natives is reused, while the number fits in it
+    used = env.symbal_buf_used;
+    CU_ASSERT(0 == env_native_set(&env, native_entry + 1, 2));
+    CU_ASSERT(0 == env_native_set(&env, native_entry, 3));
+    CU_ASSERT(used == env.symbal_buf_used);
+    CU_ASSERT(0 < interp_execute_string(&env, "fib(add(one(), 4))", &res) && val_is_number(res) && 5 == val_2_double(res));
+
+    env_deinit(&env);
+}
+
+#define NATIVE_MANY     300
+#define NATIVE_BUF_SIZE (48 * 1024)
+
+static uint8_t native_buf[NATIVE_BUF_SIZE];
+static char    native_names[NATIVE_MANY][8];
+static native_t native_many[NATIVE_MANY];
+
+static void test_exec_native_many(void)
+{
+    env_t env;
+    val_t *res;
+    int i;
+
+    for (i = 0; i < NATIVE_MANY; i++) {
+        sprintf(native_names[i], "n%d", i);
+        native_many[i].name = native_names[i];
+        native_many[i].fn = i % 2 ? test_native_add : test_native_one;
+    }
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, native_buf, NATIVE_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, native_many, NATIVE_MANY));
+    CU_ASSERT(NATIVE_MANY == env.native_num);
+    CU_ASSERT(NULL != env.native_index);
+
+    CU_ASSERT(0 < interp_execute_string(&env, "n0() + n298()", &res) && val_is_number(res) && 2 == val_2_double(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n1(2, 3) + n299(4, 5)", &res) && val_is_number(res) && 14 == val_2_double(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n217(n0(), n256())", &res) && val_is_number(res) && 2 == val_2_double(res));
+
+    // Too many natives, the natives set before are kept
+    CU_ASSERT(0 != env_native_set(&env, native_many, LIMIT_NATIVE_SIZE + 1));
+    CU_ASSERT(ERR_ResourceOutLimit == env.error);
+    CU_ASSERT(NATIVE_MANY == env.native_num);
+
     env_deinit(&env);
 }
 
@@ -687,6 +826,77 @@ static void test_exec_native_call_script(void)
     env_deinit(&env);
 }
 
+static void test_exec_constant_pool(void)
+{
+    env_t env;
+    val_t *res;
+    int num, str;
+    native_t native_entry[] = {
+        {"one", test_native_one},
+        {"add", test_native_add},
+        {"fib", test_native_fib},
+        {"call", test_native_call}
+    };
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT(0 == env_native_set(&env, native_entry, 4));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var a = 1.5, b = 'x', c = 'y';", &res));
+    num = env.exe.number_num;
+    str = env.exe.string_num;
+
+    // literals already in pool should be reused
+    CU_ASSERT(0 < interp_execute_string(&env, "a = 1.5 + 1.5", &res) && val_is_number(res) && 3 == val_2_double(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "b = 'x' + 'y'", &res) && val_is_string(res));
+    CU_ASSERT(num == env.exe.number_num && str == env.exe.string_num);
+
+    CU_ASSERT(0 < interp_execute_string(&env, "add(call(one), fib(10)) == 14", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def f(p, q, r, s, t) {var u = p, v = q; return u + v + r + s + t}", &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f(1, 2, 3, 4, 5) == 15", &res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
+static void test_exec_compile_cache(void)
+{
+    env_t env;
+    val_t *res;
+    int i, fn_num;
+    char buf[128];
+    native_t native_entry[] = {
+        {"one", test_native_one},
+    };
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT(0 == env_native_set(&env, native_entry, 1));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var a = 0;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def f() return a", &res) && val_is_function(res));
+    fn_num = env.exe.func_num;
+    for (i = 0; i < 10; i++) {
+        CU_ASSERT(0 < interp_execute_string(&env, "a = a + 1", &res) && val_is_number(res) && i + 1 == val_2_integer(res));
+        CU_ASSERT(0 < interp_execute_string(&env, "def f() return a", &res) && val_is_function(res));
+        CU_ASSERT(0 < interp_execute_stmts(&env, "a = a + 1; a = a - 1; f()", &res) && val_is_number(res) && i + 1 == val_2_integer(res));
+    }
+    // function defined by cached code should be reused
+    CU_ASSERT(fn_num == env.exe.func_num);
+
+    // native function shadowed by main variable defined later
+    CU_ASSERT(0 < interp_execute_string(&env, "one", &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "var one = 5", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "one", &res) && val_is_number(res) && 5 == val_2_integer(res));
+
+    // entries be evicted, while cache full
+    for (i = 0; i < 100; i++) {
+        snprintf(buf, 128, "a = %d%*s", i % 10, i, "");
+        CU_ASSERT(0 < interp_execute_string(&env, buf, &res) && val_is_number(res) && i % 10 == val_2_integer(res));
+    }
+    CU_ASSERT(env.exe.cache_used <= env.exe.cache_size);
+    CU_ASSERT(0 < interp_execute_string(&env, "f() == 9", &res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
 static void test_exec_string(void)
 {
     env_t env;
@@ -838,6 +1048,73 @@ static void test_exec_array(void)
     env_deinit(&env);
 }
 
+static void test_exec_lazy(void)
+{
+    env_t env;
+    val_t *res;
+    int num;
+    const char *input = "                                                   \
+        var a = 1;                                                          \
+        def fact(x) { if (x > 1) return x * fact(x - 1) else return 1 }     \
+        def add(x) { def inner(y) return x + y + a; return inner }          \
+        ";
+    const char *more = "                                                    \
+        def unused() { var s = 0, i; for (i in [1, 2, 3]) s = s + i; return s } \
+        def later() return b;                                               \
+        var b = 2;                                                          \
+        ";
+    const char *skip = "                                                    \
+        def braces() { var o = {s: '}{'}; if (o.s == '}{') { return o.s } } \
+        def broken() { var = ; }                                            \
+        ";
+    const char *consts = "                                                  \
+        const PI = 3, N = 'pi';                                             \
+        def area(r) { return PI * r * r }                                   \
+        def name() { return N }                                             \
+        def set() { PI = 4; return PI }                                     \
+        ";
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT_FATAL(0 < interp_execute_lazy(&env, input, &res));
+    CU_ASSERT_FATAL(0 < interp_execute_lazy(&env, more, &res));
+    num = env.exe.func_num;
+
+    // body is compiled on the first call, once
+    CU_ASSERT(0 < interp_execute_string(&env, "fact(5)", &res) && val_is_number(res) && 120 == val_2_integer(res));
+    CU_ASSERT(num + 1 == env.exe.func_num);
+    CU_ASSERT(0 < interp_execute_string(&env, "fact(6)", &res) && val_is_number(res) && 720 == val_2_integer(res));
+    CU_ASSERT(num + 1 == env.exe.func_num);
+
+    // nested functions are compiled with the owner
+    CU_ASSERT(0 < interp_execute_string(&env, "var f = add(10); f(100)", &res) && val_is_number(res) && 111 == val_2_integer(res));
+    CU_ASSERT(num + 3 == env.exe.func_num);
+    CU_ASSERT(0 < interp_execute_string(&env, "a = 2; f(100) + add(20)(200)", &res) && val_is_number(res) && 334 == val_2_integer(res));
+    CU_ASSERT(num + 3 == env.exe.func_num);
+
+    // bodies are skipped by parse, errors in them are found on the first call
+    CU_ASSERT_FATAL(0 < interp_execute_lazy(&env, skip, &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "braces() == '}{'", &res) && val_is_true(res));
+
+    // variables defined after the function are not visible
+    CU_ASSERT(-ERR_NotDefinedId == interp_execute_string(&env, "later()", &res));
+
+    env_deinit(&env);
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT_FATAL(0 < interp_execute_lazy(&env, skip, &res));
+    CU_ASSERT(-ERR_InvalidToken == interp_execute_string(&env, "broken()", &res));
+
+    env_deinit(&env);
+
+    // constants of main visible at definition, are known by the lazy function
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT_FATAL(0 < interp_execute_lazy(&env, consts, &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "area(2) == 12 && name() == 'pi'", &res) && val_is_true(res));
+    CU_ASSERT(-ERR_InvalidLeftValue == interp_execute_string(&env, "set()", &res));
+
+    env_deinit(&env);
+}
+
 static void test_exec_closure(void)
 {
     env_t env;
@@ -898,6 +1175,42 @@ static void test_exec_func_arg(void)
     env_deinit(&env);
 }
 
+static void test_exec_typed_op(void)
+{
+    env_t env;
+    val_t *res;
+
+    char *sum = "def sum(n) {                   \
+                     var i = 0, s = 0;          \
+                     while (i < n) {            \
+                         s = s + i;             \
+                         if (i == 3) s = und;   \
+                         i++;                   \
+                     }                          \
+                     return s;                  \
+                 }";
+    char *inc = "def inc(n) {                   \
+                     var i = n * 1;             \
+                     i++; ++i; i--;             \
+                     return i > 3 ? --i : i++;  \
+                 }";
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var und;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, sum, &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "sum(3)", &res) && val_is_number(res) && 3 == val_2_double(res));
+    // variable is not a number any more, fall back to generic operation
+    CU_ASSERT(0 < interp_execute_string(&env, "sum(5)", &res) && val_is_nan(res));
+
+    CU_ASSERT(0 < interp_execute_string(&env, inc, &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "inc(3)", &res) && val_is_number(res) && 3 == val_2_double(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "inc(1)", &res) && val_is_number(res) && 2 == val_2_double(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "inc(und)", &res) && val_is_nan(res));
+
+    env_deinit(&env);
+}
+
 static void test_exec_gc(void)
 {
     env_t env;
@@ -1010,6 +1323,172 @@ static void test_exec_gc_reference(void)
     env_deinit(&env);
 }
 
+#define GEN_HEAP_SIZE   (32 * 1024)
+#define GEN_BUF_SIZE    (sizeof(val_t) * STACK_SIZE + GEN_HEAP_SIZE + EXE_MEM_SPACE + SYM_MEM_SPACE)
+
+static uint8_t gen_env_buf[GEN_BUF_SIZE];
+
+static void test_exec_gc_generation(void)
+{
+    env_t env;
+    val_t *res;
+    void *keep;
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, gen_env_buf, GEN_BUF_SIZE, NULL, GEN_HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT_FATAL(env.old != NULL);
+    CU_ASSERT(0 == env_callback_set(&env, gc_callback));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var n = 0, o = {s: 'hello' + '.', a: []}, s;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def add(a, b) {var x = a + b; return def() {return x}}", &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "var f = add('a', 'b');", &res));
+
+    // long lived objects are promoted, by minor gc
+    gc_count = 0;
+    CU_ASSERT(0 < interp_execute_string(&env, "while(n < 1000) {'aaaaaa' + 'bbbbbb'; n += 1}", &res));
+    CU_ASSERT(0 == gc_count);
+    CU_ASSERT(0 < interp_execute_string(&env, "o", &res) && val_is_object(res));
+    keep = (void *)val_2_intptr(res);
+    CU_ASSERT(heap_is_owned(env.old, keep));
+
+    // young objects stored in old objects
+    CU_ASSERT(0 < interp_execute_string(&env, "o.b = 'world' + '.';", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a.push({v: 'x' + '1'}, ['y' + '2']);", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a.unshift('z' + '3');", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s = o.s + o.b; f = add('c', 'd');", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 1000) {'aaaaaa' + 'bbbbbb'; n += 1}", &res));
+    CU_ASSERT(0 == gc_count);
+
+    CU_ASSERT(0 < interp_execute_string(&env, "o", &res) && val_is_object(res) && keep == (void *)val_2_intptr(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.s == 'hello.'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.b == 'world.'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a[0] == 'z3'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a[1].v == 'x1'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a[2][0] == 'y2'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 'hello.world.'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f() == 'cd'", &res) && val_is_true(res));
+
+    // full gc, when old space is not enough
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 200) {o.a.push('aaaaaa' + 'bbbbbb'); n += 1}", &res));
+    CU_ASSERT(0 < gc_count);
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a[0] == 'z3' && o.a[1].v == 'x1' && o.a[202] == 'aaaaaabbbbbb'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 1000) {o.a = ['aaaaaa' + 'bbbbbb']; n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a[0] == 'aaaaaabbbbbb'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.s + o.b == s", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f() == 'cd'", &res) && val_is_true(res));
+
+    // heap full of live objects in young and old space, full gc should fit
+    CU_ASSERT(0 < interp_execute_string(&env, "var a = [], t; n = 0; while (n < 2000) {t = {i: n, l: [n]}; if (t == undefined) break; a.push(t); n += 1} n", &res) && val_2_integer(res) < 2000);
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while (n < 1000) {a[n % 8] = {i: n, l: [n]}; n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a[9].i == 9 && a[9].l[0] == 9 && f() == 'cd'", &res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
+static int gc_step_count = 0;
+static val_t test_native_gc_step(env_t *env, int ac, val_t *av)
+{
+    (void) ac;
+    (void) av;
+
+    gc_step_count += env->gc_cycle;
+    return val_mk_undefined();
+}
+
+static void test_exec_gc_incremental(void)
+{
+    env_t env;
+    val_t *res;
+    native_t native_entry[] = {
+        {"gc_step", test_native_gc_step}
+    };
+
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT(0 == env_native_set(&env, native_entry, 1));
+    CU_ASSERT(0 == env_callback_set(&env, gc_callback));
+    CU_ASSERT(0 == env_gc_slice_set(&env, 64));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var n = 0, a = [], o = {s: 'hello' + '.'}, s;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def add(a, b) {var x = a + b; return def() {return x}}", &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "var f = add('a', 'b');", &res));
+
+    // gc be done step by step, in allocations
+    gc_count = 0;
+    gc_step_count = 0;
+    CU_ASSERT(0 < interp_execute_string(&env, "while(n < 1000) {s = 'aaaaaa' + 'bbbbbb'; a = [s, {v: s}]; o.b = a; gc_step(); n += 1}", &res));
+    CU_ASSERT(0 < gc_count);
+    CU_ASSERT(0 < gc_step_count);
+
+    CU_ASSERT(0 < interp_execute_string(&env, "o.s == 'hello.'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.b == a && a[1].v == s", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 'aaaaaabbbbbb'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f() == 'ab'", &res) && val_is_true(res));
+
+    // stop the world gc
+    CU_ASSERT(0 == env_gc_slice_set(&env, 0));
+    CU_ASSERT(0 == env.gc_cycle && gc_count % 2 == 0);
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 1000) {s = 'aaaaaa' + 'cccccc'; n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.b[1].v + s == 'aaaaaabbbbbbaaaaaacccccc'", &res) && val_is_true(res));
+
+    env_deinit(&env);
+
+    // in generational, old space is collected incrementally
+    CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, gen_env_buf, GEN_BUF_SIZE, NULL, GEN_HEAP_SIZE, NULL, STACK_SIZE));
+    CU_ASSERT(0 == env_native_set(&env, native_entry, 1));
+    CU_ASSERT(0 == env_callback_set(&env, gc_callback));
+    CU_ASSERT(0 == env_gc_slice_set(&env, 64));
+
+    gc_count = 0;
+    gc_step_count = 0;
+    CU_ASSERT(0 < interp_execute_string(&env, "var n = 0, a = [], s;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "while(n < 50) {a.push('aaaaaa' + 'bbbbbb'); gc_step(); n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 2000) {s = ['aaaaaa' + 'cccccc']; a[n % 50] = s; gc_step(); n += 1}", &res));
+    CU_ASSERT(0 < gc_count);
+    CU_ASSERT(0 < gc_step_count);
+    CU_ASSERT(0 < interp_execute_string(&env, "a[0][0] == 'aaaaaacccccc' && a[49] == s", &res) && val_is_true(res));
+
+    // heap full of live objects, copies of gc should fit with allocations in it
+    CU_ASSERT(0 < interp_execute_string(&env, "a = []; n = 0; while (n < 2000) {s = {i: n, l: [n, n]}; if (s == undefined) break; a.push(s); n += 1} n", &res) && val_2_integer(res) < 2000);
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while (n < 2000) {a[n % 8] = {i: n, l: [n, n]}; gc_step(); n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "a[9].i == 9 && a[9].l[1] == 9 && a[0].l[0] == 1992", &res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
+static void test_exec_gc_compact(void)
+{
+    env_t env;
+    val_t *res;
+    int exe_size = GEN_BUF_SIZE - GEN_HEAP_SIZE - sizeof(val_t) * STACK_SIZE;
+    int num_max, str_max, fn_max, code_max;
+
+    CU_ASSERT_FATAL(0 == env_exe_memery_distribute(exe_size, &num_max, &str_max, &fn_max, &code_max));
+    CU_ASSERT_FATAL(0 == env_init(&env, gen_env_buf, GEN_BUF_SIZE, NULL, GEN_HEAP_SIZE, NULL, STACK_SIZE,
+                                  num_max, str_max, fn_max, code_max, ENV_FL_INTERACTIVE | ENV_FL_GC_COMPACT));
+    CU_ASSERT(env.gc_compact && env.old == NULL && env.heap->size > GEN_HEAP_SIZE * 3 / 4);
+    CU_ASSERT(0 != env_gc_slice_set(&env, 64));
+    CU_ASSERT(0 == env_callback_set(&env, gc_callback));
+
+    CU_ASSERT(0 < interp_execute_string(&env, "var n = 0, a = [], o = {}, s;", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a = 1; o.b = 2; o.c = 3; o.d = 4; o.e = 5; o.f = 6; o.g = 7; o.h = 8; o.i = 9; o.j = 'x' + 'y';", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "def add(a, b) {var x = a + b; return def() {return x}}", &res) && val_is_function(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "var f = add('a', 'b');", &res));
+
+    // live objects more than half of heap
+    gc_count = 0;
+    CU_ASSERT(0 < interp_execute_string(&env, "while(n < 600) {a.push('aaaaaa' + 'bbbbbb'); n += 1}", &res));
+    CU_ASSERT(0 < interp_execute_string(&env, "n = 0; while(n < 1000) {s = 'aaaaaa' + 'cccccc'; o.j += 'z'; o.j = 'x' + 'y'; n += 1}", &res));
+    CU_ASSERT(0 < gc_count);
+    env_heap_gc(&env, 0);
+    CU_ASSERT(env.heap->free > GEN_HEAP_SIZE / 2);
+
+    CU_ASSERT(0 < interp_execute_string(&env, "a[0] == 'aaaaaabbbbbb' && a[599] == a[0]", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "s == 'aaaaaacccccc'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "o.a + o.i == 10 && o.j == 'xy'", &res) && val_is_true(res));
+    CU_ASSERT(0 < interp_execute_string(&env, "f() == 'ab'", &res) && val_is_true(res));
+
+    env_deinit(&env);
+}
+
 static void test_exec_op_neg(void)
 {
     env_t env;
@@ -1635,11 +2114,23 @@ static void test_exec_stmts(void)
 {
     env_t env;
     val_t *res;
+    char input[2048];
+    int i, n = 0;
 
     CU_ASSERT_FATAL(0 == interp_env_init_interactive(&env, env_buf, ENV_BUF_SIZE, NULL, HEAP_SIZE, NULL, STACK_SIZE));
 
     CU_ASSERT(0 < interp_execute_stmts(&env, "var a = 1; a + 2 == 3", &res) && val_is_true(res));
 
+    // Parser heap is reset by each statement, with the names interned
+    for (i = 0; i < 25; i++) {
+        n += snprintf(input + n, sizeof(input) - n, "var v%d = 1; ", i);
+    }
+    for (i = 0; i < 60; i++) {
+        n += snprintf(input + n, sizeof(input) - n, "v%d = v%d + 1; ", i % 25, i % 25);
+    }
+    snprintf(input + n, sizeof(input) - n, "v0 + v24");
+    CU_ASSERT(0 < interp_execute_stmts(&env, input, &res) && val_is_number(res) && 7 == val_2_integer(res));
+
     env_deinit(&env);
     return;
 }
@@ -1659,18 +2150,29 @@ CU_pSuite test_lang_interp_entry()
         CU_add_test(suite, "exec selfop",       test_exec_selfop);
         CU_add_test(suite, "exec if stmt",      test_exec_if);
         CU_add_test(suite, "exec while stmt",   test_exec_while);
+        CU_add_test(suite, "exec switch stmt",  test_exec_switch);
+        CU_add_test(suite, "exec for stmt",     test_exec_for);
+        CU_add_test(suite, "exec for rebind",   test_exec_for_rebind);
 
         CU_add_test(suite, "exec function",     test_exec_function);
         CU_add_test(suite, "exec native",       test_exec_native);
+        CU_add_test(suite, "exec native many",  test_exec_native_many);
         CU_add_test(suite, "exec native call",  test_exec_native_call_script);
+        CU_add_test(suite, "exec constant pool", test_exec_constant_pool);
+        CU_add_test(suite, "exec compile cache", test_exec_compile_cache);
         CU_add_test(suite, "exec string",       test_exec_string);
         CU_add_test(suite, "exec object",       test_exec_object);
         CU_add_test(suite, "exec array",        test_exec_array);
         CU_add_test(suite, "exec closure",      test_exec_closure);
+        CU_add_test(suite, "exec lazy function", test_exec_lazy);
         CU_add_test(suite, "exec stack check",  test_exec_stack_check);
         CU_add_test(suite, "exec function arg", test_exec_func_arg);
+        CU_add_test(suite, "exec typed op",     test_exec_typed_op);
         CU_add_test(suite, "exec gc",           test_exec_gc);
         CU_add_test(suite, "exec gc with ref",  test_exec_gc_reference);
+        CU_add_test(suite, "exec gc generation", test_exec_gc_generation);
+        CU_add_test(suite, "exec gc incremental", test_exec_gc_incremental);
+        CU_add_test(suite, "exec gc compact",   test_exec_gc_compact);
 
         CU_add_test(suite, "exec op neg",       test_exec_op_neg);
         CU_add_test(suite, "exec op not",       test_exec_op_not);
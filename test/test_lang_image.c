@@ -23,6 +23,7 @@
 #include "cunit/CUnit.h"
 #include "cunit/CUnit_Basic.h"
 
+#include "lang/bcode.h"
 #include "lang/compile.h"
 #include "lang/interp.h"
 
@@ -66,12 +67,601 @@ static void test_image_simple(void)
     CU_ASSERT_FATAL(0 <= interp_execute_image(&env, &res));// && val_is_number(res) && 1 == val_2_double(res));
 }
 
+static void test_image_order(void)
+{
+    int img_sz;
+    env_t env;
+    image_info_t image;
+    const char *input = "                                           \
+        def f(a) { def h(s) return s + 'x'; return h(a) + 'y' }     \
+        def g() { var t = 'z'; return t }                           \
+        f('a') + g();                                               \
+        ";
+
+    // function is compiled at its definition, constants and functions
+    // are in the order they appear in source
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(4 == image.str_cnt && 4 == image.fn_cnt);
+
+    CU_ASSERT(0 == strcmp("x", image_get_string(&image, 0)));
+    CU_ASSERT(0 == strcmp("y", image_get_string(&image, 1)));
+    CU_ASSERT(0 == strcmp("z", image_get_string(&image, 2)));
+    CU_ASSERT(0 == strcmp("a", image_get_string(&image, 3)));
+    CU_ASSERT(1 == executable_func_get_arg_cnt(image_get_function(&image, 2)));
+    CU_ASSERT(0 == executable_func_get_arg_cnt(image_get_function(&image, 3)));
+}
+
+static int check_count;
+static val_t test_image_check(env_t *env, int ac, val_t *av)
+{
+    (void) env;
+
+    if (ac > 0 && val_is_true(av)) {
+        check_count++;
+    }
+    return val_mk_undefined();
+}
+
+static void test_image_function(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                               \
+        var a = 1, b = 2;                               \
+        def add(x) {                                    \
+            var n = x + a;                              \
+            def inner(y) return n + y + b;              \
+            return inner;                               \
+        }                                               \
+        def fact(x) { if (x > 1) return x * fact(x - 1) else return 1 } \
+        var c = 'hello', f = add(10);                   \
+        check(f(100) == 113);                           \
+        check(fact(5) == 120);                          \
+        var g = def() return def() return c;            \
+        check(g()() == 'hello');                        \
+        ";
+
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT(6 == image.fn_cnt);
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+}
+
+static int test_image_count(const uint8_t *entry, int bc)
+{
+    const uint8_t *code = executable_func_get_code(entry);
+    int size = executable_func_get_code_size(entry);
+    int off = 0, n = 0;
+
+    while (off < size) {
+        const char *name;
+        int p1, p2;
+
+        n += code[off] == bc;
+        bcode_parse(code, &off, &name, &p1, &p2);
+    }
+    return n;
+}
+
+// return: offset of first instruction, or -1
+static int test_image_find(const uint8_t *entry, int bc)
+{
+    const uint8_t *code = executable_func_get_code(entry);
+    int size = executable_func_get_code_size(entry);
+    int off = 0;
+
+    while (off < size) {
+        const char *name;
+        int p1, p2;
+
+        if (code[off] == bc) {
+            return off;
+        }
+        bcode_parse(code, &off, &name, &p1, &p2);
+    }
+    return -1;
+}
+
+static int test_image_calls(const uint8_t *entry)
+{
+    return test_image_count(entry, BC_FUNC_CALL);
+}
+
+static void test_image_inline(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                                           \
+        def clamp(x, lo, hi) return x < lo ? lo : x > hi ? hi : x;  \
+        def twice(x) return x + x;                                  \
+        def dec(x) return x - 1;                                    \
+        dec = def(x) return x + 1;                                  \
+        def sum(n) {                                                \
+            var s = 0;                                              \
+            while (n > 0) { s = s + clamp(n, 2, 4); n--; }          \
+            return s;                                               \
+        }                                                           \
+        check(clamp(5, 0, 3) == 3);                                 \
+        check(clamp(twice(-1), twice(0), 3) == 0);                  \
+        check(twice(2, check(1)) == 4);                             \
+        check(dec(1) == 2);                                         \
+        check(sum(5) == 15);                                        \
+        ";
+
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(6 == image.fn_cnt);
+
+    // only calls of check, the reassigned dec and sum are left
+    CU_ASSERT(8 == test_image_calls(image_get_function(&image, 0)));
+    CU_ASSERT(0 == test_image_calls(image_get_function(&image, 5)));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(6 == check_count);
+}
+
+static void test_image_inline_room(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                                           \
+        def add(a, b) return a + b;                                 \
+        def f() {                                                   \
+            var r = add(1, 2);                                      \
+            var v0, v1, v2, v3, v4, v5, v6, v7, v8, v9;             \
+            var w0, w1, w2, w3, w4, w5, w6, w7, w8, w9;             \
+            var u0, u1, u2, u3, u4, u5, u6, u7, u8, u9;             \
+            return r;                                               \
+        }                                                           \
+        check(f() == 3);                                            \
+        ";
+
+    // No room for the hidden variables of add in f, it is called normally
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT(1 == test_image_calls(image_get_function(&image, 2)));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(1 == check_count);
+}
+
+static void test_image_stack(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    const char *input = "                               \
+        var f = def(a, b) return a + b * (a - b);       \
+        var g = def(n) return g(n + f(n, 1));           \
+        g(0);                                           \
+        ";
+
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(3 == image.fn_cnt);
+
+    // a, b, a, b
+    CU_ASSERT(4 == executable_func_get_stack_high(image_get_function(&image, 1)));
+    // n, 1, n, f
+    CU_ASSERT(4 == executable_func_get_stack_high(image_get_function(&image, 2)));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 64, &image));
+    CU_ASSERT(-ERR_StackOverflow == interp_execute_image(&env, &res));
+}
+
+static void test_image_const(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                               \
+        const N = 4, M = N * 2 + 1, S = 'x', O = {v: 3};\
+        def f(x) return x * M + N;                      \
+        def g() return (N + M) * -N;                    \
+        check(f(1) == 13);                              \
+        check(g() == -52);                              \
+        O.v = 5; check(S == 'x' && O.v == 5);           \
+        ";
+
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(3 == image.fn_cnt);
+
+    // constants are inlined, and folded
+    CU_ASSERT(1 == test_image_count(image_get_function(&image, 1), BC_PUSH_VAR));
+    CU_ASSERT(0 == test_image_count(image_get_function(&image, 2), BC_PUSH_VAR));
+    CU_ASSERT(0 == test_image_count(image_get_function(&image, 2), BC_MUL));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+
+    // constant could not be assigned
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT(-ERR_InvalidLeftValue == compile_exe(&env, "const a = 1; a = 2;", img_buf, IMG_BUF_SIZE));
+    CU_ASSERT(-ERR_InvalidLeftValue == compile_exe(&env, "const a = {}; def f() a++;", img_buf, IMG_BUF_SIZE));
+}
+
+static void test_image_scalar(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                                           \
+        def f(a, b) {                                               \
+            var p = {x: a, 'y': b}, s = 0;                          \
+            while (a > 0) { var q = [a, p.y]; s += q[0] * q[1]; a--; }\
+            p.x += 1;                                               \
+            return p.x * p['y'] + s;                                \
+        }                                                           \
+        def g(a) { var p = {x: a}; return p; }                      \
+        def h(a) { var p = {x: a}, c = p; p.x = 0; return c.x; }    \
+        check(f(2, 3) == 18);                                       \
+        check(g(5).x == 5);                                         \
+        check(h(5) == 0);                                           \
+        ";
+
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(4 == image.fn_cnt);
+
+    // literals never escape are not created
+    CU_ASSERT(0 == test_image_count(image_get_function(&image, 1), BC_DICT));
+    CU_ASSERT(0 == test_image_count(image_get_function(&image, 1), BC_ARRAY));
+    CU_ASSERT(0 == test_image_count(image_get_function(&image, 1), BC_PROP));
+    CU_ASSERT(1 == test_image_count(image_get_function(&image, 2), BC_DICT));
+    CU_ASSERT(1 == test_image_count(image_get_function(&image, 3), BC_DICT));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+}
+
+static void test_image_cse(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                                           \
+        var cfg = {net: {retry: {timeout: 3, count: 2}}};           \
+        def f(a) {                                                  \
+            var t = cfg.net.retry.timeout * a;                      \
+            return t + cfg.net.retry.timeout + cfg.net.retry.count; \
+        }                                                           \
+        def g(p, q) {                                               \
+            var x = p.a.b;                                          \
+            q.b = x + 1;                                            \
+            return x + p.a.b;                                       \
+        }                                                           \
+        def h(p) {                                                  \
+            var x = p.a.b;                                          \
+            p.a = {b: 0};                                           \
+            return x + p.a.b;                                       \
+        }                                                           \
+        var o = {a: {b: 1}};                                        \
+        check(f(2) == 11);                                          \
+        check(g(o, o.a) == 3);                                      \
+        check(h(o) == 2);                                           \
+        ";
+
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(4 == image.fn_cnt);
+
+    // cfg.net.retry and cfg.net.retry.timeout are loaded once
+    CU_ASSERT(4 == test_image_count(image_get_function(&image, 1), BC_PROP));
+    // p.a.b is loaded again after store to property b or a
+    CU_ASSERT(4 == test_image_count(image_get_function(&image, 2), BC_PROP));
+    CU_ASSERT(4 == test_image_count(image_get_function(&image, 3), BC_PROP));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+}
+
+static void test_image_cse_branch(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                                           \
+        var g0 = {x: 1, y: 2, n: {x: 4, y: 5}};                     \
+        var g1 = {x: 1, y: 2, n: {x: 4, y: 5}};                     \
+        def f1(c) {                                                 \
+            if (c) { g0.n.y = g0.n.x; } else { g0.y = g0.n.x; }     \
+        }                                                           \
+        def f2(c) {                                                 \
+            switch (c) {                                            \
+            case 1: g1.n.y = g1.n.x;                                \
+            case 2: g1.y = g1.n.x;                                  \
+            }                                                       \
+        }                                                           \
+        f1(0);                                                      \
+        check(g0.y == 4 && g0.n.y == 5);                            \
+        f2(2);                                                      \
+        check(g1.y == 4 && g1.n.y == 5);                            \
+        f2(1);                                                      \
+        check(g1.y == 4 && g1.n.y == 4);                            \
+        ";
+
+    // Values loaded in a branch or case, are not reused in another one
+    check_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+}
+
+static int square_count;
+static val_t test_image_square(env_t *env, int ac, val_t *av)
+{
+    double d = ac > 0 && val_is_number(av) ? val_2_double(av) : 0;
+
+    (void) env;
+    square_count++;
+    return val_mk_number(d * d);
+}
+
+static void test_image_pure(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    const uint8_t *fn;
+    native_t natives[] = {
+        {"check", test_image_check},
+        {"sq", test_image_square, 1}
+    };
+    const char *input = "                                       \
+        const K = sq(3);                                        \
+        def f(a) return sq(a) + sq(a) + K + sq(2);              \
+        def g(n) {                                              \
+            var s = 0, i = 0, c = n * 2;                        \
+            while (i < n) {                                     \
+                s = s + sq(c) + sq(i);                          \
+                i = i + 1;                                      \
+            }                                                   \
+            return s;                                           \
+        }                                                       \
+        check(f(3) == 31);                                      \
+        check(g(2) == 33);                                      \
+        check(sq(2) + sq(3) == 13);                             \
+        ";
+
+    check_count = 0;
+    square_count = 0;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 2));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(3 == image.fn_cnt);
+
+    // sq is called in compile once for each set of arguments: 3 and 2
+    CU_ASSERT(2 == square_count);
+
+    // sq(3), sq(2) are folded, sq(a) is called once
+    CU_ASSERT(1 == test_image_calls(image_get_function(&image, 1)));
+
+    // sq(c) is called before the loop
+    fn = image_get_function(&image, 2);
+    CU_ASSERT(2 == test_image_calls(fn));
+    CU_ASSERT(test_image_find(fn, BC_FUNC_CALL) < test_image_find(fn, BC_POP_SJMP_T));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 2));
+
+    // once for sq(a), once for the hoisted sq(c), twice for sq(i) in loop
+    square_count = 0;
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+    CU_ASSERT(4 == square_count);
+}
+
+static void test_image_line(void)
+{
+    int img_sz;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    const uint8_t *fn;
+    const char *input =
+        "var a = 1;\n"
+        "def f(x) {\n"
+        "    var y = x * 2;\n"
+        "\n"
+        "    return y + a;\n"
+        "}\n"
+        "a = f(a) > 1 ?\n"
+        "    f(a) : 0;\n";
+
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe(&env, input, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(2 == image.fn_cnt && 0 != image.line_ent);
+
+    fn = image_get_function(&image, 0);
+    CU_ASSERT(0 == image_get_line(&image, 0, 0));
+    CU_ASSERT(7 == image_get_line(&image, 0, executable_func_get_code_size(fn) - 1));
+
+    fn = image_get_function(&image, 1);
+    CU_ASSERT(2 == image_get_line(&image, 1, 0));
+    CU_ASSERT(4 == image_get_line(&image, 1, executable_func_get_code_size(fn) - 1));
+
+    CU_ASSERT(-1 == image_get_line(&image, 2, 0));
+
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+}
+
+static void test_image_stream(void)
+{
+    int img_sz, i, n;
+    env_t env;
+    val_t *res;
+    image_info_t image;
+    lex_iovec_t region;
+    native_t natives[] = {
+        {"check", test_image_check}
+    };
+    const char *input = "                               \
+        const N = 4, S = 'x';                           \
+        var a = 1, b = 2, o = {v: 1};                   \
+        def add(x) {                                    \
+            def inner(y) return x + y + b;              \
+            return inner;                               \
+        }                                               \
+        o.v = o.v + N; o.v = o.v + a;                   \
+        check(add(10)(100) == 112);                     \
+        check(o.v == 6 && S == 'x');                    \
+        while (a < 10) a = a + N;                       \
+        check(a == 13);                                 \
+        ";
+    static char big[8192];
+
+    check_count = 0;
+    region.base = input;
+    region.size = strlen(input);
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe_stream(&env, lex_input_region, &region, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT(3 == image.fn_cnt && 0 != image.line_ent);
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(3 == check_count);
+
+    // parse space hold one statement only
+    n = sprintf(big, "var a = 0;\n");
+    for (i = 0; i < 100; i++) {
+        n += sprintf(big + n, "a = a + %d;\n", i % 3);
+    }
+    n += sprintf(big + n, "check(a == 99);");
+
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT(-ERR_NotEnoughMemory == compile_exe(&env, big, img_buf, IMG_BUF_SIZE));
+
+    check_count = 0;
+    region.base = big;
+    region.size = n;
+    CU_ASSERT_FATAL(0 == compile_env_init(&env, cpl_buf, CPL_BUF_SIZE));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+    CU_ASSERT_FATAL(0 < (img_sz = compile_exe_stream(&env, lex_input_region, &region, img_buf, IMG_BUF_SIZE)));
+    CU_ASSERT_FATAL(0 == image_load(&image, img_buf, img_sz));
+    CU_ASSERT_FATAL(0 == interp_env_init_image(&env, run_buf, RUN_BUF_SIZE,
+            NULL, 8192, NULL, 1024, &image));
+    CU_ASSERT_FATAL(0 == env_native_set(&env, natives, 1));
+
+    CU_ASSERT(0 <= interp_execute_image(&env, &res));
+    CU_ASSERT(1 == check_count);
+}
+
 CU_pSuite test_lang_image_entry()
 {
     CU_pSuite suite = CU_add_suite("lang image", test_setup, test_clean);
 
     if (suite) {
         CU_add_test(suite, "image simple",       test_image_simple);
+        CU_add_test(suite, "image function",     test_image_function);
+        CU_add_test(suite, "image order",        test_image_order);
+        CU_add_test(suite, "image stack",        test_image_stack);
+        CU_add_test(suite, "image inline",       test_image_inline);
+        CU_add_test(suite, "image inline room",  test_image_inline_room);
+        CU_add_test(suite, "image line",         test_image_line);
+        CU_add_test(suite, "image const",        test_image_const);
+        CU_add_test(suite, "image scalar",       test_image_scalar);
+        CU_add_test(suite, "image cse",          test_image_cse);
+        CU_add_test(suite, "image cse branch",   test_image_cse_branch);
+        CU_add_test(suite, "image pure",         test_image_pure);
+        CU_add_test(suite, "image stream",       test_image_stream);
     }
 
     return suite;
@@ -124,6 +124,143 @@ static void test_common(void)
     CU_ASSERT(0 == lex_deinit(&lex));
 }
 
+static void test_keyword(void)
+{
+    lexer_t lex;
+    token_t tok;
+    const char *ids[] = {"iff", "i", "Def", "vars", "functions", "undefine", "elsf", "casE", "$if", "trye"};
+    int i;
+
+    CU_ASSERT(0 == lex_init(&lex, "\
+        if in def var NaN try for else elif case true null false while break catch\
+        throw const return switch default continue function undefined\
+        iff i Def vars functions undefine elsf casE $if trye", NULL));
+
+    CU_ASSERT(lex_match(&lex, TOK_IF));
+    CU_ASSERT(lex_match(&lex, TOK_IN));
+    CU_ASSERT(lex_match(&lex, TOK_DEF));
+    CU_ASSERT(lex_match(&lex, TOK_VAR));
+    CU_ASSERT(lex_match(&lex, TOK_NAN));
+    CU_ASSERT(lex_match(&lex, TOK_TRY));
+    CU_ASSERT(lex_match(&lex, TOK_FOR));
+    CU_ASSERT(lex_match(&lex, TOK_ELSE));
+    CU_ASSERT(lex_match(&lex, TOK_ELIF));
+    CU_ASSERT(lex_match(&lex, TOK_CASE));
+    CU_ASSERT(lex_match(&lex, TOK_TRUE));
+    CU_ASSERT(lex_match(&lex, TOK_NULL));
+    CU_ASSERT(lex_match(&lex, TOK_FALSE));
+    CU_ASSERT(lex_match(&lex, TOK_WHILE));
+    CU_ASSERT(lex_match(&lex, TOK_BREAK));
+    CU_ASSERT(lex_match(&lex, TOK_CATCH));
+    CU_ASSERT(lex_match(&lex, TOK_THROW));
+    CU_ASSERT(lex_match(&lex, TOK_CONST));
+    CU_ASSERT(lex_match(&lex, TOK_RET));
+    CU_ASSERT(lex_match(&lex, TOK_SWITCH));
+    CU_ASSERT(lex_match(&lex, TOK_DEFAULT));
+    CU_ASSERT(lex_match(&lex, TOK_CONTINUE));
+    CU_ASSERT(lex_match(&lex, TOK_DEF));
+    CU_ASSERT(lex_match(&lex, TOK_UND));
+
+    for (i = 0; i < 10; i++) {
+        CU_ASSERT(TOK_ID == lex_token(&lex, &tok) && 0 == strcmp(tok.text, ids[i]));
+        CU_ASSERT(lex_match(&lex, TOK_ID));
+    }
+
+    CU_ASSERT(0 == lex_deinit(&lex));
+}
+
+static void test_input(void)
+{
+    lexer_t lex;
+    token_t tok;
+    lex_iovec_t iov[] = {
+        {"var ab", 6}, {"", 0}, {"c = 'he", 7}, {"llo' // com", 11}, {"ment\n+", 6}, {"= 0x1", 5}, {"f; wh", 5}, {"ile", 3}
+    };
+    lex_iovec_list_t list = {iov, 8};
+    lex_iovec_t region = {"if (a) 12 trailing", 8};
+
+    CU_ASSERT(0 == lex_init_input(&lex, lex_input_iovec, &list));
+
+    CU_ASSERT(lex_match(&lex, TOK_VAR));
+    CU_ASSERT(TOK_ID == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "abc"));
+    CU_ASSERT(lex_match(&lex, TOK_ID));
+    CU_ASSERT(lex_match(&lex, '='));
+    CU_ASSERT(TOK_STR == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "hello"));
+    CU_ASSERT(lex_match(&lex, TOK_STR));
+    CU_ASSERT(lex_match(&lex, TOK_ADDASSIGN));
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "0x1f"));
+    CU_ASSERT(lex_match(&lex, TOK_NUM));
+    CU_ASSERT(lex_match(&lex, ';'));
+    CU_ASSERT(lex_match(&lex, TOK_WHILE));
+    CU_ASSERT(TOK_EOF == lex_token(&lex, NULL));
+
+    // Region is not terminated by 0
+    CU_ASSERT(0 == lex_init_input(&lex, lex_input_region, &region));
+    CU_ASSERT(lex_match(&lex, TOK_IF));
+    CU_ASSERT(lex_match(&lex, '('));
+    CU_ASSERT(lex_match(&lex, TOK_ID));
+    CU_ASSERT(lex_match(&lex, ')'));
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "1"));
+    CU_ASSERT(lex_match(&lex, TOK_NUM));
+    CU_ASSERT(TOK_EOF == lex_token(&lex, NULL));
+
+    CU_ASSERT(0 == lex_deinit(&lex));
+}
+
+static void test_long_token(void)
+{
+    lexer_t lex;
+    token_t tok;
+    char input[512];
+    char name[200];
+    lex_iovec_t iov[3];
+    lex_iovec_list_t list = {iov, 3};
+    int i;
+
+    memset(name, 'a', 199);
+    name[0] = '_';
+    name[199] = 0;
+    snprintf(input, sizeof(input), "\
+    abcdefghijklmnopqrstuvwxyz_$0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ  \t  \n\
+    /* comment ** with * stars\n and lines ********/ // line comment, 'and' \"quotes\"\n\
+    'string with \\'escape\\' and \"quotes\" in the middle of it' \"\\t\\\\ \" %s end", name);
+
+    // Tokens and runs are splited by chunks
+    iov[0].base = input; iov[0].size = 37;
+    iov[1].base = input + 37; iov[1].size = 100;
+    iov[2].base = input + 137; iov[2].size = strlen(input) - 137;
+
+    for (i = 0; i < 2; i++) {
+        if (i == 0) {
+            CU_ASSERT(0 == lex_init(&lex, input, NULL));
+        } else {
+            CU_ASSERT(0 == lex_init_input(&lex, lex_input_iovec, &list));
+        }
+
+        CU_ASSERT(TOK_ID == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "abcdefghijklmnopqrstuvwxyz_$0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+        CU_ASSERT(0 == tok.line && 6 == tok.col);
+        CU_ASSERT(lex_match(&lex, TOK_ID));
+
+        CU_ASSERT(TOK_STR == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "string with 'escape' and \"quotes\" in the middle of it"));
+        CU_ASSERT(3 == tok.line && 4 == tok.col);
+        CU_ASSERT(lex_match(&lex, TOK_STR));
+
+        CU_ASSERT(TOK_STR == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "\t\\ "));
+        CU_ASSERT(lex_match(&lex, TOK_STR));
+
+        // Identifier is truncated by size of token buffer
+        CU_ASSERT(TOK_ID == lex_token(&lex, &tok) && TOKEN_MAX_SIZE - 1 == tok.value && 0 == memcmp(tok.text, name, TOKEN_MAX_SIZE - 1));
+        CU_ASSERT(lex_match(&lex, TOK_ID));
+
+        CU_ASSERT(TOK_ID == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "end"));
+        CU_ASSERT(3 == tok.line);
+        CU_ASSERT(lex_match(&lex, TOK_ID));
+        CU_ASSERT(TOK_EOF == lex_token(&lex, NULL));
+    }
+
+    CU_ASSERT(0 == lex_deinit(&lex));
+}
+
 static void test_mch_tok(void)
 {
     lexer_t lex;
@@ -186,15 +323,36 @@ static void test_hex_number(void)
     CU_ASSERT(lex_match(&lex, TOK_NUM));
 }
 
+static void test_binary_number(void)
+{
+    lexer_t lex;
+    token_t tok;
+
+    CU_ASSERT(0 == lex_init(&lex, "0b101 0B11 0b2", NULL));
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "0b101"));
+    CU_ASSERT(lex_match(&lex, TOK_NUM));
+
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "0b11"));
+    CU_ASSERT(lex_match(&lex, TOK_NUM));
+
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "0b"));
+    CU_ASSERT(lex_match(&lex, TOK_NUM));
+    CU_ASSERT(TOK_NUM == lex_token(&lex, &tok) && 0 == strcmp(tok.text, "2"));
+}
+
 CU_pSuite test_lang_lex_entry()
 {
     CU_pSuite suite = CU_add_suite("lang lex", test_setup, test_clean);
 
     if (suite) {
         CU_add_test(suite, "common",            test_common);
+        CU_add_test(suite, "keyword",           test_keyword);
         CU_add_test(suite, "multiCh token",     test_mch_tok);
+        CU_add_test(suite, "chunked input",     test_input);
+        CU_add_test(suite, "long token",        test_long_token);
         CU_add_test(suite, "floating number",   test_floating_number);
-        CU_add_test(suite, "hex number",   test_floating_number);
+        CU_add_test(suite, "hex number",        test_hex_number);
+        CU_add_test(suite, "binary number",     test_binary_number);
     }
 
     return suite;
@@ -613,7 +613,7 @@ static void test_expr_funcdef(void)
     CU_ASSERT(R_(expr) && ast_expr_type(R_(expr)) == EXPR_FUNCPROC);
     CU_ASSERT(L_(L_(expr)) && ast_expr_type(L_(L_(expr))) == EXPR_ID);
     CU_ASSERT(R_(L_(expr)) && ast_expr_type(R_(L_(expr))) == EXPR_ID);
-    CU_ASSERT(STMT(R_(expr)) && STMT(R_(expr))->next);
+    CU_ASSERT(STMT(R_(expr)) && ast_stmt_next(STMT(R_(expr))));
 
     parse_init(&psr, "def () {}\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (expr = parse_expr(&psr)));
@@ -765,41 +765,41 @@ static void test_stmt_simple(void)
     parse_init(&psr, "a + b;\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_EXPR);
-    CU_ASSERT(stmt->expr->type == EXPR_ADD);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_ADD);
 
     parse_init(&psr, "a - b\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_EXPR);
-    CU_ASSERT(stmt->expr->type == EXPR_SUB);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_SUB);
 
     // break
     parse_init(&psr, "break\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_BREAK);
-    CU_ASSERT(!stmt->expr);
+    CU_ASSERT(!ast_stmt_expr(stmt));
 
     // continue
     parse_init(&psr, "continue", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_CONTINUE);
-    CU_ASSERT(!stmt->expr);
+    CU_ASSERT(!ast_stmt_expr(stmt));
 
     // var
     parse_init(&psr, "var a = 1, b = c = 0", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_VAR);
-    CU_ASSERT(stmt->expr->type == EXPR_COMMA);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_COMMA);
 
     // return
     parse_init(&psr, "return a + b", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_RET);
-    CU_ASSERT(stmt->expr->type == EXPR_ADD);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_ADD);
 
     parse_init(&psr, "return;", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_RET);
-    CU_ASSERT(!stmt->expr);
+    CU_ASSERT(!ast_stmt_expr(stmt));
 }
 
 static void test_stmt_if(void)
@@ -819,9 +819,9 @@ static void test_stmt_if(void)
     // expression
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_IF);
-    CU_ASSERT(stmt->expr->type == EXPR_ADD);
-    CU_ASSERT(stmt->block != NULL);
-    CU_ASSERT(stmt->other != NULL);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_ADD);
+    CU_ASSERT(ast_stmt_block(stmt) != NULL);
+    CU_ASSERT(ast_stmt_other(stmt) != NULL);
 }
 
 static void test_stmt_while(void)
@@ -839,7 +839,7 @@ static void test_stmt_while(void)
     // expression
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_WHILE);
-    CU_ASSERT(stmt->expr->type == EXPR_TGT);
+    CU_ASSERT(ast_stmt_expr(stmt)->type == EXPR_TGT);
 }
 
 static void test_stmt_try(void)
@@ -856,9 +856,9 @@ static void test_stmt_try(void)
     parse_init(&psr, input, NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT_FATAL(stmt->type == STMT_TRY);
-    CU_ASSERT(stmt->block != NULL);
-    CU_ASSERT(stmt->other != NULL);
-    CU_ASSERT(stmt->other->next != NULL);
+    CU_ASSERT(ast_stmt_block(stmt) != NULL);
+    CU_ASSERT(ast_stmt_other(stmt) != NULL);
+    CU_ASSERT(ast_stmt_next(ast_stmt_other(stmt)) != NULL);
 
     input = "\
     try {\n\
@@ -871,21 +871,38 @@ static void test_stmt_try(void)
     parse_init(&psr, input, NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_TRY);
-    CU_ASSERT(stmt->expr != NULL);
-    CU_ASSERT(stmt->block != NULL);
-    CU_ASSERT(stmt->block->next != NULL);
-    CU_ASSERT(stmt->other != NULL);
+    CU_ASSERT(ast_stmt_expr(stmt) != NULL);
+    CU_ASSERT(ast_stmt_block(stmt) != NULL);
+    CU_ASSERT(ast_stmt_next(ast_stmt_block(stmt)) != NULL);
+    CU_ASSERT(ast_stmt_other(stmt) != NULL);
 
     // throw
     parse_init(&psr, "throw;\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_THROW);
-    CU_ASSERT(stmt->expr == NULL);
+    CU_ASSERT(ast_stmt_expr(stmt) == NULL);
 
     parse_init(&psr, "throw Error('some error')\n", NULL, heap_buf, PSR_BUF_SIZE);
     CU_ASSERT_FATAL(0 != (stmt = parse_stmt(&psr)));
     CU_ASSERT(stmt->type == STMT_THROW);
-    CU_ASSERT(stmt->expr != NULL);
+    CU_ASSERT(ast_stmt_expr(stmt) != NULL);
+}
+
+static void test_stmt_compact(void)
+{
+    parser_t psr;
+    stmt_t   *stmt;
+    expr_t   *expr;
+
+    // Identifiers appeared again share the text
+    parse_init(&psr, "count = count + 'count'; count;\n", NULL, heap_buf, PSR_BUF_SIZE);
+    CU_ASSERT_FATAL(0 != (stmt = parse_stmt_multi(&psr)));
+    CU_ASSERT_FATAL(0 != (expr = ast_stmt_expr(stmt)) && ast_stmt_next(stmt));
+    CU_ASSERT(TEXT(L_(expr)) == TEXT(L_(R_(expr))));
+    CU_ASSERT(TEXT(L_(expr)) == TEXT(ast_stmt_expr(ast_stmt_next(stmt))));
+    CU_ASSERT(TEXT(L_(expr)) != TEXT(R_(R_(expr))) && !strcmp(TEXT(R_(R_(expr))), "count"));
+
+    CU_ASSERT(sizeof(expr_t) <= 16 && sizeof(stmt_t) <= 24);
 }
 
 CU_pSuite test_lang_parse_entry()
@@ -916,6 +933,7 @@ CU_pSuite test_lang_parse_entry()
         CU_add_test(suite, "parse statements if",       test_stmt_if);
         CU_add_test(suite, "parse statements while",    test_stmt_while);
         CU_add_test(suite, "parse statements try",      test_stmt_try);
+        CU_add_test(suite, "parse statements compact",  test_stmt_compact);
     }
 
     return suite;
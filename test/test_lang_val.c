@@ -24,6 +24,7 @@
 #include "cunit/CUnit_Basic.h"
 
 #include "lang/val.h"
+#include "lang/type_number.h"
 
 static int test_setup()
 {
@@ -133,6 +134,39 @@ static void test_val_set(void)
     CU_ASSERT(v == val_mk_boolean(1));
 }
 
+static int test_number_same(const char *s)
+{
+    double a, b = strtod(s, NULL);
+
+    return number_parse(s, &a) == (int)strlen(s) && 0 == memcmp(&a, &b, sizeof(a));
+}
+
+static void test_number_parse(void)
+{
+    double v;
+
+    CU_ASSERT(test_number_same("0"));
+    CU_ASSERT(test_number_same("123"));
+    CU_ASSERT(test_number_same("0.1"));
+    CU_ASSERT(test_number_same("3.14159"));
+    CU_ASSERT(test_number_same("1E-3"));
+    CU_ASSERT(test_number_same("123E12"));
+    CU_ASSERT(test_number_same("9007199254740993"));
+    CU_ASSERT(test_number_same("12345678901234567890123"));
+    CU_ASSERT(test_number_same("0.30000000000000004"));
+    CU_ASSERT(test_number_same("2.2250738585072011E-308"));
+    CU_ASSERT(test_number_same("1E400"));
+    CU_ASSERT(test_number_same("0x1F"));
+    CU_ASSERT(test_number_same("0x20000000000001"));
+    CU_ASSERT(test_number_same("0x1000000000000000000000001"));
+
+    CU_ASSERT(5 == number_parse("0b101", &v) && v == 5);
+    CU_ASSERT(1 == number_parse("0b2", &v) && v == 0);
+    CU_ASSERT(56 == number_parse("0b100000000000000000000000000000000000000000000000000011", &v) && v == 9007199254740996.0);
+    CU_ASSERT(0 == number_parse("abc", &v));
+    CU_ASSERT(2 == number_parse("12abc", &v) && v == 12);
+}
+
 CU_pSuite test_lang_val_entry()
 {
     CU_pSuite suite = CU_add_suite("lang value", test_setup, test_clean);
@@ -140,6 +174,7 @@ CU_pSuite test_lang_val_entry()
     if (suite) {
         CU_add_test(suite, "value make", test_val_make);
         CU_add_test(suite, "value set", test_val_set);
+        CU_add_test(suite, "number parse", test_number_parse);
     }
 
     return suite;